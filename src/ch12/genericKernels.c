@@ -0,0 +1,203 @@
+/*
+ * The ch12/ch14 kernels written once for many element types.
+ *
+ * The other examples hard-code int for every array.  Real programs often
+ * need a wider type (int64_t or double) to avoid overflow, or would like a
+ * narrower one (int8_t or int16_t) to move fewer bytes through the memory
+ * system.  Rather than copying every kernel once per type, this program
+ * writes each kernel once as a macro, DEFINE_KERNELS, and expands it for
+ * six types.  Each expansion also names an accumulator type used for
+ * sums, and float adds up into double to limit rounding error.  The integer
+ * types add up into int64_t: a product of two int8_t values is at most 2^14
+ * in magnitude and of two int16_t values at most 2^30, so a row sum cannot
+ * overflow with fewer than 2^49 (int8_t) or 2^33 (int16_t) columns.  There
+ * is no wider type for int32_t and int64_t, whose products can be as large
+ * as the accumulator itself; their values must be small enough for the row
+ * sums to fit (the benchmark's values, 0 to MAX-1, always are).
+ *
+ * C11's _Generic then lets the caller use one name for all the versions:
+ * scalar_multiply(array, len, s) calls scalar_multiply_i8 when array is an
+ * int8_t *, scalar_multiply_f64 when it is a double *, and so on.
+ *
+ * The benchmark runs every kernel for every type on the same number of
+ * elements and prints bytes per element next to the throughput, which
+ * shows how much of each kernel's time is spent moving data.
+ *
+ * To compile: gcc -O2 -std=c11 -o genericKernels genericKernels.c
+ *
+ * To run: ./genericKernels <n>
+ *   where n is the number of elements per array (and per matrix)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define MAX 10   //countElems: values are in the range 0 to MAX-1
+#define NITER 10 //times each kernel is run (time is averaged)
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* DEFINE_KERNELS(T, ACC, NAME) defines the kernels for element type T,
+ * using accumulator type ACC, with names ending in _NAME. */
+#define DEFINE_KERNELS(T, ACC, NAME)                                         \
+                                                                             \
+/* allocates an array of len elements of type T */                           \
+T * allocateArray_##NAME(long len) {                                         \
+    T * result = malloc(len * sizeof(T));                                    \
+    if (result == NULL) print_error("ERROR: malloc failed");                 \
+    return result;                                                           \
+}                                                                            \
+                                                                             \
+/* fills array with random values from 0 to MAX-1 */                         \
+void fillArrayRandom_##NAME(T * array, long len) {                           \
+    long i;                                                                  \
+    for (i = 0; i < len; i++) {                                              \
+        array[i] = (T)(rand() % MAX);                                        \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+/* multiplies each element of array by scalar */                             \
+void scalar_multiply_##NAME(T * array, long len, T scalar) {                 \
+    long i;                                                                  \
+    for (i = 0; i < len; i++) {                                              \
+        array[i] = (T)(array[i] * scalar);                                   \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+/* counts how often each value 0 to MAX-1 appears in array */                \
+void countElems_##NAME(long * counts, T * array, long len) {                 \
+    long i;                                                                  \
+    for (i = 0; i < len; i++) {                                              \
+        counts[(long)array[i]]++;                                            \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+/* y = mat * vec for a row-major rows x cols matrix; the dot product for     \
+ * each row is accumulated in type ACC */                                    \
+void matrixVectorMultiply_##NAME(T * mat, T * vec, ACC * y,                  \
+                                 long rows, long cols) {                     \
+    long i, j;                                                               \
+    for (i = 0; i < rows; i++) {                                             \
+        ACC sum = 0;                                                         \
+        for (j = 0; j < cols; j++) {                                         \
+            sum += (ACC)mat[i*cols + j] * vec[j];                            \
+        }                                                                    \
+        y[i] = sum;                                                          \
+    }                                                                        \
+}
+
+//    element   accumulator name
+DEFINE_KERNELS(int8_t,  int64_t, i8)
+DEFINE_KERNELS(int16_t, int64_t, i16)
+DEFINE_KERNELS(int32_t, int64_t, i32)
+DEFINE_KERNELS(int64_t, int64_t, i64)
+DEFINE_KERNELS(float,   double,  f32)
+DEFINE_KERNELS(double,  double,  f64)
+
+/* Type-generic names: each picks the version that matches the type of its
+ * first (array) argument.  For example, with int16_t *a, scalar_multiply(a,
+ * n, 3) calls scalar_multiply_i16(a, n, 3). */
+#define KERNEL_FOR(kernel, array) _Generic((array),                          \
+        int8_t *:  kernel##_i8,                                              \
+        int16_t *: kernel##_i16,                                             \
+        int32_t *: kernel##_i32,                                             \
+        int64_t *: kernel##_i64,                                             \
+        float *:   kernel##_f32,                                             \
+        double *:  kernel##_f64)
+
+#define fillArrayRandom(array, len) \
+        KERNEL_FOR(fillArrayRandom, array)(array, len)
+#define scalar_multiply(array, len, scalar) \
+        KERNEL_FOR(scalar_multiply, array)(array, len, scalar)
+#define countElems(counts, array, len) \
+        KERNEL_FOR(countElems, array)(counts, array, len)
+#define matrixVectorMultiply(mat, vec, y, rows, cols) \
+        KERNEL_FOR(matrixVectorMultiply, mat)(mat, vec, y, rows, cols)
+
+/* prints one line of the results table: time per run of a kernel that
+ * touched n elements of size bytes each */
+void report(char *kernel, char *type, int bytes, long n, double time) {
+    printf("%-8s %-8s %d B/elem  %9.3f Melem/s  %8.3f GB/s\n", kernel, type,
+           bytes, n / time / 1e6, (double)n * bytes / time / 1e9);
+}
+
+/* BENCHMARK(T, ACC, NAME) times every kernel for element type T.  It uses
+ * the type-generic names, so the body is the same for every type. */
+#define BENCHMARK(T, ACC, NAME) do {                                         \
+    long _i, _iter, _total = 0;                                              \
+    long counts[MAX] = {0};                                                  \
+    struct timeval tstart, tend;                                             \
+    T * array = allocateArray_##NAME(n);                                     \
+    T * vec = allocateArray_##NAME(cols);                                    \
+    ACC * y = malloc(rows * sizeof(ACC));                                    \
+    if (y == NULL) print_error("ERROR: malloc failed");                      \
+    fillArrayRandom(array, n);                                               \
+    fillArrayRandom(vec, cols);                                              \
+                                                                             \
+    gettimeofday(&tstart, NULL);                                             \
+    for (_iter = 0; _iter < NITER; _iter++) {                                \
+        countElems(counts, array, n);                                        \
+    }                                                                        \
+    gettimeofday(&tend, NULL);                                               \
+    report("count", #NAME, sizeof(T), n, getTime(tstart, tend) / NITER);     \
+    for (_i = 0; _i < MAX; _i++) _total += counts[_i];                       \
+    if (_total != n * NITER) print_error("ERROR: countElems lost elements"); \
+                                                                             \
+    gettimeofday(&tstart, NULL);                                             \
+    for (_iter = 0; _iter < NITER; _iter++) {                                \
+        matrixVectorMultiply(array, vec, y, rows, cols);                     \
+    }                                                                        \
+    gettimeofday(&tend, NULL);                                               \
+    report("matvec", #NAME, sizeof(T), rows * cols,                          \
+           getTime(tstart, tend) / NITER);                                   \
+                                                                             \
+    /* multiplying by -1 never overflows, so the array stays in range */     \
+    gettimeofday(&tstart, NULL);                                             \
+    for (_iter = 0; _iter < NITER; _iter++) {                                \
+        scalar_multiply(array, n, (T)-1);                                    \
+    }                                                                        \
+    gettimeofday(&tend, NULL);                                               \
+    report("scale", #NAME, sizeof(T), n, getTime(tstart, tend) / NITER);     \
+                                                                             \
+    free(y);                                                                 \
+    free(vec);                                                               \
+    free(array);                                                             \
+} while (0)
+
+int main(int argc, char ** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <n>\n", argv[0]);
+        fprintf(stderr, "where <n> is the number of elements in each array\n");
+        return 1;
+    }
+
+    long n = strtol(argv[1], NULL, 10);
+    if (n < 1) print_error("ERROR: n must be greater than 0");
+
+    //the matrix for matrixVectorMultiply has the same n elements
+    long cols = 1024;
+    if (cols > n) cols = n;
+    long rows = n / cols;
+    srand(4);
+
+    printf("%ld elements per array, %ld x %ld matrix\n", n, rows, cols);
+    BENCHMARK(int8_t,  int64_t, i8);
+    BENCHMARK(int16_t, int64_t, i16);
+    BENCHMARK(int32_t, int64_t, i32);
+    BENCHMARK(int64_t, int64_t, i64);
+    BENCHMARK(float,   double,  f32);
+    BENCHMARK(double,  double,  f64);
+
+    return 0;
+}
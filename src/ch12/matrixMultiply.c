@@ -0,0 +1,237 @@
+/*
+ * Matrix-matrix multiplication C = A * B (GEMM), naive and cache-blocked.
+ *
+ * The naive triple loop streams through all of B for every row of A, so
+ * once the matrices are bigger than the caches almost every access to B is
+ * a cache miss.  The blocked version reorganizes the same computation so
+ * that data is reused while it is still in the cache:
+ *
+ *   - B is split into KC x NC blocks sized to stay in the L3 cache, and
+ *     copied ("packed") into a contiguous buffer of NR-column panels.
+ *   - A is split into MC x KC blocks sized to stay in the L2 cache, and
+ *     packed into MR-row panels.
+ *   - A micro-kernel computes an MR x NR block of C, keeping those MR*NR
+ *     sums in registers while it walks through one panel of A and one
+ *     panel of B (each KC long, small enough for the L1 cache).
+ *
+ * Packing also means the micro-kernel always reads memory sequentially,
+ * and the panels are padded with zeros so the kernel never needs to check
+ * for the edges of the matrix.
+ *
+ * Matrices are row-major arrays of doubles.
+ *
+ * To compile: gcc -O3 -march=native -o matrixMultiply matrixMultiply.c -lm
+ *
+ * To run: ./matrixMultiply <n>            # n x n times n x n
+ *         ./matrixMultiply <m> <k> <n>    # m x k times k x n
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define MR 4     //rows of C computed by the micro-kernel
+#define NR 8     //columns of C computed by the micro-kernel
+#define KC 256   //depth of a packed panel: MR*KC + NR*KC doubles fit in L1/L2
+#define MC 96    //rows of a packed block of A: MC*KC doubles fit in L2
+#define NC 4096  //columns of a packed block of B: KC*NC doubles fit in L3
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+//helper function: allocates and fills a matrix with random values
+double * randomMatrix(long rows, long cols) {
+    long i;
+    double * mat = malloc(rows * cols * sizeof(double));
+    if (mat == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < rows * cols; i++) {
+        mat[i] = (rand() % 200 - 100) / 10.0;
+    }
+    return mat;
+}
+
+/* naive GEMM: the textbook triple loop.  A is m x k, B is k x n, and C is
+ * m x n. */
+void gemmNaive(double * A, double * B, double * C, long m, long k, long n) {
+    long i, j, p;
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < n; j++) {
+            double sum = 0;
+            for (p = 0; p < k; p++) {
+                sum += A[i*k + p] * B[p*n + j];
+            }
+            C[i*n + j] = sum;
+        }
+    }
+}
+
+/* copies an mc x kc block of A (row stride lda) into MR-row panels: panel
+ * r holds rows r*MR to r*MR+MR-1, stored column by column, so the
+ * micro-kernel reads MR consecutive values for each step p. Rows past the
+ * edge of the matrix are filled with zeros. */
+void packA(double * A, long lda, long mc, long kc, double * buf) {
+    long r, p, i;
+    for (r = 0; r < mc; r += MR) {
+        for (p = 0; p < kc; p++) {
+            for (i = 0; i < MR; i++) {
+                *buf++ = (r + i < mc) ? A[(r + i)*lda + p] : 0.0;
+            }
+        }
+    }
+}
+
+/* copies a kc x nc block of B (row stride ldb) into NR-column panels, each
+ * stored row by row, padding columns past the edge with zeros. */
+void packB(double * B, long ldb, long kc, long nc, double * buf) {
+    long c, p, j;
+    for (c = 0; c < nc; c += NR) {
+        for (p = 0; p < kc; p++) {
+            for (j = 0; j < NR; j++) {
+                *buf++ = (c + j < nc) ? B[p*ldb + c + j] : 0.0;
+            }
+        }
+    }
+}
+
+/* micro-kernel: adds the product of one packed MR x kc panel of A and one
+ * packed kc x NR panel of B to the mr x nr block of C at c (row stride
+ * ldc).  The MR*NR sums live in the local array acc, which the compiler
+ * keeps in (vector) registers for the whole loop over p. */
+void microKernel(long kc, double * a, double * b, double * c, long ldc,
+                 long mr, long nr) {
+    double acc[MR][NR] = {{0}};
+    long p, i, j;
+
+    for (p = 0; p < kc; p++) {
+        for (i = 0; i < MR; i++) {
+            for (j = 0; j < NR; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+
+    //only the part of the block that is inside C is written back
+    for (i = 0; i < mr; i++) {
+        for (j = 0; j < nr; j++) {
+            c[i*ldc + j] += acc[i][j];
+        }
+    }
+}
+
+/* blocked GEMM: C = A * B using packed panels and the micro-kernel. */
+void gemmBlocked(double * A, double * B, double * C, long m, long k, long n) {
+    long jc, pc, ic, jr, ir, nc, kc, mc;
+    double * bufA = aligned_alloc(64, MC * KC * sizeof(double));
+    double * bufB = aligned_alloc(64, KC * (NC + NR) * sizeof(double));
+    if (bufA == NULL || bufB == NULL) {
+        fprintf(stderr, "aligned_alloc failed\n");
+        exit(1);
+    }
+
+    memset(C, 0, m * n * sizeof(double));
+
+    for (jc = 0; jc < n; jc += NC) {              //L3: NC columns of B
+        nc = (n - jc < NC) ? n - jc : NC;
+        for (pc = 0; pc < k; pc += KC) {          //KC deep slice of A and B
+            kc = (k - pc < KC) ? k - pc : KC;
+            packB(B + pc*n + jc, n, kc, nc, bufB);
+
+            for (ic = 0; ic < m; ic += MC) {      //L2: MC rows of A
+                mc = (m - ic < MC) ? m - ic : MC;
+                packA(A + ic*k + pc, k, mc, kc, bufA);
+
+                for (jr = 0; jr < nc; jr += NR) {     //L1: one panel of B
+                    for (ir = 0; ir < mc; ir += MR) { //registers: MR x NR of C
+                        microKernel(kc, bufA + ir*kc, bufB + jr*kc,
+                                    C + (ic + ir)*n + jc + jr, n,
+                                    (mc - ir < MR) ? mc - ir : MR,
+                                    (nc - jr < NR) ? nc - jr : NR);
+                    }
+                }
+            }
+        }
+    }
+
+    free(bufA);
+    free(bufB);
+}
+
+//returns the largest difference between two m x n matrices
+double maxDiff(double * X, double * Y, long m, long n) {
+    long i;
+    double d, max = 0;
+    for (i = 0; i < m * n; i++) {
+        d = fabs(X[i] - Y[i]);
+        if (d > max) max = d;
+    }
+    return max;
+}
+
+int main(int argc, char ** argv) {
+    long m, k, n;
+    if (argc == 2) {
+        m = k = n = strtol(argv[1], NULL, 10);
+    } else if (argc == 4) {
+        m = strtol(argv[1], NULL, 10);
+        k = strtol(argv[2], NULL, 10);
+        n = strtol(argv[3], NULL, 10);
+    } else {
+        fprintf(stderr, "usage: %s <n> or %s <m> <k> <n>\n", argv[0], argv[0]);
+        printf("program will multiply a random mxk matrix by a random kxn\n");
+        printf("matrix (nxn by nxn if only <n> is given), first with the\n");
+        printf("naive triple loop and then with the cache-blocked version.\n");
+        return 1;
+    }
+    if (m < 1 || k < 1 || n < 1) {
+        fprintf(stderr, "matrix dimensions must be positive\n");
+        return 1;
+    }
+
+    struct timeval tstart, tend;
+    double time, flops = 2.0 * m * n * k; //a multiply and an add per step
+    srand(4);
+
+    double * A = randomMatrix(m, k);
+    double * B = randomMatrix(k, n);
+    double * C1 = malloc(m * n * sizeof(double));
+    double * C2 = malloc(m * n * sizeof(double));
+    if (C1 == NULL || C2 == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return 1;
+    }
+
+    gettimeofday(&tstart, NULL);
+    gemmNaive(A, B, C1, m, k, n);
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend);
+    printf("Time to multiply (naive):   %g (%.3f GFLOP/s)\n", time, flops / time / 1e9);
+
+    gettimeofday(&tstart, NULL);
+    gemmBlocked(A, B, C2, m, k, n);
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend);
+    printf("Time to multiply (blocked): %g (%.3f GFLOP/s)\n", time, flops / time / 1e9);
+
+    //the sums are added in a different order, so allow for rounding
+    double diff = maxDiff(C1, C2, m, n);
+    printf("Largest difference between results: %g\n", diff);
+    if (diff > 1e-9 * k * 100) {
+        printf("ERROR: results differ\n");
+        return 1;
+    }
+
+    free(A);
+    free(B);
+    free(C1);
+    free(C2);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * matrixVector.c with its matrix and vector read from array files (see
+ * ../ch14/arrayfile.h) rather than filled in with rand().
+ *
+ * Both files are mapped into memory, so the matrix rows are used in place:
+ * mat[i] simply points at row i of the mapped data.  The result matrix is
+ * written directly into a mapped output file.
+ *
+ * To compile:
+ *   gcc -O2 -I../ch14 -o matrixVector_file matrixVector_file.c ../ch14/arrayfile.c
+ *
+ * To run:
+ *   ../ch14/genArrayFile mat.arr uniform 100 1000 1000
+ *   ../ch14/genArrayFile vec.arr uniform 100 1000
+ *   ./matrixVector_file mat.arr vec.arr res.arr
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "arrayfile.h"
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+//helper function: builds an array of row pointers into a row-major matrix
+int ** rowPointers(int * data, long rows, long cols) {
+    long i;
+    int ** mat = malloc(rows * sizeof(int *));
+    if (mat == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < rows; i++) {
+        mat[i] = data + i * cols;
+    }
+    return mat;
+}
+
+void matrixVectorMultiply(int ** mat, int * vec, int ** res, int row, int col){
+    int i, j;
+    for (j = 0; j < col; j++){
+        for (i = 0; i < row; i++){
+            res[i][j] = mat[i][j] * vec[j];
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    struct arrayfile matfile, vecfile, resfile;
+    struct timeval tstart, tend;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <mat> <vec> <res>\n", argv[0]);
+        printf("where <mat> is an array file holding an nxm matrix of ints,\n");
+        printf("<vec> is an array file holding a vector of m ints,\n");
+        printf("and <res> is the array file to write the nxm result to.\n");
+        return 1;
+    }
+
+    gettimeofday(&tstart, NULL);
+    if (af_open(argv[1], 0, &matfile) == -1 || af_open(argv[2], 0, &vecfile) == -1) {
+        return 1;
+    }
+    if (matfile.header->elem_type != AF_INT32 || matfile.header->ndims != 2
+        || vecfile.header->elem_type != AF_INT32
+        || vecfile.header->count != matfile.header->dims[1]) {
+        fprintf(stderr, "expected an nxm int matrix and a vector of m ints\n");
+        return 1;
+    }
+    int rows = matfile.header->dims[0];
+    int cols = matfile.header->dims[1];
+
+    if (af_create(argv[3], AF_INT32, 2, matfile.header->dims, &resfile) == -1) {
+        return 1;
+    }
+
+    int ** matrix = rowPointers(matfile.data, rows, cols);
+    int ** result = rowPointers(resfile.data, rows, cols);
+    gettimeofday(&tend, NULL);
+    printf("Time to map matrices: %g\n", getTime(tstart, tend));
+
+    //perform matrix-vector multiplication
+    gettimeofday(&tstart, NULL);
+    matrixVectorMultiply(matrix, vecfile.data, result, rows, cols);
+    gettimeofday(&tend, NULL);
+    printf("Time to matrix-vector multiply: %g\n", getTime(tstart, tend));
+
+    free(matrix);
+    free(result);
+    af_close(&resfile);
+    af_close(&vecfile);
+    af_close(&matfile);
+
+    return 0;
+}
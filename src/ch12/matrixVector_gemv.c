@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define DEBUG 0
+#define NITER 10 //times each kernel is run (time is averaged)
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+//helper function: allocates an array of a specified length
+int * allocateArray(int len) {
+    int * result = malloc(len * sizeof(int));
+    return result;
+}
+
+//helper function: fills array with elements
+void fillArrayRandom(int * array, int len) {
+    int i;
+    for (i = 0; i < len; i++) {
+        array[i] = 1+rand()%100;
+    }
+}
+
+//helper function: prints out elements of array separated by spaces
+void printArray(int * arr, int len) {
+    long i;
+    for (i = 0; i < len; i++) {
+        printf("%d ", arr[i]);
+    }
+    printf("\n");
+}
+
+//helper function: prints out elements of a long array separated by spaces
+void printLongArray(long * arr, int len) {
+    long i;
+    for (i = 0; i < len; i++) {
+        printf("%ld ", arr[i]);
+    }
+    printf("\n");
+}
+
+//prints out the elements of a matrix, with each row on a separate line
+void printMatrix(int ** mat, long rows, long cols) {
+    long i;
+    for (i = 0; i < rows; i++) {
+        printArray(mat[i], cols);
+    }
+}
+
+/* the original kernel from matrixVector.c: scales column j of the matrix by
+ * vec[j], producing a rows x cols result, but never adds up the rows */
+void matrixVectorMultiply(int ** mat, int * vec, int ** res, int row, int col){
+    int i, j;
+    for (j = 0; j < col; j++){
+        for (i = 0; i < row; i++){
+            res[i][j] = mat[i][j] * vec[j];
+        }
+    }
+}
+
+/* matrix-vector product y = mat * vec (GEMV), the straightforward way:
+ * y[i] is the dot product of row i with the vector.  The sum is a long,
+ * because the sum of many int products easily overflows an int. */
+void gemvNaive(int ** mat, int * vec, long * y, int row, int col){
+    int i, j;
+    for (i = 0; i < row; i++){
+        long sum = 0;
+        for (j = 0; j < col; j++){
+            sum += (long)mat[i][j] * vec[j];
+        }
+        y[i] = sum;
+    }
+}
+
+/* GEMV with four independent accumulators per row.  In gemvNaive, every
+ * addition must wait for the previous one to finish, because they all go
+ * into the same sum.  Splitting the row into four interleaved sums lets the
+ * CPU work on four additions at once (and lets the compiler use vector
+ * instructions); the partial sums are combined at the end of the row.
+ * Processing two rows at a time also reads each vec[j] once for both. */
+void gemvUnrolled(int ** mat, int * vec, long * y, int row, int col){
+    int i, j;
+    for (i = 0; i + 1 < row; i += 2){
+        int * r0 = mat[i];
+        int * r1 = mat[i+1];
+        long a0 = 0, a1 = 0, a2 = 0, a3 = 0; //partial sums for row i
+        long b0 = 0, b1 = 0, b2 = 0, b3 = 0; //partial sums for row i+1
+        for (j = 0; j + 3 < col; j += 4){
+            a0 += (long)r0[j] * vec[j];
+            a1 += (long)r0[j+1] * vec[j+1];
+            a2 += (long)r0[j+2] * vec[j+2];
+            a3 += (long)r0[j+3] * vec[j+3];
+            b0 += (long)r1[j] * vec[j];
+            b1 += (long)r1[j+1] * vec[j+1];
+            b2 += (long)r1[j+2] * vec[j+2];
+            b3 += (long)r1[j+3] * vec[j+3];
+        }
+        for (; j < col; j++){ //leftover columns
+            a0 += (long)r0[j] * vec[j];
+            b0 += (long)r1[j] * vec[j];
+        }
+        y[i] = (a0 + a1) + (a2 + a3);
+        y[i+1] = (b0 + b1) + (b2 + b3);
+    }
+    if (i < row){ //leftover row
+        gemvNaive(mat + i, vec, y + i, 1, col);
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <n> <m>\n", argv[0]);
+        printf("where <n> is the number of rows and <m> is the number of cols\n");
+        printf("program will allocate a random nxm matrix and a vector of size m\n");
+        printf("and compute their product, a vector of size n.\n");
+        return 1;
+    }
+
+    struct timeval tstart, tend;
+    int rows = strtol(argv[1], NULL, 10);
+    int cols = strtol(argv[2], NULL, 10);
+    int i, iter;
+    double time, ops = 2.0 * rows * cols; //one multiply and one add per entry
+    srand(4);
+
+    //declare, allocate and fill the matrix and vector
+    gettimeofday(&tstart, NULL);
+    int ** matrix = malloc(rows*sizeof(int *));
+    int ** result = malloc(rows*sizeof(int *));
+    for (i = 0; i < rows; i++){
+        matrix[i] = allocateArray(cols);
+        result[i] = allocateArray(cols);
+        fillArrayRandom(matrix[i], cols);
+    }
+    int * vector = allocateArray(cols);
+    fillArrayRandom(vector, cols);
+    long * y = malloc(rows*sizeof(long));
+    long * yref = malloc(rows*sizeof(long));
+    gettimeofday(&tend, NULL);
+    printf("Time to allocate and fill: %g\n", getTime(tstart, tend));
+
+    //the original elementwise kernel, for comparison (it does half the ops)
+    gettimeofday(&tstart, NULL);
+    for (iter = 0; iter < NITER; iter++) {
+        matrixVectorMultiply(matrix, vector, result, rows, cols);
+    }
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend) / NITER;
+    printf("Time to elementwise multiply: %g (no reduction)\n", time);
+
+    gettimeofday(&tstart, NULL);
+    for (iter = 0; iter < NITER; iter++) {
+        gemvNaive(matrix, vector, yref, rows, cols);
+    }
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend) / NITER;
+    printf("Time to GEMV (naive): %g (%.3f GOP/s)\n", time, ops / time / 1e9);
+
+    gettimeofday(&tstart, NULL);
+    for (iter = 0; iter < NITER; iter++) {
+        gemvUnrolled(matrix, vector, y, rows, cols);
+    }
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend) / NITER;
+    printf("Time to GEMV (4 accumulators, 2 rows): %g (%.3f GOP/s)\n",
+           time, ops / time / 1e9);
+
+    //integer sums are exact, so both versions must agree exactly
+    for (i = 0; i < rows; i++) {
+        if (y[i] != yref[i]) {
+            printf("ERROR: results differ at row %d\n", i);
+            return 1;
+        }
+    }
+
+    if (DEBUG) {
+        printf("Matrix:\n");
+        printMatrix(matrix, rows, cols);
+
+        printf("\nVector:\n");
+        printArray(vector, cols);
+
+        printf("\nResult:\n");
+        printLongArray(y, rows);
+    }
+
+    for (i = 0; i < rows; i++){
+        free(matrix[i]);
+        free(result[i]);
+    }
+    free(matrix);
+    free(result);
+    free(vector);
+    free(y);
+    free(yref);
+    return 0;
+}
@@ -0,0 +1,504 @@
+/*
+ * Sparse matrix-vector multiplication (SpMV): y = A * x.
+ *
+ * When almost all of the entries of a matrix are zero, storing it as a dense
+ * n x m array wastes both memory and time: the dense kernel reads every zero
+ * and multiplies by it.  This program stores the matrix in two sparse
+ * formats that only keep the nonzero entries:
+ *
+ *   CSR (compressed sparse row): the nonzeros of each row are stored one
+ *     row after another in val[], with their column numbers in col[].  Row i
+ *     occupies positions row_ptr[i] to row_ptr[i+1]-1.
+ *
+ *   SELL-C-sigma (sliced ELLPACK): rows are sorted by length within windows
+ *     of SIGMA rows, then grouped into slices of C rows.  Each slice is
+ *     padded to the length of its longest row and stored column by column,
+ *     so the C rows of a slice can be processed in lockstep (which the
+ *     compiler can vectorize).
+ *
+ * It runs single-threaded and multithreaded kernels for each format and
+ * compares them with the dense kernel, reporting GFLOP/s (2 flops per
+ * nonzero) and the effective memory bandwidth (the minimum number of bytes
+ * each kernel must read and write).  The multithreaded kernels divide the
+ * rows so that every thread gets about the same number of nonzeros, rather
+ * than the same number of rows, because rows can have very different
+ * lengths.
+ *
+ * Values are doubles, as in most applications of sparse matrices.
+ *
+ * To compile: gcc -O2 -o matrixVector_sparse matrixVector_sparse.c -lm -lpthread
+ *
+ * To run: ./matrixVector_sparse <n> <m> <d> <t>
+ *   # 20000x20000 matrix with 1% nonzeros, 4 threads:
+ *   ./matrixVector_sparse 20000 20000 0.01 4
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define NITER 10                 //times each kernel is run (time is averaged)
+#define DENSE_LIMIT (1L << 27)   //largest dense matrix (elements) to allocate
+#define SELL_C 8                 //rows per SELL slice
+#define SELL_SIGMA 256           //rows per SELL sorting window
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+//a sparse matrix in CSR format
+struct csr {
+    long rows, cols, nnz;
+    long *row_ptr;  //rows+1 entries: row i is val[row_ptr[i]..row_ptr[i+1]-1]
+    int *col;       //column of each nonzero
+    double *val;    //value of each nonzero
+};
+
+//a sparse matrix in SELL-C-sigma format
+struct sell {
+    long rows, cols, nslices;
+    long *slice_ptr; //nslices+1 entries: start of each slice in val/col
+    int *slice_len;  //padded row length of each slice
+    int *perm;       //perm[k] is the original row stored in position k
+    int *col;        //column of each entry (0 for padding)
+    double *val;     //value of each entry (0 for padding)
+    long stored;     //entries stored, including padding
+};
+
+/* Generates a random rows x cols CSR matrix where each entry is nonzero
+ * with probability density.  Rather than flipping a coin for every entry,
+ * it jumps straight to the next nonzero column: the gap between nonzeros
+ * follows a geometric distribution. */
+void genSparseRandom(struct csr *A, long rows, long cols, double density) {
+    long i, j, cap, nnz = 0;
+    //log1p keeps logq nonzero even when density is too small for 1 - density
+    double u, gap, logq = log1p(-density);
+
+    cap = rows * cols * density * 1.1 + 16;
+    A->rows = rows;
+    A->cols = cols;
+    A->row_ptr = malloc((rows + 1) * sizeof(long));
+    A->col = malloc(cap * sizeof(int));
+    A->val = malloc(cap * sizeof(double));
+    if (!A->row_ptr || !A->col || !A->val) print_error("ERROR: malloc failed");
+
+    for (i = 0; i < rows; i++) {
+        A->row_ptr[i] = nnz;
+        j = -1;
+        while (1) {
+            if (density >= 1.0) {
+                j++;
+            } else {
+                u = (rand() + 1.0) / ((double)RAND_MAX + 2); //0 < u < 1
+                gap = log(u) / logq;
+                //a gap past the end of the row (possibly inf) ends the row;
+                //checking it as a double keeps the cast to long in range
+                if (gap >= cols - 1 - j) break;
+                j += 1 + (long)gap;
+            }
+            if (j >= cols) break;
+
+            if (nnz == cap) { //grow the arrays if the estimate was too small
+                cap *= 2;
+                A->col = realloc(A->col, cap * sizeof(int));
+                A->val = realloc(A->val, cap * sizeof(double));
+                if (!A->col || !A->val) print_error("ERROR: realloc failed");
+            }
+            A->col[nnz] = j;
+            A->val[nnz] = 1 + rand() % 100;
+            nnz++;
+        }
+    }
+    A->row_ptr[rows] = nnz;
+    A->nnz = nnz;
+}
+
+//expands a CSR matrix into a dense row-major array
+double *csrToDense(struct csr *A) {
+    long i, k;
+    double *D = calloc(A->rows * A->cols, sizeof(double));
+    if (!D) print_error("ERROR: calloc failed");
+    for (i = 0; i < A->rows; i++) {
+        for (k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++) {
+            D[i * A->cols + A->col[k]] = A->val[k];
+        }
+    }
+    return D;
+}
+
+//comparison function for sorting rows by decreasing length
+static long *sort_lens;
+int cmpRowLen(const void *a, const void *b) {
+    long la = sort_lens[*(const int *)a], lb = sort_lens[*(const int *)b];
+    return (la < lb) - (la > lb);
+}
+
+//converts a CSR matrix to SELL-C-sigma
+void csrToSell(struct csr *A, struct sell *S) {
+    long i, k, s, r, row, len, w;
+    long *lens = malloc(A->rows * sizeof(long));
+    if (!lens) print_error("ERROR: malloc failed");
+
+    S->rows = A->rows;
+    S->cols = A->cols;
+    S->nslices = (A->rows + SELL_C - 1) / SELL_C;
+    S->perm = malloc(A->rows * sizeof(int));
+    S->slice_ptr = malloc((S->nslices + 1) * sizeof(long));
+    S->slice_len = malloc(S->nslices * sizeof(int));
+    if (!S->perm || !S->slice_ptr || !S->slice_len) print_error("ERROR: malloc failed");
+
+    //sort rows by length within each window of SIGMA rows
+    for (i = 0; i < A->rows; i++) {
+        S->perm[i] = i;
+        lens[i] = A->row_ptr[i + 1] - A->row_ptr[i];
+    }
+    sort_lens = lens;
+    for (w = 0; w < A->rows; w += SELL_SIGMA) {
+        len = A->rows - w < SELL_SIGMA ? A->rows - w : SELL_SIGMA;
+        qsort(S->perm + w, len, sizeof(int), cmpRowLen);
+    }
+
+    //each slice is as long as its longest row
+    S->stored = 0;
+    for (s = 0; s < S->nslices; s++) {
+        S->slice_ptr[s] = S->stored;
+        S->slice_len[s] = 0;
+        for (r = 0; r < SELL_C && s * SELL_C + r < A->rows; r++) {
+            len = lens[S->perm[s * SELL_C + r]];
+            if (len > S->slice_len[s]) S->slice_len[s] = len;
+        }
+        S->stored += (long)S->slice_len[s] * SELL_C;
+    }
+    S->slice_ptr[S->nslices] = S->stored;
+
+    //padding entries have value 0 and column 0, so they add nothing to y
+    S->col = calloc(S->stored, sizeof(int));
+    S->val = calloc(S->stored, sizeof(double));
+    if (!S->col || !S->val) print_error("ERROR: calloc failed");
+
+    //entry j of row r in slice s is stored at slice_ptr[s] + j*C + r
+    for (s = 0; s < S->nslices; s++) {
+        for (r = 0; r < SELL_C && s * SELL_C + r < A->rows; r++) {
+            row = S->perm[s * SELL_C + r];
+            for (k = A->row_ptr[row]; k < A->row_ptr[row + 1]; k++) {
+                i = S->slice_ptr[s] + (k - A->row_ptr[row]) * SELL_C + r;
+                S->col[i] = A->col[k];
+                S->val[i] = A->val[k];
+            }
+        }
+    }
+    free(lens);
+}
+
+/***********************************************************/
+/* kernels: each computes y = A * x for rows (or slices) start to end-1 */
+
+void denseMV(double *D, long cols, double *x, double *y, long start, long end) {
+    long i, j;
+    for (i = start; i < end; i++) {
+        double sum = 0;
+        double *row = D + i * cols;
+        for (j = 0; j < cols; j++) {
+            sum += row[j] * x[j];
+        }
+        y[i] = sum;
+    }
+}
+
+void csrMV(struct csr *A, double *x, double *y, long start, long end) {
+    long i, k;
+    for (i = start; i < end; i++) {
+        double sum = 0;
+        for (k = A->row_ptr[i]; k < A->row_ptr[i + 1]; k++) {
+            sum += A->val[k] * x[A->col[k]];
+        }
+        y[i] = sum;
+    }
+}
+
+void sellMV(struct sell *S, double *x, double *y, long start, long end) {
+    long s, j, r, base;
+    double sum[SELL_C];
+    for (s = start; s < end; s++) {
+        base = S->slice_ptr[s];
+        for (r = 0; r < SELL_C; r++) sum[r] = 0;
+        for (j = 0; j < S->slice_len[s]; j++) {
+            //the C rows of the slice advance together
+            for (r = 0; r < SELL_C; r++) {
+                sum[r] += S->val[base + j * SELL_C + r] * x[S->col[base + j * SELL_C + r]];
+            }
+        }
+        for (r = 0; r < SELL_C && s * SELL_C + r < S->rows; r++) {
+            y[S->perm[s * SELL_C + r]] = sum[r];
+        }
+    }
+}
+
+/***********************************************************/
+/* multithreaded driver */
+
+enum { KERNEL_DENSE, KERNEL_CSR, KERNEL_SELL };
+
+struct t_arg {
+    int kernel;      //which kernel to run
+    long start, end; //this thread's rows (or slices, for SELL)
+    struct csr *A;
+    struct sell *S;
+    double *D;
+    double *x, *y;
+    pthread_barrier_t *barrier; //runs start and end together
+};
+
+void *mvThread(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    if (myargs->kernel == KERNEL_DENSE) {
+        denseMV(myargs->D, myargs->A->cols, myargs->x, myargs->y,
+                myargs->start, myargs->end);
+    } else if (myargs->kernel == KERNEL_CSR) {
+        csrMV(myargs->A, myargs->x, myargs->y, myargs->start, myargs->end);
+    } else {
+        sellMV(myargs->S, myargs->x, myargs->y, myargs->start, myargs->end);
+    }
+    return NULL;
+}
+
+/* The threads are created once, before the timed runs, so their creation
+ * is not timed.  Each run starts when every thread (and main, which does
+ * the work of thread 0) has reached the barrier, and ends when every
+ * thread has reached it again. */
+void *mvWorker(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long iter;
+    for (iter = 0; iter < NITER; iter++) {
+        pthread_barrier_wait(myargs->barrier);
+        mvThread(myargs);
+        pthread_barrier_wait(myargs->barrier);
+    }
+    return NULL;
+}
+
+/* Splits the range 0 to n-1 among nthreads threads so that each gets about
+ * the same amount of work, where ptr[i] is the total work of items 0 to i-1
+ * (row_ptr for CSR, slice_ptr for SELL).  Thread t gets items bounds[t] to
+ * bounds[t+1]-1.  If ptr is NULL every item has the same amount of work. */
+void balancedSplit(long *ptr, long n, long nthreads, long *bounds) {
+    long t, lo, hi, mid, target;
+    bounds[0] = 0;
+    for (t = 1; t < nthreads; t++) {
+        if (ptr == NULL) {
+            bounds[t] = n * t / nthreads;
+            continue;
+        }
+        //first item whose starting offset reaches t/nthreads of the work
+        target = ptr[n] * t / nthreads;
+        lo = bounds[t - 1];
+        hi = n;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (ptr[mid] < target) lo = mid + 1; else hi = mid;
+        }
+        bounds[t] = lo;
+    }
+    bounds[nthreads] = n;
+}
+
+/* Runs kernel NITER times with nthreads threads (see mvWorker) and returns
+ * the average time per run. */
+double runKernel(int kernel, long nthreads, struct csr *A, struct sell *S,
+                 double *D, double *x, double *y) {
+    struct timeval tstart, tend;
+    pthread_barrier_t barrier;
+    long t, iter, n;
+    long *ptr;
+    int ret;
+
+    pthread_t *thread_array = malloc(nthreads * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(nthreads * sizeof(struct t_arg));
+    long *bounds = malloc((nthreads + 1) * sizeof(long));
+    if (!thread_array || !thread_args || !bounds) print_error("ERROR: malloc failed");
+
+    if (kernel == KERNEL_DENSE) {
+        n = A->rows;
+        ptr = NULL; //dense rows all cost the same
+    } else if (kernel == KERNEL_CSR) {
+        n = A->rows;
+        ptr = A->row_ptr;
+    } else {
+        n = S->nslices;
+        ptr = S->slice_ptr;
+    }
+    balancedSplit(ptr, n, nthreads, bounds);
+    pthread_barrier_init(&barrier, NULL, nthreads);
+
+    for (t = 0; t < nthreads; t++) {
+        thread_args[t].kernel = kernel;
+        thread_args[t].start = bounds[t];
+        thread_args[t].end = bounds[t + 1];
+        thread_args[t].A = A;
+        thread_args[t].S = S;
+        thread_args[t].D = D;
+        thread_args[t].x = x;
+        thread_args[t].y = y;
+        thread_args[t].barrier = &barrier;
+    }
+    for (t = 1; t < nthreads; t++) {
+        ret = pthread_create(&thread_array[t], NULL, mvWorker, &thread_args[t]);
+        if (ret) print_error("ERROR: pthread_create failed");
+    }
+
+    for (iter = 0; iter < NITER; iter++) {
+        pthread_barrier_wait(&barrier);
+        if (iter == 0) gettimeofday(&tstart, NULL);
+        mvThread(&thread_args[0]);
+        pthread_barrier_wait(&barrier);
+    }
+    gettimeofday(&tend, NULL);
+
+    for (t = 1; t < nthreads; t++) {
+        ret = pthread_join(thread_array[t], NULL);
+        if (ret) print_error("ERROR: pthread_join failed");
+    }
+    pthread_barrier_destroy(&barrier);
+    free(bounds);
+    free(thread_args);
+    free(thread_array);
+    return getTime(tstart, tend) / NITER;
+}
+
+//returns 1 if y and ref agree to within rounding error
+int checkResult(double *y, double *ref, long n) {
+    long i;
+    for (i = 0; i < n; i++) {
+        if (fabs(y[i] - ref[i]) > 1e-9 * (fabs(ref[i]) + 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//prints one line of the results table (rates are n/a if the time was too
+//short for gettimeofday to measure)
+void report(char *name, long nthreads, double time, double flops, double bytes,
+            int correct) {
+    if (time > 0) {
+        printf("%-6s %3ld threads: %10.6f s  %8.3f GFLOP/s  %8.3f GB/s  %s\n",
+               name, nthreads, time, flops / time / 1e9, bytes / time / 1e9,
+               correct ? "" : "(WRONG RESULT)");
+    } else {
+        printf("%-6s %3ld threads: %10.6f s  %8s GFLOP/s  %8s GB/s  %s\n",
+               name, nthreads, time, "n/a", "n/a", correct ? "" : "(WRONG RESULT)");
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s <n> <m> <d> <t>\n", argv[0]);
+        fprintf(stderr, "where <n> is the number of rows and <m> is the number of cols\n");
+        fprintf(stderr, "and <d> is the fraction of nonzero entries (0 < d <= 1)\n");
+        fprintf(stderr, "and <t> is the number of threads\n");
+        return 1;
+    }
+
+    struct timeval tstart, tend;
+    long rows = strtol(argv[1], NULL, 10);
+    long cols = strtol(argv[2], NULL, 10);
+    double density = strtod(argv[3], NULL);
+    long nthreads = strtol(argv[4], NULL, 10);
+    long i, t;
+    if (rows < 1 || cols < 1) print_error("ERROR: n and m must be positive");
+    if (rows > 2147483647L) print_error("ERROR: n must fit in an int");
+    if (cols > 2147483647L) print_error("ERROR: m must fit in an int");
+    if (density <= 0 || density > 1) print_error("ERROR: d must be in (0, 1]");
+    if (nthreads < 1) print_error("ERROR: t must be positive");
+    srand(4);
+
+    struct csr A;
+    struct sell S;
+    gettimeofday(&tstart, NULL);
+    genSparseRandom(&A, rows, cols, density);
+    csrToSell(&A, &S);
+    gettimeofday(&tend, NULL);
+    printf("Time to generate matrix: %g\n", getTime(tstart, tend));
+    printf("%ld x %ld matrix, %ld nonzeros (%.4f%%), SELL-%d-%d padding %.1f%%\n",
+           rows, cols, A.nnz, 100.0 * A.nnz / ((double)rows * cols),
+           SELL_C, SELL_SIGMA, 100.0 * (S.stored - A.nnz) / (A.nnz ? A.nnz : 1));
+
+    double *x = malloc(cols * sizeof(double));
+    double *y = malloc(rows * sizeof(double));
+    double *ref = malloc(rows * sizeof(double));
+    if (!x || !y || !ref) print_error("ERROR: malloc failed");
+    for (i = 0; i < cols; i++) {
+        x[i] = 1 + rand() % 100;
+    }
+
+    //the serial CSR result is the reference the other kernels are checked against
+    csrMV(&A, x, ref, 0, rows);
+
+    //minimum bytes moved: the matrix, plus reading x and writing y once
+    double vecbytes = (rows + cols) * sizeof(double);
+    double csrbytes = A.nnz * (sizeof(double) + sizeof(int))
+                      + (rows + 1) * sizeof(long) + vecbytes;
+    double sellbytes = S.stored * (sizeof(double) + sizeof(int))
+                       + S.nslices * (sizeof(long) + sizeof(int))
+                       + rows * sizeof(int) + vecbytes;
+    double densebytes = (double)rows * cols * sizeof(double) + vecbytes;
+    double sparseflops = 2.0 * A.nnz;
+    double denseflops = 2.0 * rows * cols;
+
+    //single-threaded, then multithreaded
+    long tcounts[2] = {1, nthreads};
+    double *D = NULL;
+    if (rows * cols <= DENSE_LIMIT) {
+        D = csrToDense(&A);
+    } else {
+        printf("(dense matrix too large to allocate, skipping dense kernel)\n");
+    }
+
+    for (t = 0; t < 2; t++) {
+        if (t == 1 && nthreads == 1) break;
+        double time;
+
+        if (D) {
+            memset(y, 0, rows * sizeof(double));
+            time = runKernel(KERNEL_DENSE, tcounts[t], &A, &S, D, x, y);
+            report("dense", tcounts[t], time, denseflops, densebytes,
+                   checkResult(y, ref, rows));
+        }
+
+        memset(y, 0, rows * sizeof(double));
+        time = runKernel(KERNEL_CSR, tcounts[t], &A, &S, D, x, y);
+        report("CSR", tcounts[t], time, sparseflops, csrbytes,
+               checkResult(y, ref, rows));
+
+        memset(y, 0, rows * sizeof(double));
+        time = runKernel(KERNEL_SELL, tcounts[t], &A, &S, D, x, y);
+        report("SELL", tcounts[t], time, sparseflops, sellbytes,
+               checkResult(y, ref, rows));
+    }
+    printf("(GFLOP/s counts useful flops: 2 per nonzero for CSR and SELL,\n"
+           " 2 per entry for dense, which mostly multiplies zeros)\n");
+
+    free(D);
+    free(ref);
+    free(y);
+    free(x);
+    free(S.val);
+    free(S.col);
+    free(S.perm);
+    free(S.slice_len);
+    free(S.slice_ptr);
+    free(A.val);
+    free(A.col);
+    free(A.row_ptr);
+    return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * A single-threaded event loop that handles signals and periodic timer
+ * ticks without signal handlers, as a long-running program's control loop
+ * might (compare with signals.c):
+ *
+ *   signalfd: the signals are blocked, so they stay pending instead of
+ *             interrupting the program, and are read from a file
+ *             descriptor instead.  Their work is then done in the loop
+ *             itself, where calling any function (printf, malloc, ...) is
+ *             safe, which it is not in a signal handler.
+ *   timerfd:  a periodic timer, with nanosecond resolution, read from a
+ *             file descriptor.  Each read returns how many periods have
+ *             passed, so late or missed ticks are seen, not lost.
+ *   epoll:    waits until either file descriptor is ready.
+ *
+ * While it runs, it measures:
+ *
+ *   tick jitter:    how late each tick is handled, after the time it was
+ *                   due, and how many ticks were missed entirely
+ *   signal latency: a child process sends a real-time signal every few
+ *                   milliseconds with sigqueue, carrying the time it was
+ *                   sent; the latency is the time until the loop reads it
+ *
+ * Optionally, other child processes spin on the CPU, so that the loop has
+ * to compete with them to be scheduled.
+ *
+ * Signals handled:
+ *  kill -INT  pid  (or Ctrl-C) stops, and prints the results
+ *  kill -TERM pid  does the same
+ *  kill -USR1 pid  prints the results so far
+ *  kill -CONT pid  (or Ctrl-Z fg) prints a message
+ *
+ * To compile: gcc -O2 -o event_loop event_loop.c
+ *
+ * To run: ./event_loop <period_us> <seconds> [nload]
+ *   period_us: tick period, in microseconds
+ *   seconds:   how long to run
+ *   nload:     number of CPU-spinning processes to run alongside (default 0)
+ *
+ *   ./event_loop 1000 10
+ *   ./event_loop 1000 10 8
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#define PING_NS 7000000L  /* time between the pinger's signals (7 ms) */
+#define MAX_PINGS 1000000 /* most signal latencies stored */
+
+/* the results so far */
+struct stats {
+    long *jitter;    // lateness of each tick handled, in ns
+    long nticks;     // ticks handled
+    long max_ticks;  // room in jitter
+    long missed;     // ticks that passed without being handled
+    long *latency;   // latency of each ping, in ns
+    long npings;
+};
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: returns the current CLOCK_MONOTONIC time in ns.  It is
+ * the same clock in every process, and the one the timer uses. */
+long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* comparison function for qsort */
+int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* prints the min, median, 99th percentile and max of n values (in ns) as
+ * microseconds; sorts a copy, so values can still be added */
+void print_percentiles(const char *name, const long *values, long n) {
+    long *sorted;
+    long i;
+    if (n == 0) {
+        printf("%-16s %10s\n", name, "none");
+        return;
+    }
+    sorted = malloc(n * sizeof(long));
+    if (sorted == NULL) print_error("ERROR: cannot malloc");
+    for (i = 0; i < n; i++) sorted[i] = values[i];
+    qsort(sorted, n, sizeof(long), cmp_long);
+    printf("%-16s %10ld %10.1f %10.1f %10.1f %10.1f\n", name, n, sorted[0] / 1e3,
+           sorted[n / 2] / 1e3, sorted[n * 99 / 100] / 1e3, sorted[n - 1] / 1e3);
+    free(sorted);
+}
+
+void print_stats(struct stats *s) {
+    printf("%-16s %10s %10s %10s %10s %10s\n", "(us)", "count", "min", "p50",
+           "p99", "max");
+    print_percentiles("tick jitter", s->jitter, s->nticks);
+    print_percentiles("signal latency", s->latency, s->npings);
+    printf("missed ticks: %ld\n", s->missed);
+    fflush(stdout);
+}
+
+/* The pinger child: sends sig to parent every PING_NS, with the time it was
+ * sent as the signal's value, until the parent is gone. */
+void pinger(pid_t parent, int sig) {
+    struct timespec gap = { 0, PING_NS };
+    union sigval value;
+    while (getppid() == parent) {
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &gap, NULL);
+        // sival_ptr is 64 bits wide on 64-bit Linux, so it holds the time
+        value.sival_ptr = (void *)(intptr_t)now_ns();
+        if (sigqueue(parent, sig, value) == -1) break;
+    }
+    _exit(0);
+}
+
+/* A load child: spins until killed. */
+void spinner(void) {
+    volatile unsigned long count = 0;
+    while (1) {
+        count++;
+    }
+}
+
+int main(int argc, char **argv) {
+    long period_us, seconds, nload = 0, i;
+    long period, start, due, late;
+    int ping_sig = SIGRTMIN;
+    int sfd, tfd, efd, n, running = 1;
+    pid_t parent = getpid(), *children;
+    sigset_t mask;
+    struct signalfd_siginfo info;
+    struct itimerspec spec;
+    struct epoll_event ev, events[2];
+    struct stats s = {0};
+    uint64_t expirations;
+
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s <period_us> <seconds> [nload]\n", argv[0]);
+        fprintf(stderr, "where <period_us> is the tick period in microseconds\n");
+        fprintf(stderr, "and <seconds> is how long to run\n");
+        fprintf(stderr, "and [nload] is the number of CPU-spinning processes\n");
+        return 1;
+    }
+    period_us = strtol(argv[1], NULL, 10);
+    seconds = strtol(argv[2], NULL, 10);
+    if (argc == 4) nload = strtol(argv[3], NULL, 10);
+    if (period_us < 1) print_error("ERROR: period_us must be at least 1");
+    if (seconds < 1) print_error("ERROR: seconds must be at least 1");
+    if (nload < 0) print_error("ERROR: nload must not be negative");
+
+    period = period_us * 1000;
+    s.max_ticks = seconds * 1000000L / period_us;
+    s.jitter = malloc(s.max_ticks * sizeof(long));
+    s.latency = malloc(MAX_PINGS * sizeof(long));
+    children = malloc((nload + 1) * sizeof(pid_t));
+    if (!s.jitter || !s.latency || !children) print_error("ERROR: cannot malloc");
+
+    /* Block the signals, so they wait for signalfd instead of being
+     * delivered.  This is done before fork, so none can arrive before the
+     * signalfd exists. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGCONT);
+    sigaddset(&mask, ping_sig);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) print_error("ERROR: sigprocmask failed");
+
+    fflush(stdout); // so that children do not inherit unwritten output
+    for (i = 0; i <= nload; i++) {
+        children[i] = fork();
+        if (children[i] == -1) print_error("ERROR: fork failed");
+        if (children[i] == 0) { /* the child process */
+            prctl(PR_SET_PDEATHSIG, SIGKILL); // do not outlive the parent
+            if (i == 0) pinger(parent, ping_sig);
+            spinner();
+        }
+    }
+
+    sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    if (sfd == -1 || tfd == -1 || efd == -1) print_error("ERROR: cannot create event fds");
+
+    ev.events = EPOLLIN;
+    ev.data.fd = sfd;
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, sfd, &ev) == -1) print_error("ERROR: epoll_ctl failed");
+    ev.data.fd = tfd;
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, tfd, &ev) == -1) print_error("ERROR: epoll_ctl failed");
+
+    printf("kill -CONT %d to send SIGCONT, kill -USR1 %d for results so far\n",
+           getpid(), getpid());
+    printf("tick every %ld us for %ld s, %ld load processes\n", period_us,
+           seconds, nload);
+    fflush(stdout);
+
+    /* The first tick is due one period from now, and the rest at exact
+     * multiples of the period after it: an absolute time does not drift. */
+    start = now_ns();
+    due = start + period;
+    spec.it_value.tv_sec = due / 1000000000L;
+    spec.it_value.tv_nsec = due % 1000000000L;
+    spec.it_interval.tv_sec = period / 1000000000L;
+    spec.it_interval.tv_nsec = period % 1000000000L;
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        print_error("ERROR: timerfd_settime failed");
+    }
+
+    while (running) {
+        n = epoll_wait(efd, events, 2, -1);
+        if (n == -1) print_error("ERROR: epoll_wait failed");
+        for (i = 0; i < n; i++) {
+            if (events[i].data.fd == tfd) {
+                if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    print_error("ERROR: reading timerfd failed");
+                }
+                // the latest tick was due (expirations - 1) periods after
+                // the one we were waiting for; the rest were missed
+                due += (expirations - 1) * period;
+                late = now_ns() - due;
+                s.missed += expirations - 1;
+                if (s.nticks < s.max_ticks) s.jitter[s.nticks++] = late;
+                due += period;
+                if (s.nticks + s.missed >= s.max_ticks) running = 0;
+            } else {
+                if (read(sfd, &info, sizeof(info)) != sizeof(info)) {
+                    print_error("ERROR: reading signalfd failed");
+                }
+                if ((int)info.ssi_signo == ping_sig) {
+                    if (s.npings < MAX_PINGS) {
+                        s.latency[s.npings++] = now_ns() - (long)info.ssi_ptr;
+                    }
+                } else if (info.ssi_signo == SIGUSR1) {
+                    print_stats(&s);
+                } else if (info.ssi_signo == SIGCONT) {
+                    printf("got SIGCONT, signal number %d\n", info.ssi_signo);
+                    fflush(stdout);
+                } else { // SIGINT or SIGTERM
+                    printf("got signal number %d...exiting\n", info.ssi_signo);
+                    running = 0;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i <= nload; i++) {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+    printf("ran for %.3f s\n", (now_ns() - start) / 1e9);
+    print_stats(&s);
+
+    close(efd);
+    close(tfd);
+    close(sfd);
+    free(children);
+    free(s.jitter);
+    free(s.latency);
+    return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Runs the countElems (ch14) and scalar_multiply (ch15) kernels in parallel
+ * with worker processes created by fork, instead of with threads, and
+ * compares the two.
+ *
+ * Processes do not share memory the way threads do: after fork, a child's
+ * writes to ordinary memory go to its own copy of each page.  So the input
+ * array, and a slot per worker for its results, live in memory that is
+ * explicitly shared:
+ *
+ *   shm:   an mmap(MAP_SHARED | MAP_ANONYMOUS) region created before fork,
+ *          which parent and children all see
+ *   memfd: an anonymous in-memory file from memfd_create.  Each child maps
+ *          it itself, from the file descriptor it inherits, as a worker
+ *          started with exec (for stronger isolation) would have to.
+ *
+ * Each worker handles one chunk of the array, writes its partial counts to
+ * its own slot (slots are cache-line aligned, so workers do not write to
+ * the same cache lines) and exits; the parent waits for every worker with
+ * waitpid, then combines the counts.  scalar_multiply updates the shared
+ * array in place.
+ *
+ * For comparison, the same chunk functions are run with pthreads.  Each
+ * backend is also timed doing no work at all, which is the cost of
+ * creating and waiting for the workers.
+ *
+ * To compile: gcc -O2 -o fork_workers fork_workers.c -lpthread
+ *
+ * To run: ./fork_workers <n> <p>
+ *   n: length of the array
+ *   p: number of worker processes (and of threads)
+ *
+ *   ./fork_workers 100000000 8
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#define MAX 10      //the maximum value of an element. (10 means 0-9)
+#define NITER 5     //times each kernel is run (time is averaged); must be odd
+#define LINE 64     //cache line size
+
+/* the work each worker does */
+enum { JOB_NONE, JOB_COUNT, JOB_SCALE };
+
+/* the backends compared */
+enum { B_THREADS, B_SHM, B_MEMFD, NBACKENDS };
+static const char *backend_names[NBACKENDS] = {
+    "pthreads", "fork + shared mmap", "fork + memfd"
+};
+
+/* one worker's results, padded to whole cache lines */
+struct slot {
+    long counts[MAX];
+} __attribute__((aligned(LINE)));
+
+/* the shared region: n ints of array data, then p slots */
+struct region {
+    void *base;
+    size_t size;
+    size_t slots_offset;  // where the slots start (page aligned)
+    int fd;               // the memfd, or -1
+    int *array;
+    struct slot *slots;
+};
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: computes wall clock time */
+double getTime(struct timeval ts, struct timeval te) {
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+/* helper function: genRandomArray
+ * fills an input array of specified length (length) with random
+ * values from 0 to MAX-1
+ */
+void genRandomArray(int *array, long length) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = rand() % MAX;
+    }
+}
+
+/* Creates the shared region for n ints and p slots, in an anonymous shared
+ * mapping or (if use_memfd) in a memfd mapped by the parent. */
+void create_region(struct region *r, long n, long p, int use_memfd) {
+    long page = sysconf(_SC_PAGESIZE);
+
+    r->slots_offset = (n * sizeof(int) + page - 1) / page * page;
+    r->size = r->slots_offset + p * sizeof(struct slot);
+    r->fd = -1;
+    if (use_memfd) {
+        r->fd = memfd_create("fork_workers", 0);
+        if (r->fd == -1) print_error("ERROR: memfd_create failed");
+        if (ftruncate(r->fd, r->size) == -1) print_error("ERROR: ftruncate failed");
+        r->base = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    } else {
+        r->base = mmap(NULL, r->size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    if (r->base == MAP_FAILED) print_error("ERROR: cannot mmap shared region");
+    r->array = (int *)r->base;
+    r->slots = (struct slot *)((char *)r->base + r->slots_offset);
+}
+
+void destroy_region(struct region *r) {
+    munmap(r->base, r->size);
+    if (r->fd != -1) close(r->fd);
+}
+
+/* the chunk of the array that worker id of p handles */
+void chunk(long n, long p, long id, long *start, long *end) {
+    *start = n / p * id;
+    *end = (id == p - 1) ? n : n / p * (id + 1);
+}
+
+/* countElems on array[start..end-1], with the counts written to slot */
+void countChunk(int *array, long start, long end, struct slot *slot) {
+    long local_counts[MAX] = {0};
+    long i;
+    int val;
+    for (i = start; i < end; i++) {
+        val = array[i];
+        local_counts[val] = local_counts[val] + 1;
+    }
+    memcpy(slot->counts, local_counts, sizeof(local_counts));
+}
+
+/* scalar_multiply on array[start..end-1] */
+void scaleChunk(int *array, long start, long end, int scalar) {
+    long i;
+    for (i = start; i < end; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* does worker id's part of job, on region r of an n-element array */
+void do_job(int job, struct region *r, long n, long p, long id, int scalar) {
+    long start, end;
+    chunk(n, p, id, &start, &end);
+    if (job == JOB_COUNT) {
+        countChunk(r->array, start, end, &r->slots[id]);
+    } else if (job == JOB_SCALE) {
+        scaleChunk(r->array, start, end, scalar);
+    }
+}
+
+/******** processes ************/
+
+/* Forks p workers to do job, and waits for all of them. */
+void run_processes(int job, struct region *r, long n, long p, int scalar) {
+    long id;
+    int status;
+    pid_t pid;
+
+    for (id = 0; id < p; id++) {
+        pid = fork();
+        if (pid == -1) print_error("ERROR: fork failed");
+        if (pid == 0) { /* the child process */
+            struct region mine = *r;
+            if (r->fd != -1) {
+                // map the memfd afresh: only the fd was needed, not the
+                // parent's mapping
+                mine.base = mmap(NULL, r->size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, r->fd, 0);
+                if (mine.base == MAP_FAILED) _exit(1);
+                mine.array = (int *)mine.base;
+                mine.slots = (struct slot *)((char *)mine.base + r->slots_offset);
+            }
+            do_job(job, &mine, n, p, id, scalar);
+            _exit(0); // not exit: the parent's stdio buffers must not be flushed twice
+        }
+    }
+
+    /* the parent process: wait for every worker */
+    for (id = 0; id < p; id++) {
+        if (waitpid(-1, &status, 0) == -1) print_error("ERROR: waitpid failed");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            print_error("ERROR: a worker failed");
+        }
+    }
+}
+
+/******** threads ************/
+
+struct t_arg {
+    long id; //thread id
+    long numthreads; //number of threads
+    int job; //JOB_NONE, JOB_COUNT or JOB_SCALE
+    struct region *r; //the shared region
+    long length; //length of the array
+    int scalar; //scalar for JOB_SCALE
+};
+
+void *worker(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    do_job(myargs->job, myargs->r, myargs->length, myargs->numthreads,
+           myargs->id, myargs->scalar);
+    return NULL;
+}
+
+/* Creates p threads to do job, and joins all of them. */
+void run_threads(int job, struct region *r, long n, long p, int scalar) {
+    long t;
+    int ret;
+    pthread_t *thread_array = malloc(p * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(p * sizeof(struct t_arg));
+    if (!thread_array || !thread_args) print_error("ERROR: cannot malloc");
+
+    for (t = 0; t < p; t++) {
+        thread_args[t].id = t;
+        thread_args[t].numthreads = p;
+        thread_args[t].job = job;
+        thread_args[t].r = r;
+        thread_args[t].length = n;
+        thread_args[t].scalar = scalar;
+    }
+    for (t = 0; t < p; t++) {
+        ret = pthread_create(&thread_array[t], NULL, worker, &thread_args[t]);
+        if (ret) print_error("ERROR: pthread_create failed");
+    }
+    for (t = 0; t < p; t++) {
+        ret = pthread_join(thread_array[t], NULL);
+        if (ret) print_error("ERROR: pthread_join failed");
+    }
+    free(thread_array);
+    free(thread_args);
+}
+
+/******** benchmark ************/
+
+/* Runs job with the given backend NITER times; returns the average time.
+ * For JOB_COUNT, the workers' counts are combined into counts. */
+double time_job(int backend, int job, struct region *r, long n, long p,
+                int scalar, long *counts) {
+    struct timeval tstart, tend;
+    long iter, id;
+    int i;
+
+    fflush(stdout); // so that children do not inherit unwritten output
+    gettimeofday(&tstart, NULL);
+    for (iter = 0; iter < NITER; iter++) {
+        if (backend == B_THREADS) {
+            run_threads(job, r, n, p, scalar);
+        } else {
+            run_processes(job, r, n, p, scalar);
+        }
+        if (job == JOB_COUNT) { // combine the results
+            for (i = 0; i < MAX; i++) counts[i] = 0;
+            for (id = 0; id < p; id++) {
+                for (i = 0; i < MAX; i++) counts[i] += r->slots[id].counts[i];
+            }
+        }
+    }
+    gettimeofday(&tend, NULL);
+    return getTime(tstart, tend) / NITER;
+}
+
+int main(int argc, char **argv) {
+    int b, i, errors = 0;
+    long n, p, j, counts[MAX], expected[MAX] = {0};
+    double t_none, t_count, t_scale;
+    struct region r;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <n> <p>\n", argv[0]);
+        fprintf(stderr, "where <n> is the length of the array\n");
+        fprintf(stderr, "and <p> is the number of worker processes or threads\n");
+        return 1;
+    }
+    n = strtol(argv[1], NULL, 10);
+    p = strtol(argv[2], NULL, 10);
+    if (p < 1) print_error("ERROR: p needs to be at least 1");
+    if (n < p) print_error("ERROR: n must be at least p");
+
+    printf("n = %ld, %ld workers, average of %d runs\n", n, p, NITER);
+    printf("%-20s %14s %14s %16s\n", "backend", "no work (s)", "countElems (s)",
+           "scalar_mult (s)");
+
+    for (b = 0; b < NBACKENDS; b++) {
+        create_region(&r, n, p, b == B_MEMFD);
+        srand(10);
+        genRandomArray(r.array, n);
+        if (b == 0) {
+            for (j = 0; j < n; j++) expected[r.array[j]]++;
+        }
+
+        t_none = time_job(b, JOB_NONE, &r, n, p, 0, counts);
+        t_count = time_job(b, JOB_COUNT, &r, n, p, 0, counts);
+        for (i = 0; i < MAX; i++) {
+            if (counts[i] != expected[i]) errors++;
+        }
+        // multiply by -1 an odd number of times: every value is negated
+        t_scale = time_job(b, JOB_SCALE, &r, n, p, -1, counts);
+        for (i = 0; i < MAX; i++) counts[i] = 0;
+        for (j = 0; j < n; j++) {
+            if (r.array[j] > 0 || r.array[j] <= -MAX) {
+                errors++;
+                break;
+            }
+            counts[-r.array[j]]++;
+        }
+        for (i = 0; i < MAX; i++) {
+            if (counts[i] != expected[i]) errors++;
+        }
+
+        printf("%-20s %14.6f %14.6f %16.6f\n", backend_names[b], t_none, t_count,
+               t_scale);
+        destroy_region(&r);
+    }
+
+    printf("%s\n", errors ? "ERROR: wrong results" : "results verified");
+    return errors ? 1 : 0;
+}
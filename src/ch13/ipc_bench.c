@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Measures how fast a parent process can pass buffers to the child it
+ * forks, with each of the methods in ipc_channel.h: pipe, vmsplice, memfd
+ * and a shared-memory ring.
+ *
+ * For each method and message size, the parent (the sender) forks a child
+ * (the receiver) and:
+ *
+ *   1. sends a stream of messages as fast as it can, and reports the
+ *      bandwidth: bytes sent divided by the time until the child has
+ *      received them all
+ *   2. sends messages one at a time, waiting for the child to receive each
+ *      before sending the next, and reports the latency: the time from
+ *      ipc_send being called to ipc_recv returning in the child (the
+ *      median and the 99th percentile)
+ *
+ * The sender fills in every byte of every message, and the receiver checks
+ * every byte, as a real producer and consumer would touch their data.
+ * The child reports back to the parent through a separate pipe.
+ *
+ * To compile: gcc -O2 -o ipc_bench ipc_bench.c ipc_channel.c
+ *
+ * To run: ./ipc_bench [max_bytes]
+ *   max_bytes: largest message size (default 16 MiB)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "ipc_channel.h"
+
+#define MIN_BYTES 64
+#define MAX_BYTES (16L << 20)
+#define STREAM_BYTES (256L << 20) /* bytes sent in the bandwidth test */
+#define MAX_MSGS 200000           /* most messages in the bandwidth test */
+#define LAT_BYTES (64L << 20)     /* bytes sent in the latency test */
+#define MIN_LAT 20
+#define MAX_LAT 2000              /* most messages in the latency test */
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: returns the current time in seconds.  CLOCK_MONOTONIC
+ * is the same clock in every process, so a time read by the sender can be
+ * compared with one read by the receiver. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+/* reads or writes exactly n bytes through a pipe, or exits */
+void read_exact(int fd, void *buf, size_t n) {
+    ssize_t ret;
+    while (n > 0) {
+        ret = read(fd, buf, n);
+        if (ret <= 0) print_error("ERROR: reading from the other process");
+        buf = (char *)buf + ret;
+        n -= ret;
+    }
+}
+void write_exact(int fd, const void *buf, size_t n) {
+    ssize_t ret;
+    while (n > 0) {
+        ret = write(fd, buf, n);
+        if (ret <= 0) print_error("ERROR: writing to the other process");
+        buf = (const char *)buf + ret;
+        n -= ret;
+    }
+}
+
+/* Message i: every 8-byte word is a pattern made from i, except the first,
+ * which holds the time it was sent (or 0). */
+void fill(uint64_t *msg, size_t len, long i, double stamp) {
+    uint64_t pattern = 0x0101010101010101ULL * (i & 0xff);
+    size_t j;
+    for (j = 1; j < len / 8; j++) {
+        msg[j] = pattern;
+    }
+    memcpy(&msg[0], &stamp, sizeof(stamp));
+}
+
+/* returns 1 if message i is wrong */
+int check(const uint64_t *msg, size_t len, size_t expected_len, long i) {
+    uint64_t pattern = 0x0101010101010101ULL * (i & 0xff);
+    size_t j;
+    int bad = len != expected_len;
+    for (j = 1; j < len / 8 && !bad; j++) {
+        bad = msg[j] != pattern;
+    }
+    return bad;
+}
+
+/* comparison function for qsort */
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* The child: receives nmsgs messages, then nlat one at a time, and reports
+ * on the done pipe: a byte after the stream and after each single message,
+ * then the latencies and the number of wrong messages. */
+void receiver(struct ipc_channel *ch, size_t size, long nmsgs, long nlat, int done) {
+    double *lat = malloc(nlat * sizeof(double));
+    long i, errors = 0;
+    size_t len;
+    uint64_t *msg;
+    double stamp;
+    char byte = 0;
+
+    if (lat == NULL) print_error("ERROR: cannot malloc");
+    for (i = 0; i < nmsgs; i++) {
+        msg = ipc_recv(ch, &len);
+        if (msg == NULL) print_error("ERROR: channel closed early");
+        errors += check(msg, len, size, i);
+        ipc_release(ch, msg);
+    }
+    write_exact(done, &byte, 1);
+
+    for (i = 0; i < nlat; i++) {
+        msg = ipc_recv(ch, &len);
+        if (msg == NULL) print_error("ERROR: channel closed early");
+        memcpy(&stamp, &msg[0], sizeof(stamp));
+        lat[i] = now() - stamp;
+        errors += check(msg, len, size, i);
+        ipc_release(ch, msg);
+        write_exact(done, &byte, 1);
+    }
+
+    write_exact(done, lat, nlat * sizeof(double));
+    write_exact(done, &errors, sizeof(errors));
+    free(lat);
+}
+
+/* Runs both tests for one method and size.  Returns the number of wrong
+ * messages. */
+long run(int method, size_t size) {
+    struct ipc_channel ch;
+    long nmsgs, nlat, i, errors;
+    int done[2], status;
+    double start, gbps, *lat;
+    uint64_t *buf;
+    char byte;
+    pid_t pid;
+
+    nmsgs = STREAM_BYTES / size;
+    if (nmsgs > MAX_MSGS) nmsgs = MAX_MSGS;
+    if (nmsgs < 1) nmsgs = 1;
+    nlat = LAT_BYTES / size;
+    if (nlat > MAX_LAT) nlat = MAX_LAT;
+    if (nlat < MIN_LAT) nlat = MIN_LAT;
+
+    if (ipc_open(&ch, method, size) == -1) exit(1);
+    if (pipe(done) == -1) print_error("ERROR: pipe failed");
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == -1) print_error("ERROR: fork failed");
+    if (pid == 0) { /* the child process: the receiver */
+        close(done[0]);
+        ipc_role(&ch, IPC_RECEIVER);
+        receiver(&ch, size, nmsgs, nlat, done[1]);
+        ipc_close(&ch);
+        _exit(0);
+    }
+
+    /* the parent process: the sender */
+    close(done[1]);
+    ipc_role(&ch, IPC_SENDER);
+    lat = malloc(nlat * sizeof(double));
+    if (lat == NULL) print_error("ERROR: cannot malloc");
+
+    start = now();
+    for (i = 0; i < nmsgs; i++) {
+        buf = ipc_send_buf(&ch, size);
+        if (buf == NULL) exit(1);
+        fill(buf, size, i, 0);
+        if (ipc_send(&ch, buf, size) == -1) exit(1);
+    }
+    read_exact(done[0], &byte, 1);
+    gbps = (double)nmsgs * size / (now() - start) / 1e9;
+
+    for (i = 0; i < nlat; i++) {
+        buf = ipc_send_buf(&ch, size);
+        if (buf == NULL) exit(1);
+        fill(buf, size, i, 0);
+        // the time is stamped after the message is filled in, so latency
+        // does not include producing it
+        start = now();
+        memcpy(&buf[0], &start, sizeof(start));
+        if (ipc_send(&ch, buf, size) == -1) exit(1);
+        read_exact(done[0], &byte, 1);
+    }
+
+    read_exact(done[0], lat, nlat * sizeof(double));
+    read_exact(done[0], &errors, sizeof(errors));
+    ipc_close(&ch);
+    close(done[0]);
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        print_error("ERROR: receiver failed");
+    }
+
+    qsort(lat, nlat, sizeof(double), cmp_double);
+    printf("%-10s %10zu %8ld %10.3f %12.2f %12.2f\n", ipc_method_name(method),
+           size, nmsgs, gbps, lat[nlat / 2] * 1e6, lat[nlat * 99 / 100] * 1e6);
+    free(lat);
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    long max_bytes = MAX_BYTES, errors = 0;
+    size_t size;
+    int m;
+
+    if (argc == 2) {
+        max_bytes = strtol(argv[1], NULL, 10);
+    }
+    if (argc > 2 || max_bytes < MIN_BYTES) {
+        fprintf(stderr, "usage: %s [max_bytes]\n", argv[0]);
+        fprintf(stderr, "where [max_bytes] >= %d is the largest message size\n",
+                MIN_BYTES);
+        return 1;
+    }
+
+    printf("%-10s %10s %8s %10s %12s %12s\n", "method", "bytes", "msgs", "GB/s",
+           "p50 lat (us)", "p99 lat (us)");
+    for (m = 0; m < IPC_NMETHODS; m++) {
+        for (size = MIN_BYTES; size <= (size_t)max_bytes; size *= 4) {
+            errors += run(m, size);
+        }
+    }
+
+    printf("%s\n", errors ? "ERROR: messages were corrupted" : "all messages verified");
+    return errors ? 1 : 0;
+}
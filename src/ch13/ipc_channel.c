@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the ipc_channel library (see ipc_channel.h).
+ *
+ * Compile it together with a program that uses it, for example:
+ *   gcc -O2 -o ipc_bench ipc_bench.c ipc_channel.c
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+#include "ipc_channel.h"
+
+#define IPC_HDR 64               /* header before each message in a stream */
+#define IPC_PIPE_SIZE (1 << 20)  /* requested pipe capacity */
+#define IPC_RING_SIZE (4 << 20)  /* bytes of data in a ring */
+#define PAGE 4096
+#define LINE 64
+
+static const char *method_names[IPC_NMETHODS] = {
+    "pipe", "vmsplice", "memfd", "ring"
+};
+
+const char *ipc_method_name(int method) {
+    return method >= 0 && method < IPC_NMETHODS ? method_names[method] : "?";
+}
+
+/******** the shared-memory ring ************/
+
+/* The ring's control block, at the start of its shared mapping, followed by
+ * the data.  head and tail count all the bytes ever written and read, so
+ * head - tail bytes are in the ring.  Each side has its own cache line. */
+struct ipc_ring {
+    // written by the sender
+    uint64_t head __attribute__((aligned(LINE)));
+    uint32_t head_seq;       // futex: incremented when head moves
+    uint32_t send_waiting;   // 1 while the sender waits for space
+    uint32_t closed;         // 1 once the sender has closed the ring
+    // written by the receiver
+    uint64_t tail __attribute__((aligned(LINE)));
+    uint32_t tail_seq;       // futex: incremented when tail moves
+    uint32_t recv_waiting;   // 1 while the receiver waits for data
+    char data[] __attribute__((aligned(LINE)));
+};
+
+static void futex_wait(uint32_t *addr, uint32_t val) {
+    // returns at once if *addr is no longer val (someone moved on already)
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* Waits until cond (re-evaluated each time) is true.  Before sleeping, the
+ * waiter announces itself in *waiting and checks cond once more; the other
+ * side moves its counter, bumps *seq and then checks *waiting, so either the
+ * waiter sees the change or the other side sees the waiter and wakes it. */
+#define RING_WAIT(cond, seq, waiting)                                         \
+    while (!(cond)) {                                                         \
+        uint32_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);                  \
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);                       \
+        if (!(cond)) futex_wait(seq, s);                                      \
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);                       \
+    }
+
+/* copies n bytes from src into the ring, waiting for space as needed */
+static void ring_write(struct ipc_ring *r, const char *src, size_t n) {
+    uint64_t head = r->head, tail;
+    size_t chunk, at;
+
+    while (n > 0) {
+        RING_WAIT((tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST),
+                   head - tail < IPC_RING_SIZE), &r->tail_seq, &r->send_waiting);
+        chunk = IPC_RING_SIZE - (head - tail);  // free space
+        at = head % IPC_RING_SIZE;
+        if (chunk > IPC_RING_SIZE - at) chunk = IPC_RING_SIZE - at; // to the end
+        if (chunk > n) chunk = n;
+        memcpy(r->data + at, src, chunk);
+        head += chunk;
+        src += chunk;
+        n -= chunk;
+
+        // publish the data, then wake the receiver if it is waiting
+        __atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&r->head_seq, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->recv_waiting, __ATOMIC_SEQ_CST)) {
+            futex_wake(&r->head_seq);
+        }
+    }
+}
+
+/* copies n bytes out of the ring into dst, waiting for data as needed.
+ * returns 0, or -1 if the ring was closed first */
+static int ring_read(struct ipc_ring *r, char *dst, size_t n) {
+    uint64_t tail = r->tail, head;
+    size_t chunk, at;
+
+    while (n > 0) {
+        RING_WAIT((head = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST),
+                   head > tail || __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE)),
+                  &r->head_seq, &r->recv_waiting);
+        if (head == tail) return -1; // closed, and nothing left
+        chunk = head - tail;
+        at = tail % IPC_RING_SIZE;
+        if (chunk > IPC_RING_SIZE - at) chunk = IPC_RING_SIZE - at;
+        if (chunk > n) chunk = n;
+        memcpy(dst, r->data + at, chunk);
+        tail += chunk;
+        dst += chunk;
+        n -= chunk;
+
+        // free the space, then wake the sender if it is waiting
+        __atomic_store_n(&r->tail, tail, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&r->tail_seq, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->send_waiting, __ATOMIC_SEQ_CST)) {
+            futex_wake(&r->tail_seq);
+        }
+    }
+    return 0;
+}
+
+/******** helpers for pipes ************/
+
+/* writes all n bytes of buf to fd. returns 0, or -1 on error */
+static int write_all(int fd, const char *buf, size_t n) {
+    ssize_t ret;
+    while (n > 0) {
+        ret = write(fd, buf, n);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            perror("ipc_send: write");
+            return -1;
+        }
+        buf += ret;
+        n -= ret;
+    }
+    return 0;
+}
+
+/* reads exactly n bytes from fd into buf. returns 0, or -1 at end of file
+ * or on error */
+static int read_all(int fd, char *buf, size_t n) {
+    ssize_t ret;
+    while (n > 0) {
+        ret = read(fd, buf, n);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) {
+            if (ret == -1) perror("ipc_recv: read");
+            return -1;
+        }
+        buf += ret;
+        n -= ret;
+    }
+    return 0;
+}
+
+/******** the interface ************/
+
+int ipc_open(struct ipc_channel *ch, int method, size_t max_len) {
+    int ret;
+
+    memset(ch, 0, sizeof(*ch));
+    ch->method = method;
+    ch->max_len = max_len;
+    ch->fds[0] = ch->fds[1] = ch->memfd = -1;
+
+    switch (method) {
+        case IPC_PIPE:
+        case IPC_VMSPLICE:
+            if (pipe(ch->fds) == -1) {
+                perror("ipc_open: pipe");
+                return -1;
+            }
+            // a larger pipe means fewer trips into the kernel (this can fail
+            // if it is over the system's limit, which is not an error)
+            fcntl(ch->fds[1], F_SETPIPE_SZ, IPC_PIPE_SIZE);
+            ret = fcntl(ch->fds[1], F_GETPIPE_SZ);
+            ch->pipe_size = ret > 0 ? ret : 16 * PAGE;
+            return 0;
+        case IPC_MEMFD:
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ch->fds) == -1) {
+                perror("ipc_open: socketpair");
+                return -1;
+            }
+            return 0;
+        case IPC_RING:
+            ch->ring_len = sizeof(struct ipc_ring) + IPC_RING_SIZE;
+            ch->ring = mmap(NULL, ch->ring_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (ch->ring == MAP_FAILED) {
+                perror("ipc_open: mmap");
+                ch->ring = NULL;
+                return -1;
+            }
+            return 0;
+    }
+    fprintf(stderr, "ipc_open: unknown method %d\n", method);
+    return -1;
+}
+
+void ipc_role(struct ipc_channel *ch, int role) {
+    int unused = role == IPC_SENDER ? 0 : 1;
+    ch->role = role;
+    if (ch->fds[unused] != -1) {
+        close(ch->fds[unused]);
+        ch->fds[unused] = -1;
+    }
+}
+
+void *ipc_send_buf(struct ipc_channel *ch, size_t len) {
+    char *buf;
+
+    if (len == 0 || len > ch->max_len) {
+        fprintf(stderr, "ipc_send_buf: bad message length %zu\n", len);
+        return NULL;
+    }
+
+    if (ch->method == IPC_MEMFD) {
+        // a new file for every message, written in place
+        ch->memfd = memfd_create("ipc_channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (ch->memfd == -1 || ftruncate(ch->memfd, len) == -1) {
+            perror("ipc_send_buf: memfd");
+            return NULL;
+        }
+        ch->map_len = len;
+        ch->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, ch->memfd, 0);
+        if (ch->map == MAP_FAILED) {
+            perror("ipc_send_buf: mmap");
+            return NULL;
+        }
+        return ch->map;
+    }
+
+    if (ch->sbufs == NULL) {
+        // Each buffer has room for a header before the message, and is page
+        // aligned.  vmsplice'd pages stay in use until the receiver reads
+        // them, so with vmsplice there are enough buffers that a buffer is
+        // only reused after a pipe's worth of pages has been sent since.
+        ch->sbuf_stride = (IPC_HDR + ch->max_len + PAGE - 1) / PAGE * PAGE;
+        ch->nsbufs = 1;
+        if (ch->method == IPC_VMSPLICE) {
+            size_t pages = ch->sbuf_stride / PAGE;
+            ch->nsbufs = 2 + (ch->pipe_size / PAGE + pages - 1) / pages;
+        }
+        if (posix_memalign((void **)&ch->sbufs, PAGE, ch->nsbufs * ch->sbuf_stride)) {
+            fprintf(stderr, "ipc_send_buf: out of memory\n");
+            ch->sbufs = NULL;
+            return NULL;
+        }
+    }
+    buf = ch->sbufs + ch->next_sbuf * ch->sbuf_stride;
+    ch->next_sbuf = (ch->next_sbuf + 1) % ch->nsbufs;
+    return buf + IPC_HDR;
+}
+
+int ipc_send(struct ipc_channel *ch, void *buf, size_t len) {
+    char *msg = (char *)buf - IPC_HDR;  // the header and the message
+    size_t total = IPC_HDR + len;
+    struct iovec iov;
+    ssize_t ret;
+
+    if (ch->method == IPC_MEMFD) {
+        struct msghdr mh;
+        struct cmsghdr *cm;
+        char control[CMSG_SPACE(sizeof(int))];
+        uint64_t len64 = len;
+
+        // seal the file, so the receiver knows it cannot change any more
+        munmap(ch->map, ch->map_len);
+        if (fcntl(ch->memfd, F_ADD_SEALS,
+                  F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+            perror("ipc_send: sealing memfd");
+            return -1;
+        }
+
+        // send the length, with the file descriptor attached
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = &len64;
+        iov.iov_len = sizeof(len64);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &ch->memfd, sizeof(int));
+        ret = sendmsg(ch->fds[1], &mh, 0);
+        close(ch->memfd); // the receiver has its own descriptor now
+        ch->memfd = -1;
+        if (ret == -1) {
+            perror("ipc_send: sendmsg");
+            return -1;
+        }
+        return 0;
+    }
+
+    memset(msg, 0, IPC_HDR);
+    memcpy(msg, &len, sizeof(len));
+    switch (ch->method) {
+        case IPC_PIPE:
+            return write_all(ch->fds[1], msg, total);
+        case IPC_VMSPLICE:
+            iov.iov_base = msg;
+            iov.iov_len = total;
+            while (iov.iov_len > 0) {
+                ret = vmsplice(ch->fds[1], &iov, 1, 0);
+                if (ret == -1) {
+                    if (errno == EINTR) continue;
+                    perror("ipc_send: vmsplice");
+                    return -1;
+                }
+                iov.iov_base = (char *)iov.iov_base + ret;
+                iov.iov_len -= ret;
+            }
+            return 0;
+        case IPC_RING:
+            ring_write(ch->ring, msg, total);
+            return 0;
+    }
+    return -1;
+}
+
+void *ipc_recv(struct ipc_channel *ch, size_t *len) {
+    char hdr[IPC_HDR];
+    size_t n;
+
+    if (ch->method == IPC_MEMFD) {
+        struct msghdr mh;
+        struct cmsghdr *cm;
+        struct iovec iov;
+        char control[CMSG_SPACE(sizeof(int))];
+        struct stat st;
+        uint64_t len64 = 0; // stays 0 if the message is cut short
+        int fd, seals;
+
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = &len64;
+        iov.iov_len = sizeof(len64);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(ch->fds[0], &mh, 0) <= 0) return NULL; // closed
+        cm = CMSG_FIRSTHDR(&mh);
+        if (cm == NULL || cm->cmsg_type != SCM_RIGHTS) {
+            fprintf(stderr, "ipc_recv: no file descriptor received\n");
+            return NULL;
+        }
+        memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+        // only a file sealed against writing and shrinking can be mapped
+        // and read safely: it cannot change, or get shorter than len64
+        // (reading past its end would raise SIGBUS)
+        seals = fcntl(fd, F_GET_SEALS);
+        if (len64 < 1 || len64 > ch->max_len || seals == -1
+            || (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)
+            || fstat(fd, &st) == -1 || (uint64_t)st.st_size < len64) {
+            fprintf(stderr, "ipc_recv: bad memfd message\n");
+            close(fd);
+            return NULL;
+        }
+        ch->map = mmap(NULL, len64, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ch->map == MAP_FAILED) {
+            perror("ipc_recv: mmap");
+            return NULL;
+        }
+        ch->map_len = len64;
+        *len = len64;
+        return ch->map;
+    }
+
+    if (ch->rbuf == NULL) {
+        ch->rbuf = malloc(ch->max_len > 0 ? ch->max_len : 1);
+        if (ch->rbuf == NULL) {
+            fprintf(stderr, "ipc_recv: out of memory\n");
+            return NULL;
+        }
+    }
+    if (ch->method == IPC_RING) {
+        if (ring_read(ch->ring, hdr, IPC_HDR) == -1) return NULL;
+    } else {
+        if (read_all(ch->fds[0], hdr, IPC_HDR) == -1) return NULL;
+    }
+    memcpy(&n, hdr, sizeof(n));
+    if (n > ch->max_len) {
+        fprintf(stderr, "ipc_recv: message of %zu bytes is longer than %zu\n",
+                n, ch->max_len);
+        return NULL;
+    }
+    if (ch->method == IPC_RING) {
+        if (ring_read(ch->ring, ch->rbuf, n) == -1) return NULL;
+    } else {
+        if (read_all(ch->fds[0], ch->rbuf, n) == -1) return NULL;
+    }
+    *len = n;
+    return ch->rbuf;
+}
+
+void ipc_release(struct ipc_channel *ch, void *msg) {
+    if (ch->method == IPC_MEMFD && msg != NULL) {
+        munmap(msg, ch->map_len);
+    }
+}
+
+void ipc_close(struct ipc_channel *ch) {
+    if (ch->fds[0] != -1) close(ch->fds[0]);
+    if (ch->fds[1] != -1) close(ch->fds[1]);
+    if (ch->ring != NULL && ch->role == IPC_SENDER) {
+        // tell a receiver waiting for more that none will come
+        __atomic_store_n(&ch->ring->closed, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&ch->ring->head_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&ch->ring->head_seq);
+    }
+    if (ch->ring != NULL) {
+        munmap(ch->ring, ch->ring_len);
+    }
+    free(ch->sbufs);
+    free(ch->rbuf);
+    memset(ch, 0, sizeof(*ch));
+    ch->fds[0] = ch->fds[1] = ch->memfd = -1;
+}
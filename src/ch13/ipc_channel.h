@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * ipc_channel: moves messages (buffers of any size) from one process to
+ * another, typically a parent and the child it forks, by one of several
+ * methods with the same interface:
+ *
+ *   IPC_PIPE:     write() into a pipe and read() out of it.  Each message is
+ *                 copied twice: into the kernel, then out to the receiver.
+ *   IPC_VMSPLICE: vmsplice() the sender's pages into a pipe, and read() out
+ *                 of it.  The sender's copy is avoided: the pipe refers to
+ *                 the sender's pages until the receiver reads them.
+ *   IPC_MEMFD:    the sender writes each message straight into a new memfd
+ *                 (an anonymous in-memory file), seals it against further
+ *                 changes, and passes the file descriptor over a Unix socket;
+ *                 the receiver maps it.  The data is never copied.
+ *   IPC_RING:     a ring buffer in shared memory.  Each message is copied
+ *                 into the ring and out again, but by the processes
+ *                 themselves: the kernel is only entered (through a futex)
+ *                 when one side must wait for the other.
+ *
+ * Usage: create the channel with ipc_open, fork, and call ipc_role in each
+ * process.  The sender then gets a buffer with ipc_send_buf, fills it in and
+ * passes it to ipc_send; the receiver gets each message from ipc_recv and
+ * gives it back with ipc_release when done with it.
+ */
+#ifndef _IPC_CHANNEL_H_
+#define _IPC_CHANNEL_H_
+
+#include <stddef.h>
+
+enum ipc_method { IPC_PIPE, IPC_VMSPLICE, IPC_MEMFD, IPC_RING, IPC_NMETHODS };
+
+enum ipc_role { IPC_SENDER, IPC_RECEIVER };
+
+struct ipc_ring;
+
+/* one end of a channel (the fields are private) */
+struct ipc_channel {
+    int method;
+    int role;            // IPC_SENDER or IPC_RECEIVER
+    int fds[2];          // pipe or socket pair: [0] receives, [1] sends
+    size_t max_len;      // largest message
+    size_t pipe_size;    // capacity of the pipe, in bytes
+    char *sbufs;         // sender's buffers
+    int nsbufs, next_sbuf;
+    size_t sbuf_stride;
+    int memfd;           // IPC_MEMFD: the message being built
+    void *map;           // IPC_MEMFD: its mapping (or the received one)
+    size_t map_len;
+    char *rbuf;          // receiver's buffer
+    struct ipc_ring *ring;
+    size_t ring_len;     // length of the ring's mapping
+};
+
+/*
+ * Returns the name of a method ("pipe", "vmsplice", "memfd" or "ring").
+ */
+extern const char *ipc_method_name(int method);
+
+/*
+ * Creates a channel for messages of up to max_len bytes.  Call before fork.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int ipc_open(struct ipc_channel *ch, int method, size_t max_len);
+
+/*
+ * Makes this process the channel's sender or receiver.  Call after fork,
+ * in both processes.
+ */
+extern void ipc_role(struct ipc_channel *ch, int role);
+
+/*
+ * Returns a buffer for the next message, of len bytes (at least 1 and at
+ * most max_len).
+ * Fill it in, then pass it to ipc_send.
+ *  returns NULL on error (with a message printed to stderr)
+ */
+extern void *ipc_send_buf(struct ipc_channel *ch, size_t len);
+
+/*
+ * Sends the len-byte message in buf, which must have come from the last
+ * call of ipc_send_buf.  The buffer must not be used again.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int ipc_send(struct ipc_channel *ch, void *buf, size_t len);
+
+/*
+ * Waits for the next message, and sets *len to its length.  The message
+ * is valid until ipc_release is called.
+ *  returns the message, or NULL if the sender has closed the channel
+ */
+extern void *ipc_recv(struct ipc_channel *ch, size_t *len);
+
+/*
+ * Gives back a message returned by ipc_recv.
+ */
+extern void ipc_release(struct ipc_channel *ch, void *msg);
+
+/*
+ * Closes this process's end of the channel.  Once the sender has closed
+ * it, ipc_recv returns NULL after the last message.
+ */
+extern void ipc_close(struct ipc_channel *ch);
+
+#endif
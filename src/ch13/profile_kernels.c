@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Profiles three kernels from the book with the sampling profiler in
+ * profiler.h, and writes their folded stacks, ready to be drawn as a flame
+ * graph:
+ *
+ *   prime:  genPrimeSequence, which calls getNextPrime, which calls isPrime
+ *           (ch12, optExample.c)
+ *   count:  countElems on p threads, each counting its chunk into local
+ *           counts before adding them to the shared ones (ch14,
+ *           countElems_p_v3.c)
+ *   matvec: matrixVectorMultiply, on a matrix of rows of separate arrays,
+ *           walked column by column (ch12, matrixVector.c)
+ *
+ * The kernels are marked noinline so that each keeps a frame of its own,
+ * and appears in the stacks, even when the compiler would inline it.
+ *
+ * To compile:
+ *   gcc -O2 -fno-omit-frame-pointer -rdynamic -o profile_kernels \
+ *       profile_kernels.c profiler.c -lm -lpthread
+ *
+ * To run: ./profile_kernels <kernel> <n> [p] > out.folded
+ *   kernel: prime, count or matvec
+ *   n:      prime: the limit to find primes up to
+ *           count: the length of the array
+ *           matvec: the number of rows and of columns
+ *   p:      count: the number of threads (default 1)
+ *
+ *   ./profile_kernels prime 5000000 > prime.folded
+ *   flamegraph.pl prime.folded > prime.svg
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "profiler.h"
+
+#define PROF_RATE 997  /* samples per CPU second (not a round number, so
+                          samples do not fall in step with the program);
+                          the kernel's tick rate may give fewer, so the
+                          rate achieved is printed too */
+#define MAX 10         //countElems: the maximum value of an element
+#define NITER 10       //times countElems and matrixVectorMultiply are run
+
+#define NOINLINE __attribute__((noinline))
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+//helper function: allocates an array of a specified length and returns a pointer
+int * allocateArray(long len) {
+    int * result = malloc(len * sizeof(int));
+    if (result == NULL) print_error("ERROR: malloc failed");
+    return result;
+}
+
+/******** prime: from ch12/optExample.c ************/
+
+//helper function: checks to see if a number is prime
+NOINLINE int isPrime(int x) {
+    int i;
+    for (i = 2; i < sqrt(x)+1; i++) { //no prime number is less than 2
+        if (x % i == 0) { //if the number is divisible by i
+            return 0; //it is not prime
+        }
+    }
+    return 1; //otherwise it is prime
+}
+
+// finds the next prime
+NOINLINE int getNextPrime(int prev) {
+    int next = prev + 1;
+    while (!isPrime(next)) { //while the number is not prime
+        next++; //increment and check again
+    }
+    return next;
+}
+
+// generates a sequence of primes
+NOINLINE int genPrimeSequence(int * array, int limit) {
+    int i;
+    int len = limit;
+    if (len == 0) return 0;
+    array[0]=2; //initialize the first number to 2
+    for (i = 1; i < len; i++) {
+        array[i] = getNextPrime(array[i-1]); //fill in the array
+        if (array[i] > limit){
+            len = i;
+            return len;
+        }
+    }
+    return len;
+}
+
+/******** count: from ch14/countElems_p_v3.c ************/
+
+long counts[MAX];
+pthread_mutex_t mutex;
+
+struct t_arg {
+    int *array; //pointer to shared array
+    long length; //num elements in array
+    long nthreads; //number of threads
+    long id; //logical thread id
+};
+
+NOINLINE void *countElems(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long local_counts[MAX] = {0};
+    long chunk = myargs->length / myargs->nthreads;
+    long start = myargs->id * chunk;
+    long end = (myargs->id == myargs->nthreads - 1) ? myargs->length : start + chunk;
+    long i;
+    int j, val;
+    int *array = myargs->array;
+
+    for (i = start; i < end; i++) {
+        val = array[i];
+        local_counts[val] = local_counts[val] + 1;
+    }
+
+    pthread_mutex_lock(&mutex);
+    for (j = 0; j < MAX; j++) {
+        counts[j] += local_counts[j];
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+/* each thread runs the kernel NITER times, and is sampled only then */
+void *countThread(void *args) {
+    long iter;
+    if (prof_thread_start() == -1) exit(1);
+    for (iter = 0; iter < NITER; iter++) {
+        countElems(args);
+    }
+    prof_thread_stop();
+    return NULL;
+}
+
+/******** matvec: from ch12/matrixVector.c ************/
+
+NOINLINE void matrixVectorMultiply(int ** mat, int * vec, int ** res, int row, int col){
+    int i, j;
+    for (j = 0; j < col; j++){
+        for (i = 0; i < row; i++){
+            res[i][j] = mat[i][j] * vec[j];
+        }
+    }
+}
+
+/******** the kernels, as run ************/
+
+void run_prime(long n) {
+    int *array = allocateArray(n + 1);
+    int len = genPrimeSequence(array, n);
+    fprintf(stderr, "found %d primes up to %ld\n", len, n);
+    free(array);
+}
+
+void run_count(long n, long p) {
+    int *array = allocateArray(n);
+    pthread_t *thread_array = malloc(p * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(p * sizeof(struct t_arg));
+    long i, t, total = 0;
+
+    if (!thread_array || !thread_args) print_error("ERROR: malloc failed");
+    for (i = 0; i < n; i++) {
+        array[i] = rand() % MAX;
+    }
+    pthread_mutex_init(&mutex, NULL);
+    for (t = 0; t < p; t++) {
+        thread_args[t].array = array;
+        thread_args[t].length = n;
+        thread_args[t].nthreads = p;
+        thread_args[t].id = t;
+        if (pthread_create(&thread_array[t], NULL, countThread, &thread_args[t])) {
+            print_error("ERROR: pthread_create failed");
+        }
+    }
+    for (t = 0; t < p; t++) {
+        pthread_join(thread_array[t], NULL);
+    }
+    pthread_mutex_destroy(&mutex);
+    for (i = 0; i < MAX; i++) total += counts[i];
+    if (total != n * NITER) print_error("ERROR: countElems lost elements");
+    fprintf(stderr, "counted %ld elements %d times on %ld threads\n", n, NITER, p);
+    free(array);
+    free(thread_array);
+    free(thread_args);
+}
+
+void run_matvec(long n) {
+    int **matrix = malloc(n * sizeof(int *));
+    int **result = malloc(n * sizeof(int *));
+    int *vector = allocateArray(n);
+    long i, j, iter;
+
+    if (!matrix || !result) print_error("ERROR: malloc failed");
+    for (i = 0; i < n; i++) {
+        matrix[i] = allocateArray(n);
+        result[i] = allocateArray(n);
+        for (j = 0; j < n; j++) matrix[i][j] = rand() % MAX;
+        vector[i] = rand() % MAX;
+    }
+    for (iter = 0; iter < NITER; iter++) {
+        matrixVectorMultiply(matrix, vector, result, n, n);
+    }
+    fprintf(stderr, "multiplied a %ldx%ld matrix %d times\n", n, n, NITER);
+    for (i = 0; i < n; i++) {
+        free(matrix[i]);
+        free(result[i]);
+    }
+    free(matrix);
+    free(result);
+    free(vector);
+}
+
+int main(int argc, char **argv) {
+    struct timeval tstart, tend;
+    long n, p = 1, samples;
+    double cpu;
+
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s <kernel> <n> [p]\n", argv[0]);
+        fprintf(stderr, "where <kernel> is prime, count or matvec\n");
+        fprintf(stderr, "and <n> is the prime limit, array length, or matrix size\n");
+        fprintf(stderr, "and [p] is the number of threads for count\n");
+        fprintf(stderr, "folded stacks are written to standard output\n");
+        return 1;
+    }
+    n = strtol(argv[2], NULL, 10);
+    if (argc == 4) p = strtol(argv[3], NULL, 10);
+    if (n < 1) print_error("ERROR: n must be at least 1");
+    if (p < 1) print_error("ERROR: p must be at least 1");
+    if (n > 2000000000) print_error("ERROR: n is too large");
+
+    srand(10);
+    if (prof_init(PROF_RATE) == -1) return 1;
+
+    gettimeofday(&tstart, NULL);
+    if (strcmp(argv[1], "prime") == 0) {
+        if (prof_thread_start() == -1) return 1;
+        run_prime(n);
+        prof_thread_stop();
+    } else if (strcmp(argv[1], "count") == 0) {
+        run_count(n, p);
+    } else if (strcmp(argv[1], "matvec") == 0) {
+        if (prof_thread_start() == -1) return 1;
+        run_matvec(n);
+        prof_thread_stop();
+    } else {
+        print_error("ERROR: kernel must be prime, count or matvec");
+    }
+    gettimeofday(&tend, NULL);
+
+    samples = prof_write(stdout);
+    if (samples == -1) return 1;
+    fprintf(stderr, "time: %g s, %ld samples (%ld dropped)\n",
+            getTime(tstart, tend), samples, prof_dropped());
+    //below PROF_RATE when the kernel's timer tick is slower
+    cpu = prof_cpu_time();
+    fprintf(stderr, "sampled CPU time: %g s, %.0f samples per CPU second (%d requested)\n",
+            cpu, cpu > 0 ? (samples + prof_dropped()) / cpu : 0.0, PROF_RATE);
+    return 0;
+}
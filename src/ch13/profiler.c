@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the profiler library (see profiler.h).
+ *
+ * Compile it together with the program it profiles, for example:
+ *   gcc -O2 -fno-omit-frame-pointer -rdynamic -o profile_kernels \
+ *       profile_kernels.c profiler.c -lm -lpthread
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "profiler.h"
+
+#define PROF_DEPTH 32          /* most addresses recorded per sample */
+#define PROF_SAMPLES (1 << 16) /* samples each thread's buffer holds */
+#define PROF_THREADS 1024      /* most threads sampled in one run */
+#define PROF_NAME 4096         /* longest folded stack printed */
+
+// older glibc versions do not name this field of struct sigevent
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* one sample: the interrupted instruction, then the return addresses of
+ * its callers, innermost first */
+struct prof_sample {
+    int depth;
+    void *pc[PROF_DEPTH];
+};
+
+/* one thread's samples; only that thread's signal handler adds to it */
+struct prof_buf {
+    uintptr_t stack_lo, stack_hi;  // the thread's stack
+    timer_t timer;
+    struct timespec cpu_start;     // the thread's CPU time when started
+    double cpu;                    // CPU seconds sampled (set when stopped)
+    long count;                    // samples in it (read by prof_write)
+    struct prof_sample samples[PROF_SAMPLES];
+};
+
+static int prof_hz;
+static struct prof_buf *bufs[PROF_THREADS];  // every thread's buffer
+static long nbufs;
+static long dropped;
+
+/* the calling thread's buffer, or NULL when it is not being sampled */
+static __thread struct prof_buf *my_buf;
+
+/* Follows the frame pointer chain from fp, storing return addresses in s.
+ * Each frame starts with the caller's frame pointer, then the return
+ * address.  A frame pointer outside the stack, not aligned or not moving
+ * towards the stack's base ends the walk: the code running may not keep
+ * frame pointers, or may not have set up its frame yet. */
+static void walk_frames(struct prof_sample *s, uintptr_t fp, uintptr_t lo, uintptr_t hi) {
+    uintptr_t *frame, next;
+    while (s->depth < PROF_DEPTH && fp >= lo && fp + 2 * sizeof(uintptr_t) <= hi
+           && fp % sizeof(uintptr_t) == 0) {
+        frame = (uintptr_t *)fp;
+        if (frame[1] == 0) break;
+        s->pc[s->depth++] = (void *)frame[1];
+        next = frame[0];
+        if (next <= fp) break;
+        fp = next;
+    }
+}
+
+/* The SIGPROF handler: records a sample in the interrupted thread's buffer.
+ * It calls no library functions, so it is async-signal-safe. */
+static void prof_handler(int sig, siginfo_t *info, void *context) {
+    ucontext_t *uc = (ucontext_t *)context;
+    struct prof_buf *b = my_buf;
+    struct prof_sample *s;
+    uintptr_t pc, fp;
+    int saved_errno = errno;
+
+    (void)sig;
+    (void)info;
+    if (b == NULL) return; // a signal left over after prof_thread_stop
+    if (b->count == PROF_SAMPLES) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+#if defined(__x86_64__)
+    pc = uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+    pc = uc->uc_mcontext.pc;
+    fp = uc->uc_mcontext.regs[29];
+#else
+    (void)uc;
+    pc = 0;
+    fp = 0; // no unwinding: only the samples' count is recorded
+#endif
+
+    s = &b->samples[b->count];
+    s->depth = 0;
+    if (pc != 0) s->pc[s->depth++] = (void *)pc;
+    walk_frames(s, fp, b->stack_lo, b->stack_hi);
+    // publish the sample only once it is complete
+    __atomic_store_n(&b->count, b->count + 1, __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+int prof_init(int hz) {
+    struct sigaction sa;
+
+    if (hz < 1 || hz > 1000000) {
+        fprintf(stderr, "prof_init: bad sampling rate %d\n", hz);
+        return -1;
+    }
+    prof_hz = hz;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = prof_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART; // interrupted system calls resume
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) == -1) {
+        perror("prof_init: sigaction");
+        return -1;
+    }
+    return 0;
+}
+
+int prof_thread_start(void) {
+    struct prof_buf *b;
+    struct sigevent sev;
+    struct itimerspec spec;
+    pthread_attr_t attr;
+    void *stack;
+    size_t stack_size;
+    long slot;
+
+    if (prof_hz == 0) {
+        fprintf(stderr, "prof_thread_start: prof_init was not called\n");
+        return -1;
+    }
+    if (my_buf != NULL) return 0; // already sampled
+
+    // mmap, not malloc: the buffer is large, and zeroed pages cost nothing
+    // until samples are written to them
+    b = mmap(NULL, sizeof(*b), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED) {
+        perror("prof_thread_start: mmap");
+        return -1;
+    }
+
+    // the unwinder only follows frame pointers that lie in this range
+    if (pthread_getattr_np(pthread_self(), &attr) != 0
+        || pthread_attr_getstack(&attr, &stack, &stack_size) != 0) {
+        fprintf(stderr, "prof_thread_start: cannot find the thread's stack\n");
+        munmap(b, sizeof(*b));
+        return -1;
+    }
+    pthread_attr_destroy(&attr);
+    b->stack_lo = (uintptr_t)stack;
+    b->stack_hi = (uintptr_t)stack + stack_size;
+
+    // a timer on this thread's CPU clock, which signals this thread only
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &b->timer) == -1) {
+        perror("prof_thread_start: timer_create");
+        munmap(b, sizeof(*b));
+        return -1;
+    }
+    my_buf = b;
+
+    // the period, 1/hz seconds (tv_nsec must be less than a second)
+    spec.it_interval.tv_sec = 1 / prof_hz;
+    spec.it_interval.tv_nsec = (1000000000L / prof_hz) % 1000000000L;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(b->timer, 0, &spec, NULL) == -1) {
+        perror("prof_thread_start: timer_settime");
+        goto fail;
+    }
+
+    // only now take a slot in bufs, so that a thread that failed to start
+    // does not use one up.  Slots are taken only while some are left, so
+    // nbufs never passes PROF_THREADS; prof_write skips a slot until its
+    // buffer is stored in it.
+    slot = __atomic_load_n(&nbufs, __ATOMIC_RELAXED);
+    do {
+        if (slot >= PROF_THREADS) {
+            fprintf(stderr, "prof_thread_start: too many threads\n");
+            goto fail;
+        }
+    } while (!__atomic_compare_exchange_n(&nbufs, &slot, slot + 1, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &b->cpu_start);
+    __atomic_store_n(&bufs[slot], b, __ATOMIC_RELEASE);
+    return 0;
+
+fail:
+    timer_delete(b->timer);
+    my_buf = NULL;
+    munmap(b, sizeof(*b));
+    return -1;
+}
+
+void prof_thread_stop(void) {
+    struct prof_buf *b = my_buf;
+    struct timespec now;
+    if (b == NULL) return;
+    timer_delete(b->timer);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    b->cpu = now.tv_sec - b->cpu_start.tv_sec
+             + (now.tv_nsec - b->cpu_start.tv_nsec) / 1.e9;
+    my_buf = NULL;
+}
+
+long prof_dropped(void) {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+double prof_cpu_time(void) {
+    struct prof_buf *b;
+    double total = 0;
+    long i;
+
+    for (i = 0; i < nbufs; i++) {
+        b = __atomic_load_n(&bufs[i], __ATOMIC_ACQUIRE);
+        if (b != NULL) total += b->cpu;
+    }
+    return total;
+}
+
+/* Appends the name of the function containing addr to name, which holds
+ * len characters so far; returns the new length.  Return addresses point
+ * just after their call instruction, which may be the start of the next
+ * function, so addr - 1 is looked up for them. */
+static size_t append_name(char *name, size_t len, void *addr, int is_return) {
+    Dl_info info;
+    const char *sym = "??";
+    void *lookup = is_return ? (char *)addr - 1 : addr;
+    int ret;
+
+    if (dladdr(lookup, &info) != 0 && info.dli_sname != NULL) {
+        sym = info.dli_sname;
+    } else if (len == 0 && is_return) {
+        return 0; // leave out unnamed outermost frames (the C library's start-up)
+    }
+    ret = snprintf(name + len, PROF_NAME - len, "%s%s", len > 0 ? ";" : "", sym);
+    if (ret < 0) return len;
+    len += ret;
+    return len < PROF_NAME ? len : PROF_NAME - 1;
+}
+
+/* comparison function for qsort: orders folded stacks */
+static int cmp_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+long prof_write(FILE *out) {
+    long i, j, k, total = 0, run;
+    struct prof_buf *b;
+    struct prof_sample *s;
+    char **names, name[PROF_NAME];
+    size_t len;
+    int d;
+
+    for (i = 0; i < nbufs; i++) {
+        b = __atomic_load_n(&bufs[i], __ATOMIC_ACQUIRE);
+        if (b != NULL) total += __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+    }
+    names = malloc((total > 0 ? total : 1) * sizeof(char *));
+    if (names == NULL) {
+        fprintf(stderr, "prof_write: out of memory\n");
+        return -1;
+    }
+
+    // turn each sample into its folded stack: outermost function first
+    k = 0;
+    for (i = 0; i < nbufs; i++) {
+        b = __atomic_load_n(&bufs[i], __ATOMIC_ACQUIRE);
+        if (b == NULL) continue;
+        for (j = 0; j < b->count && k < total; j++) {
+            s = &b->samples[j];
+            len = 0;
+            name[0] = '\0';
+            for (d = s->depth - 1; d >= 0; d--) {
+                len = append_name(name, len, s->pc[d], d > 0);
+            }
+            if (len == 0) snprintf(name, PROF_NAME, "??");
+            names[k] = strdup(name);
+            if (names[k] == NULL) {
+                fprintf(stderr, "prof_write: out of memory\n");
+                total = k;
+                break;
+            }
+            k++;
+        }
+    }
+    total = k;
+
+    // sorting brings identical stacks together, to be counted
+    qsort(names, total, sizeof(char *), cmp_names);
+    for (i = 0; i < total; i += run) {
+        for (run = 1; i + run < total && strcmp(names[i], names[i + run]) == 0; run++);
+        fprintf(out, "%s %ld\n", names[i], run);
+    }
+
+    for (i = 0; i < total; i++) free(names[i]);
+    free(names);
+    return total;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * profiler: a sampling profiler that runs inside the program it profiles.
+ *
+ * Each thread that calls prof_thread_start gets a timer that counts the
+ * CPU time the thread uses, and sends it a SIGPROF every 1/hz seconds of
+ * it.  The kernel only checks CPU-time timers at its scheduler tick
+ * (CONFIG_HZ, often 250 or 1000 per second), so a higher hz is capped at
+ * the tick rate: divide the number of samples by prof_cpu_time to see the
+ * rate actually achieved.  The signal handler records where the thread was: the interrupted
+ * instruction and the return addresses on its stack, found by following
+ * the chain of saved frame pointers.  This unwinding only reads memory and
+ * calls no library functions, so it is safe in a signal handler.
+ *
+ * Each thread's samples go into its own buffer, which only that thread's
+ * signal handler writes, so no locks are needed.  prof_write turns the
+ * addresses into function names and prints one line per distinct stack,
+ * in the "folded" format that flame graph tools read:
+ *
+ *   main;genPrimeSequence;getNextPrime;isPrime 1234
+ *
+ * Compile the program with -fno-omit-frame-pointer, so that every function
+ * keeps a frame pointer to follow, and with -rdynamic, so that the
+ * program's own function names can be looked up.  Functions the compiler
+ * inlines do not appear: their time is counted in the function they were
+ * inlined into.
+ */
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdio.h>
+
+/*
+ * Installs the SIGPROF handler; threads started later are sampled hz times
+ * per second of CPU time they use (at most the kernel's tick rate).  Call once, before prof_thread_start.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int prof_init(int hz);
+
+/*
+ * Starts sampling the calling thread.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int prof_thread_start(void);
+
+/*
+ * Stops sampling the calling thread.  Its samples are kept for prof_write.
+ */
+extern void prof_thread_stop(void);
+
+/*
+ * Writes every sample taken so far to out as folded stacks, with the
+ * number of times each stack was seen.  Call after the sampled threads
+ * have stopped.
+ *  returns the number of samples, or -1 on error (with a message printed
+ *  to stderr)
+ */
+extern long prof_write(FILE *out);
+
+/*
+ * Returns the number of samples dropped because a thread's buffer was full.
+ */
+extern long prof_dropped(void);
+
+/*
+ * Returns the CPU time, in seconds, that the sampled threads used between
+ * their prof_thread_start and prof_thread_stop calls.
+ */
+extern double prof_cpu_time(void);
+
+#endif
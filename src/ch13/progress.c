@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the progress library (see progress.h).
+ *
+ * Compile it together with a program that uses it, for example:
+ *   gcc -O2 -o progress_kernels progress_kernels.c progress.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "progress.h"
+
+/* helper function: returns the current time in seconds */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+/* The watcher thread: prints a report each time a SIGUSR1 arrives, until
+ * progress_stop wakes it with one of its own. */
+static void *watch(void *arg) {
+    struct progress *pr = (struct progress *)arg;
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while (1) {
+        if (sigwaitinfo(&set, NULL) == -1) continue; // interrupted: wait again
+        if (__atomic_load_n(&pr->stopping, __ATOMIC_ACQUIRE)) break;
+        progress_report(pr, stderr);
+    }
+    return NULL;
+}
+
+int progress_start(struct progress *pr, const char *name, long total, int nslots) {
+    sigset_t set;
+    int ret;
+
+    if (nslots < 1 || total < 0) {
+        fprintf(stderr, "progress_start: bad arguments\n");
+        return -1;
+    }
+    memset(pr, 0, sizeof(*pr));
+    pr->name = name;
+    pr->total = total;
+    pr->nslots = nslots;
+    pr->slots = aligned_alloc(PROGRESS_LINE, nslots * sizeof(struct progress_slot));
+    if (pr->slots == NULL) {
+        fprintf(stderr, "progress_start: out of memory\n");
+        return -1;
+    }
+    memset(pr->slots, 0, nslots * sizeof(struct progress_slot));
+    pthread_mutex_init(&pr->lock, NULL);
+    pr->start = pr->last_time = now();
+
+    // block SIGUSR1 here (and so in every thread created from now on), so
+    // that it waits for the watcher's sigwaitinfo
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    ret = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (ret == 0) ret = pthread_create(&pr->watcher, NULL, watch, pr);
+    if (ret != 0) {
+        fprintf(stderr, "progress_start: cannot start the watcher thread\n");
+        pthread_mutex_destroy(&pr->lock);
+        free(pr->slots);
+        return -1;
+    }
+    return 0;
+}
+
+void progress_report(struct progress *pr, FILE *out) {
+    double t, elapsed, interval, rate, recent;
+    long done = 0, d;
+    int i;
+
+    pthread_mutex_lock(&pr->lock);
+    t = now();
+    for (i = 0; i < pr->nslots; i++) {
+        done += __atomic_load_n(&pr->slots[i].done, __ATOMIC_RELAXED);
+    }
+    elapsed = t - pr->start;
+    interval = t - pr->last_time;
+    rate = elapsed > 0 ? done / elapsed : 0;
+    recent = interval > 0 ? (done - pr->last_done) / interval : 0;
+
+    fprintf(out, "%s: %ld of %ld (%.1f%%) in %.1f s, %.3g/s (%.3g/s since last report)",
+            pr->name, done, pr->total, pr->total ? 100.0 * done / pr->total : 100.0,
+            elapsed, rate, recent);
+    if (rate > 0 && done < pr->total) {
+        fprintf(out, ", about %.1f s left", (pr->total - done) / rate);
+    }
+    fprintf(out, "\n");
+    if (pr->nslots > 1) {
+        for (i = 0; i < pr->nslots; i++) {
+            d = __atomic_load_n(&pr->slots[i].done, __ATOMIC_RELAXED);
+            fprintf(out, "  thread %d: %ld, %.3g/s\n", i, d,
+                    elapsed > 0 ? d / elapsed : 0);
+        }
+    }
+    fflush(out);
+
+    pr->last_time = t;
+    pr->last_done = done;
+    pthread_mutex_unlock(&pr->lock);
+}
+
+void progress_stop(struct progress *pr) {
+    __atomic_store_n(&pr->stopping, 1, __ATOMIC_RELEASE);
+    pthread_kill(pr->watcher, SIGUSR1);
+    pthread_join(pr->watcher, NULL);
+    pthread_mutex_destroy(&pr->lock);
+    free(pr->slots);
+    pr->slots = NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * progress: lets a long-running kernel report how far along it is, while
+ * it runs, whenever the process is sent a SIGUSR1:
+ *
+ *   kill -USR1 pid
+ *
+ * prints the elements done so far, the throughput (overall, since the last
+ * report, and per thread) and an estimate of the time left.
+ *
+ * Each thread of the kernel publishes its own count of elements done in a
+ * slot of its own with progress_set, which is a single relaxed atomic
+ * store: no lock, no read-modify-write, and (since each slot fills a whole
+ * cache line) no cache line shared with another thread.  The kernel can
+ * call it every few thousand elements and run no slower.
+ *
+ * SIGUSR1 is not handled by a signal handler, in which printing is not
+ * safe: progress_start blocks it, and a watcher thread waits for it with
+ * sigwaitinfo and prints the report as ordinary code.
+ */
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define PROGRESS_LINE 64
+
+/* one thread's count, alone in its cache line */
+struct progress_slot {
+    long done;
+} __attribute__((aligned(PROGRESS_LINE)));
+
+/* a kernel's progress (the fields are private) */
+struct progress {
+    const char *name;
+    long total;               // elements in the whole job
+    int nslots;
+    struct progress_slot *slots;
+    double start;             // when progress_start was called
+    double last_time;         // when the last report was printed
+    long last_done;           // elements done at the last report
+    pthread_mutex_t lock;     // serializes reports
+    pthread_t watcher;
+    int stopping;
+};
+
+/*
+ * Starts tracking a job of total elements, done by up to nslots threads,
+ * and starts the thread that prints a report on each SIGUSR1.  Call before
+ * creating the kernel's threads: SIGUSR1 is blocked in the calling thread,
+ * and threads created later inherit this, so none of them is killed by it.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int progress_start(struct progress *pr, const char *name, long total,
+                          int nslots);
+
+/*
+ * Publishes that the thread owning slot has done done elements in all.
+ * Only that thread may call it for that slot.
+ */
+static inline void progress_set(struct progress *pr, int slot, long done) {
+    __atomic_store_n(&pr->slots[slot].done, done, __ATOMIC_RELAXED);
+}
+
+/*
+ * Prints a report to out now.
+ */
+extern void progress_report(struct progress *pr, FILE *out);
+
+/*
+ * Stops the watcher thread and frees the slots.  Blocked SIGUSR1 signals
+ * that arrive later stay pending, and do nothing.
+ */
+extern void progress_stop(struct progress *pr);
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Runs long kernels that report their progress on request, with the
+ * progress library in progress.h.  While one runs, send it a SIGUSR1 from
+ * another terminal to see how far along it is:
+ *
+ *   kill -USR1 pid
+ *
+ * The kernels:
+ *
+ *   prime: genPrimeSequence (ch12, optExample.c).  Its progress is the
+ *          number it has reached, out of the limit.  Larger numbers take
+ *          longer to test, so the estimate of the time left is optimistic.
+ *   sort:  CountSort (ch14, countSort.c) on p threads: each thread counts
+ *          the values in its chunk of the array, then writes its chunk of
+ *          the sorted array.  Its progress is the elements counted plus the
+ *          elements written, out of 2n.
+ *
+ * The threads publish their progress every PROGRESS_CHUNK elements.  To
+ * show that this costs nothing measurable, the sort is then run again
+ * without publishing, and both times are printed.
+ *
+ * To compile: gcc -O2 -o progress_kernels progress_kernels.c progress.c -lm -lpthread
+ *
+ * To run: ./progress_kernels <kernel> <n> [p]
+ *   kernel: prime or sort
+ *   n:      prime: the limit to find primes up to
+ *           sort: the length of the array
+ *   p:      sort: the number of threads (default 1)
+ *
+ *   ./progress_kernels sort 2000000000 8 &
+ *   kill -USR1 $!
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "progress.h"
+
+#define MAX 10                  //the maximum value of an element. (10 means 0-9)
+#define PROGRESS_CHUNK (1 << 16) //elements between progress updates
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+//helper function: computes wall clock time
+double getTime(struct timeval ts, struct timeval te){
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+/******** prime: from ch12/optExample.c ************/
+
+//helper function: checks to see if a number is prime
+int isPrime(int x) {
+    int i;
+    for (i = 2; i < sqrt(x)+1; i++) { //no prime number is less than 2
+        if (x % i == 0) { //if the number is divisible by i
+            return 0; //it is not prime
+        }
+    }
+    return 1; //otherwise it is prime
+}
+
+// finds the next prime
+int getNextPrime(int prev) {
+    int next = prev + 1;
+    while (!isPrime(next)) { //while the number is not prime
+        next++; //increment and check again
+    }
+    return next;
+}
+
+// generates a sequence of primes, publishing the number reached to pr
+int genPrimeSequence(int * array, int limit, struct progress *pr) {
+    int i;
+    int len = limit;
+    if (len == 0) return 0;
+    array[0]=2; //initialize the first number to 2
+    for (i = 1; i < len; i++) {
+        array[i] = getNextPrime(array[i-1]); //fill in the array
+        progress_set(pr, 0, array[i] < limit ? array[i] : limit);
+        if (array[i] > limit){
+            len = i;
+            return len;
+        }
+    }
+    return len;
+}
+
+/******** sort: from ch14/countSort.c ************/
+
+long counts[MAX];
+pthread_mutex_t mutex;
+pthread_barrier_t barrier;
+
+struct t_arg {
+    int *array; //pointer to shared array
+    long length; //num elements in array
+    long nthreads; //number of threads
+    long id; //logical thread id
+    struct progress *pr; //where to publish progress, or NULL
+};
+
+void *countSort(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long local_counts[MAX] = {0};
+    long chunk = myargs->length / myargs->nthreads;
+    long start = myargs->id * chunk;
+    long end = (myargs->id == myargs->nthreads - 1) ? myargs->length : start + chunk;
+    long i, j, stop, pos;
+    int val;
+    int *array = myargs->array;
+
+    //step 1: count the values in my chunk, a PROGRESS_CHUNK at a time
+    for (i = start; i < end; i = stop) {
+        stop = (end - i > PROGRESS_CHUNK) ? i + PROGRESS_CHUNK : end;
+        for (j = i; j < stop; j++) {
+            val = array[j];
+            local_counts[val] = local_counts[val] + 1;
+        }
+        if (myargs->pr) progress_set(myargs->pr, myargs->id, stop - start);
+    }
+    pthread_mutex_lock(&mutex);
+    for (val = 0; val < MAX; val++) {
+        counts[val] += local_counts[val];
+    }
+    pthread_mutex_unlock(&mutex);
+
+    //every thread's counts are needed before any chunk can be written
+    pthread_barrier_wait(&barrier);
+
+    //step 2: write my chunk of the sorted array.  Find the value that
+    //belongs at start, then write values in order from there.
+    val = 0;
+    pos = counts[0]; //where the first value after val starts
+    while (pos <= start && val < MAX - 1) {
+        val++;
+        pos += counts[val];
+    }
+    for (i = start; i < end; i = stop) {
+        stop = (end - i > PROGRESS_CHUNK) ? i + PROGRESS_CHUNK : end;
+        for (j = i; j < stop; j++) {
+            while (j >= pos) { //move on to the next value
+                val++;
+                pos += counts[val];
+            }
+            array[j] = val;
+        }
+        if (myargs->pr) progress_set(myargs->pr, myargs->id, (end - start) + (stop - start));
+    }
+    return NULL;
+}
+
+/* Sorts array on p threads; returns the time taken. */
+double run_sort(int *array, long n, long p, struct progress *pr) {
+    pthread_t *thread_array = malloc(p * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(p * sizeof(struct t_arg));
+    struct timeval tstart, tend;
+    long t;
+
+    if (!thread_array || !thread_args) print_error("ERROR: malloc failed");
+    memset(counts, 0, sizeof(counts));
+    pthread_mutex_init(&mutex, NULL);
+    pthread_barrier_init(&barrier, NULL, p);
+
+    gettimeofday(&tstart, NULL);
+    for (t = 0; t < p; t++) {
+        thread_args[t].array = array;
+        thread_args[t].length = n;
+        thread_args[t].nthreads = p;
+        thread_args[t].id = t;
+        thread_args[t].pr = pr;
+        if (pthread_create(&thread_array[t], NULL, countSort, &thread_args[t])) {
+            print_error("ERROR: pthread_create failed");
+        }
+    }
+    for (t = 0; t < p; t++) {
+        pthread_join(thread_array[t], NULL);
+    }
+    gettimeofday(&tend, NULL);
+
+    pthread_barrier_destroy(&barrier);
+    pthread_mutex_destroy(&mutex);
+    free(thread_array);
+    free(thread_args);
+    return getTime(tstart, tend);
+}
+
+/* fills array with values from 0 to MAX-1 (the same every time) */
+void genRandomArray(int *array, long length) {
+    long i;
+    srand(10);
+    for (i = 0; i < length; i++) {
+        array[i] = rand() % MAX;
+    }
+}
+
+/* returns 1 if array is sorted and holds the values genRandomArray made */
+int checkSorted(int *array, long length, long *expected) {
+    long found[MAX] = {0};
+    long i;
+    for (i = 0; i < length; i++) {
+        if (i > 0 && array[i] < array[i - 1]) return 0;
+        found[array[i]]++;
+    }
+    return memcmp(found, expected, sizeof(found)) == 0;
+}
+
+/* Until progress_start has blocked SIGUSR1, it would end the program, so
+ * the user is only told to send it after that. */
+void ready(void) {
+    printf("kill -USR1 %d to see progress\n", getpid());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    struct timeval tstart, tend;
+    struct progress pr;
+    long n, p = 1, i, expected[MAX] = {0};
+    int *array;
+    double t_progress, t_plain;
+
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s <kernel> <n> [p]\n", argv[0]);
+        fprintf(stderr, "where <kernel> is prime or sort\n");
+        fprintf(stderr, "and <n> is the prime limit or the array length\n");
+        fprintf(stderr, "and [p] is the number of threads for sort\n");
+        return 1;
+    }
+    n = strtol(argv[2], NULL, 10);
+    if (argc == 4) p = strtol(argv[3], NULL, 10);
+    if (n < 1) print_error("ERROR: n must be at least 1");
+    if (p < 1 || p > n) print_error("ERROR: p must be from 1 to n");
+
+    if (strcmp(argv[1], "prime") == 0) {
+        if (n > 2000000000) print_error("ERROR: n is too large");
+        array = malloc((n + 1) * sizeof(int));
+        if (!array) print_error("ERROR: malloc failed");
+        if (progress_start(&pr, "genPrimeSequence", n, 1) == -1) return 1;
+        ready();
+        gettimeofday(&tstart, NULL);
+        i = genPrimeSequence(array, n, &pr);
+        gettimeofday(&tend, NULL);
+        progress_report(&pr, stdout);
+        progress_stop(&pr);
+        printf("found %ld primes up to %ld in %g s\n", i, n, getTime(tstart, tend));
+
+    } else if (strcmp(argv[1], "sort") == 0) {
+        array = malloc(n * sizeof(int));
+        if (!array) print_error("ERROR: malloc failed");
+        genRandomArray(array, n);
+        for (i = 0; i < n; i++) expected[array[i]]++;
+
+        if (progress_start(&pr, "countSort", 2 * n, p) == -1) return 1;
+        ready();
+        t_progress = run_sort(array, n, p, &pr);
+        progress_report(&pr, stdout);
+        progress_stop(&pr);
+        if (!checkSorted(array, n, expected)) print_error("ERROR: array not sorted");
+
+        // the same again, without publishing progress
+        genRandomArray(array, n);
+        t_plain = run_sort(array, n, p, NULL);
+        if (!checkSorted(array, n, expected)) print_error("ERROR: array not sorted");
+        printf("sorted %ld elements on %ld threads: %g s with progress, %g s without\n",
+               n, p, t_progress, t_plain);
+
+    } else {
+        print_error("ERROR: kernel must be prime or sort");
+    }
+
+    free(array);
+    return 0;
+}
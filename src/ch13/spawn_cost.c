@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Measures the cost of creating a child process from a parent with a large
+ * resident set, with each of the ways Linux offers:
+ *
+ *   fork:           copies the parent's page tables, and marks every page
+ *                   copy-on-write in both processes.  The first write to a
+ *                   page, by either process, then takes a page fault.
+ *   fork+exec:      fork, then replace the child with /bin/true
+ *   vfork+exec:     the child borrows the parent's memory (the parent is
+ *                   suspended) until it calls exec or _exit, so nothing is
+ *                   copied
+ *   posix_spawn:    starts /bin/true; glibc implements it with a vfork-like
+ *                   clone, so it too avoids copying
+ *   clone(CLONE_VM): the child runs a function in the parent's memory, like
+ *                   a thread, so nothing is copied and writes do not fault
+ *
+ * For each, it prints the average time until the call returns in the
+ * parent and until the child has exited.  For fork and clone, the child
+ * then writes to a fraction of the parent's pages and counts the minor
+ * page faults this takes (with getrusage); after fork, the parent also
+ * counts its own faults when it writes the same pages again, since it too
+ * lost write access to them.  (A vfork child may not touch memory, and an
+ * exec'd child has none of the parent's, so those are not applicable.)
+ *
+ * Memory can be allocated in 4 KiB pages, or in 2 MiB huge pages, which
+ * need far fewer page table entries to copy.
+ *
+ * To compile: gcc -O2 -o spawn_cost spawn_cost.c
+ *
+ * To run: ./spawn_cost <rss_mib> <touch_pct> [huge]
+ *   rss_mib:   memory to allocate and touch in the parent, in MiB
+ *   touch_pct: percentage of its pages the child writes
+ *   huge:      use huge pages
+ *
+ *   ./spawn_cost 4096 10
+ *   ./spawn_cost 4096 10 huge
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <spawn.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define NITER 10             /* times each method is run (time is averaged) */
+#define PAGE 4096L
+#define HUGE_PAGE (2L << 20)
+#define STACK_SIZE (64 << 10) /* stack for the clone child */
+
+extern char **environ;
+
+enum { M_FORK, M_FORK_EXEC, M_VFORK_EXEC, M_SPAWN, M_CLONE, NMETHODS };
+static const char *method_names[NMETHODS] = {
+    "fork", "fork+exec", "vfork+exec", "posix_spawn", "clone(CLONE_VM)"
+};
+
+/* what a child measured, in memory shared with the parent */
+struct child_report {
+    long faults;     // minor faults taken writing the pages
+    double seconds;  // time taken writing the pages
+};
+
+char *memory;           // the parent's large resident set
+long npages;            // its size, in 4 KiB pages
+long touch_pages;       // pages the child writes
+struct child_report *report;
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: returns the current time in seconds */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+/* helper function: minor page faults taken by this process so far */
+long minor_faults(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/* Writes one byte in each of touch_pages pages, spread evenly over the
+ * memory, and returns the minor faults this took.  The time taken
+ * is stored in *seconds. */
+long write_pages(double *seconds) {
+    long i, stride = npages / (touch_pages > 0 ? touch_pages : 1);
+    long faults = minor_faults();
+    double start = now();
+    for (i = 0; i < touch_pages; i++) {
+        memory[i * stride * PAGE] += 1;
+    }
+    *seconds = now() - start;
+    return minor_faults() - faults;
+}
+
+/* the child's work for fork and clone: write pages, and report */
+int child_work(void *arg) {
+    (void)arg;
+    report->faults = write_pages(&report->seconds);
+    return 0;
+}
+
+/* Allocates and touches rss bytes, in huge pages if huge is set.  Returns
+ * a description of the page size actually used. */
+const char *alloc_memory(long rss, int huge) {
+    const char *kind = "4 KiB pages";
+    if (huge) {
+        rss = (rss + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        memory = mmap(NULL, rss, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        kind = "2 MiB pages (MAP_HUGETLB)";
+    }
+    if (!huge || memory == MAP_FAILED) {
+        memory = mmap(NULL, rss, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) print_error("ERROR: cannot allocate memory");
+        if (huge) {
+            madvise(memory, rss, MADV_HUGEPAGE);
+            kind = "transparent huge pages (madvise)";
+        } else {
+            madvise(memory, rss, MADV_NOHUGEPAGE);
+        }
+    }
+    memset(memory, 1, rss); // make every page resident
+    npages = rss / PAGE;
+    return kind;
+}
+
+/* Creates one child with method m and waits for it.  Sets *t_call to the
+ * time until the call returned in the parent and *t_total to the time
+ * until the child had exited. */
+void spawn_once(int m, char *clone_stack, double *t_call, double *t_total) {
+    char *argv[] = { "true", NULL };
+    double start;
+    int status;
+    pid_t pid = 0;
+
+    fflush(stdout); // so that children do not inherit unwritten output
+    start = now();
+    switch (m) {
+        case M_FORK:
+            pid = fork();
+            if (pid == 0) { /* the child process */
+                child_work(NULL);
+                _exit(0);
+            }
+            break;
+        case M_FORK_EXEC:
+            pid = fork();
+            if (pid == 0) {
+                execv("/bin/true", argv);
+                _exit(127);
+            }
+            break;
+        case M_VFORK_EXEC:
+            pid = vfork();
+            if (pid == 0) {
+                execv("/bin/true", argv);
+                _exit(127);
+            }
+            break;
+        case M_SPAWN:
+            if (posix_spawn(&pid, "/bin/true", NULL, NULL, argv, environ) != 0) {
+                pid = -1;
+            }
+            break;
+        case M_CLONE:
+            // the stack grows down, so pass the end of the stack memory
+            pid = clone(child_work, clone_stack + STACK_SIZE, CLONE_VM | SIGCHLD, NULL);
+            break;
+    }
+    *t_call = now() - start;
+    if (pid == -1) print_error("ERROR: creating a process failed");
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        print_error("ERROR: child failed");
+    }
+    *t_total = now() - start;
+}
+
+int main(int argc, char **argv) {
+    long rss_mib, touch_pct, parent_faults;
+    int m, iter, huge;
+    double t_call, t_total, sum_call, sum_total, sum_write, parent_secs;
+    long sum_faults, sum_parent;
+    const char *kind;
+
+    if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3], "huge") != 0)) {
+        fprintf(stderr, "usage: %s <rss_mib> <touch_pct> [huge]\n", argv[0]);
+        fprintf(stderr, "where <rss_mib> is the parent's resident set in MiB\n");
+        fprintf(stderr, "and <touch_pct> is the percentage of pages the child writes\n");
+        fprintf(stderr, "and huge uses 2 MiB pages\n");
+        return 1;
+    }
+    rss_mib = strtol(argv[1], NULL, 10);
+    touch_pct = strtol(argv[2], NULL, 10);
+    huge = argc == 4;
+    if (rss_mib < 1) print_error("ERROR: rss_mib must be at least 1");
+    if (touch_pct < 0 || touch_pct > 100) print_error("ERROR: touch_pct must be 0 to 100");
+
+    kind = alloc_memory(rss_mib << 20, huge);
+    touch_pages = npages * touch_pct / 100;
+
+    report = mmap(NULL, sizeof(*report), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    char *clone_stack = malloc(STACK_SIZE);
+    if (report == MAP_FAILED || clone_stack == NULL) print_error("ERROR: cannot allocate");
+
+    printf("parent resident set: %ld MiB in %s; child writes %ld of %ld pages\n",
+           rss_mib, kind, touch_pages, npages);
+    printf("%-16s %12s %15s %14s %16s %14s\n", "method", "call (us)",
+           "until exit (us)", "child faults", "child write (ms)", "parent faults");
+
+    for (m = 0; m < NMETHODS; m++) {
+        sum_call = sum_total = sum_write = 0;
+        sum_faults = sum_parent = 0;
+        for (iter = 0; iter < NITER; iter++) {
+            report->faults = 0;
+            report->seconds = 0;
+            spawn_once(m, clone_stack, &t_call, &t_total);
+            sum_call += t_call;
+            sum_total += t_total;
+            sum_faults += report->faults;
+            sum_write += report->seconds;
+
+            // after fork, the parent's pages are still write-protected, even
+            // though the child has exited
+            parent_faults = write_pages(&parent_secs);
+            sum_parent += parent_faults;
+        }
+
+        printf("%-16s %12.1f %15.1f ", method_names[m], sum_call / NITER * 1e6,
+               sum_total / NITER * 1e6);
+        if (m == M_FORK || m == M_CLONE) {
+            printf("%14ld %16.3f", sum_faults / NITER, sum_write / NITER * 1e3);
+        } else {
+            printf("%14s %16s", "n/a", "n/a");
+        }
+        printf(" %14ld\n", sum_parent / NITER);
+    }
+
+    free(clone_stack);
+    return 0;
+}
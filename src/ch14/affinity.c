@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the affinity library (see affinity.h).
+ *
+ * Compile it together with a program that uses it, with AFFINITY defined,
+ * for example:
+ *   gcc -DAFFINITY -o hellothreads hellothreads.c affinity.c -pthread
+ */
+#define _GNU_SOURCE
+#ifndef AFFINITY
+#define AFFINITY 1
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "affinity.h"
+
+#ifndef SYS_CPU
+#define SYS_CPU "/sys/devices/system/cpu" /* (another directory can be given, to test) */
+#endif
+
+/* reads a non-negative integer from the file path; returns -1 if it can't */
+static int read_int(const char *path) {
+    FILE *f = fopen(path, "r");
+    int value = -1;
+    if (f == NULL) return -1;
+    if (fscanf(f, "%d", &value) != 1) value = -1;
+    fclose(f);
+    return value;
+}
+
+/* Returns the lowest CPU sharing cpu's last-level cache (the cache index
+ * with the highest level), or -1 if the caches are not described. */
+static int llc_leader(int cpu) {
+    char path[256];
+    int index, level, best = 0, leader = -1, first;
+    FILE *f;
+
+    for (index = 0; ; index++) {
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        level = read_int(path);
+        if (level == -1) break;
+        if (level < best) continue;
+        // a list such as "0-3,8-11": the first number is the lowest CPU
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list",
+                 cpu, index);
+        f = fopen(path, "r");
+        if (f == NULL) continue;
+        if (fscanf(f, "%d", &first) == 1) {
+            best = level;
+            leader = first;
+        }
+        fclose(f);
+    }
+    return leader;
+}
+
+/* returns the NUMA node cpu belongs to (its directory has a nodeN link) */
+static int cpu_node(int cpu) {
+    char path[256];
+    struct dirent *entry;
+    DIR *dir;
+    int node = 0;
+
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d", cpu);
+    dir = opendir(path);
+    if (dir == NULL) return 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+    }
+    closedir(dir);
+    return node;
+}
+
+/* a CPU and its sort key, for ordering CPUs under a policy */
+struct keyed_cpu {
+    long key;
+    int cpu;
+};
+
+static int cmp_keyed(const void *a, const void *b) {
+    const struct keyed_cpu *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return x->cpu - y->cpu;
+}
+
+/* a sort key made of four fields, most significant first (each < 4096) */
+static long make_key(long a, long b, long c, long d) {
+    return (a << 36) | (b << 24) | (c << 12) | d;
+}
+
+/* Fills in topo's three orders of CPUs. */
+static int order_cpus(struct cpu_topology *topo) {
+    struct keyed_cpu *keyed = malloc(topo->ncpus * sizeof(struct keyed_cpu));
+    int *core_llc = malloc(topo->ncores * sizeof(int));
+    int *llc_node = malloc(topo->nllcs * sizeof(int));
+    struct cpu_info *ci;
+    int i, c, l, n, core_rank, llc_rank;
+
+    if (!keyed || !core_llc || !llc_node) {
+        free(keyed);
+        free(core_llc);
+        free(llc_node);
+        return -1;
+    }
+    for (i = 0; i < topo->ncpus; i++) {
+        core_llc[topo->cpus[i].core] = topo->cpus[i].llc;
+        llc_node[topo->cpus[i].llc] = topo->cpus[i].node;
+    }
+
+    // compact: CPUs close together in the machine are close in the order
+    for (i = 0; i < topo->ncpus; i++) {
+        ci = &topo->cpus[i];
+        keyed[i].cpu = i; // (an index into cpus, for now)
+        keyed[i].key = make_key(ci->node, ci->llc, ci->core, ci->smt);
+    }
+    qsort(keyed, topo->ncpus, sizeof(*keyed), cmp_keyed);
+
+    // cores: the same order, with only the first hardware thread of each core
+    for (i = 0, n = 0; i < topo->ncpus; i++) {
+        ci = &topo->cpus[keyed[i].cpu];
+        topo->compact[i] = ci->cpu;
+        if (ci->smt == 0) topo->cores[n++] = ci->cpu;
+    }
+
+    // scatter: the first core of the first cache of each node in turn, then
+    // the first core of each node's second cache, ..., then each cache's
+    // second core, ...; and all of that again for second hardware threads
+    for (i = 0; i < topo->ncpus; i++) {
+        ci = &topo->cpus[i];
+        core_rank = llc_rank = 0;
+        for (c = 0; c < ci->core; c++) {
+            if (core_llc[c] == ci->llc) core_rank++;
+        }
+        for (l = 0; l < ci->llc; l++) {
+            if (llc_node[l] == ci->node) llc_rank++;
+        }
+        keyed[i].cpu = ci->cpu;
+        keyed[i].key = make_key(ci->smt, core_rank, llc_rank, ci->node);
+    }
+    qsort(keyed, topo->ncpus, sizeof(*keyed), cmp_keyed);
+    for (i = 0; i < topo->ncpus; i++) topo->scatter[i] = keyed[i].cpu;
+
+    free(keyed);
+    free(core_llc);
+    free(llc_node);
+    return 0;
+}
+
+int topo_discover(struct cpu_topology *topo) {
+    char path[256];
+    cpu_set_t allowed;
+    struct cpu_info *ci, *cj;
+    int cpu, i, j, *core_id, *llc_key;
+
+    memset(topo, 0, sizeof(*topo));
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("topo_discover: sched_getaffinity");
+        return -1;
+    }
+    topo->ncpus = CPU_COUNT(&allowed);
+    topo->cpus = calloc(topo->ncpus, sizeof(struct cpu_info));
+    topo->compact = malloc(topo->ncpus * sizeof(int));
+    topo->scatter = malloc(topo->ncpus * sizeof(int));
+    topo->cores = malloc(topo->ncpus * sizeof(int));
+    core_id = malloc(topo->ncpus * sizeof(int));
+    llc_key = malloc(topo->ncpus * sizeof(int));
+    if (!topo->cpus || !topo->compact || !topo->scatter || !topo->cores
+        || !core_id || !llc_key) {
+        fprintf(stderr, "topo_discover: out of memory\n");
+        goto fail;
+    }
+
+    // read where each CPU is.  Missing files (as in some virtual machines
+    // and containers) make each CPU a core and cache of its own.
+    for (cpu = 0, i = 0; i < topo->ncpus; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        ci = &topo->cpus[i];
+        ci->cpu = cpu;
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        ci->package = read_int(path);
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", cpu);
+        core_id[i] = read_int(path); // only unique within its package
+        if (ci->package == -1 || core_id[i] == -1) {
+            ci->package = 0;
+            core_id[i] = -1 - cpu;
+        }
+        llc_key[i] = llc_leader(cpu);
+        if (llc_key[i] == -1) llc_key[i] = cpu;
+        ci->node = cpu_node(cpu);
+        i++;
+    }
+
+    // number the cores and caches 0, 1, ... in order of their first CPU.
+    // A CPU's SMT index is the number of lower CPUs on the same core.
+    for (i = 0; i < topo->ncpus; i++) {
+        ci = &topo->cpus[i];
+        ci->core = ci->llc = -1;
+        for (j = 0; j < i; j++) {
+            cj = &topo->cpus[j];
+            if (cj->package == ci->package && core_id[j] == core_id[i]) {
+                ci->core = cj->core;
+                ci->smt++;
+            }
+            if (llc_key[j] == llc_key[i]) ci->llc = cj->llc;
+        }
+        if (ci->core == -1) ci->core = topo->ncores++;
+        if (ci->llc == -1) ci->llc = topo->nllcs++;
+        for (j = 0; j < i && topo->cpus[j].node != ci->node; j++);
+        if (j == i) topo->nnodes++;
+    }
+
+    if (order_cpus(topo) == -1) {
+        fprintf(stderr, "topo_discover: out of memory\n");
+        goto fail;
+    }
+    free(core_id);
+    free(llc_key);
+    return 0;
+
+fail:
+    free(core_id);
+    free(llc_key);
+    topo_free(topo);
+    return -1;
+}
+
+void topo_free(struct cpu_topology *topo) {
+    free(topo->cpus);
+    free(topo->compact);
+    free(topo->scatter);
+    free(topo->cores);
+    memset(topo, 0, sizeof(*topo));
+}
+
+void topo_print(const struct cpu_topology *topo, FILE *out) {
+    const struct cpu_info *ci;
+    int i;
+
+    fprintf(out, "%d CPUs, %d cores, %d last-level caches, %d NUMA nodes\n",
+            topo->ncpus, topo->ncores, topo->nllcs, topo->nnodes);
+    fprintf(out, "%5s %8s %6s %5s %5s %6s\n", "cpu", "package", "core", "smt",
+            "llc", "node");
+    for (i = 0; i < topo->ncpus; i++) {
+        ci = &topo->cpus[i];
+        fprintf(out, "%5d %8d %6d %5d %5d %6d\n", ci->cpu, ci->package, ci->core,
+                ci->smt, ci->llc, ci->node);
+    }
+}
+
+static const char *policy_names[] = { "none", "compact", "scatter", "cores" };
+
+int aff_parse(const char *name) {
+    int p;
+    for (p = AFF_NONE; p <= AFF_CORES; p++) {
+        if (strcmp(name, policy_names[p]) == 0) return p;
+    }
+    return -1;
+}
+
+int aff_cpu(const struct cpu_topology *topo, int policy, long i) {
+    switch (policy) {
+        case AFF_COMPACT: return topo->compact[i % topo->ncpus];
+        case AFF_SCATTER: return topo->scatter[i % topo->ncpus];
+        case AFF_CORES:   return topo->cores[i % topo->ncores];
+    }
+    return -1;
+}
+
+int aff_attr_init(pthread_attr_t *attr, const struct cpu_topology *topo,
+                  int policy, long i) {
+    cpu_set_t set;
+    int cpu, ret;
+
+    ret = pthread_attr_init(attr);
+    if (ret != 0) {
+        fprintf(stderr, "aff_attr_init: pthread_attr_init: %s\n", strerror(ret));
+        return -1;
+    }
+    if (policy == AFF_NONE) return 0;
+    cpu = aff_cpu(topo, policy, i);
+    if (cpu == -1) {
+        fprintf(stderr, "aff_attr_init: unknown policy %d\n", policy);
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    ret = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    if (ret != 0) {
+        fprintf(stderr, "aff_attr_init: pthread_attr_setaffinity_np: %s\n",
+                strerror(ret));
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+    return 0;
+}
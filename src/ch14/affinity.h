@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * affinity: finds out how the CPUs of this machine are organized, and
+ * places threads on them.
+ *
+ * Left alone, the operating system's scheduler decides which CPU each
+ * thread runs on, and may move a thread to another CPU in the middle of a
+ * run, leaving its data in the old CPU's caches.  Pinning each thread to
+ * one CPU (setting its affinity) stops this, and lets the program choose
+ * which threads share hardware:
+ *
+ *   compact: fill CPUs in order, so consecutive threads share a core (the
+ *            hyperthreads, or SMT siblings, of one core), then a last-level
+ *            cache, then a NUMA node.  Good for threads that share data.
+ *   scatter: spread consecutive threads as far apart as possible: across
+ *            NUMA nodes, then last-level caches, then cores, using a
+ *            second hyperthread of a core only once every core has one.
+ *            Good for threads that each need memory bandwidth and cache.
+ *   cores:   one thread per physical core, never two on the same core.
+ *
+ * If there are more threads than CPUs (or, for cores, than cores), the
+ * placement wraps around.  Only the CPUs this process may run on (see
+ * taskset) are used.
+ *
+ * The topology (which CPUs share a core, a last-level cache and a NUMA
+ * node) is read from /sys/devices/system/cpu.
+ *
+ * The placement functions are only compiled in when AFFINITY is defined,
+ * so that the examples that include this header still build on their own:
+ *
+ *   gcc -o countElems_p countElems_p.c -pthread
+ *   gcc -DAFFINITY -o countElems_p countElems_p.c affinity.c -pthread
+ *
+ * Without AFFINITY, the only policy is none, and the functions below do
+ * nothing.
+ */
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* placement policies */
+enum aff_policy {
+    AFF_NONE,     /* leave placement to the scheduler */
+    AFF_COMPACT,
+    AFF_SCATTER,
+    AFF_CORES
+};
+
+/* where one CPU is */
+struct cpu_info {
+    int cpu;      /* the CPU's number */
+    int package;  /* physical package (socket) */
+    int core;     /* physical core, numbered 0.. across all packages */
+    int smt;      /* which of its core's hardware threads it is: 0, 1, ... */
+    int llc;      /* last-level cache domain, numbered 0.. */
+    int node;     /* NUMA node */
+};
+
+/* the CPUs this process may use, and the order each policy uses them in */
+struct cpu_topology {
+    int ncpus, ncores, nllcs, nnodes;
+    struct cpu_info *cpus;  /* ncpus entries, by CPU number */
+    int *compact;           /* ncpus CPU numbers */
+    int *scatter;           /* ncpus CPU numbers */
+    int *cores;             /* ncores CPU numbers */
+};
+
+#ifdef AFFINITY
+
+/*
+ * Reads the topology of the CPUs this process may run on into topo.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int topo_discover(struct cpu_topology *topo);
+
+/*
+ * Frees the memory topo_discover allocated.
+ */
+extern void topo_free(struct cpu_topology *topo);
+
+/*
+ * Prints a table of the CPUs in topo, and how many there are of each kind
+ * of domain.
+ */
+extern void topo_print(const struct cpu_topology *topo, FILE *out);
+
+/*
+ * Returns the policy named name ("none", "compact", "scatter" or "cores"),
+ * or -1 if there is no such policy.
+ */
+extern int aff_parse(const char *name);
+
+/*
+ * Returns the CPU that thread number i (0, 1, ...) is placed on under
+ * policy, or -1 for AFF_NONE.
+ */
+extern int aff_cpu(const struct cpu_topology *topo, int policy, long i);
+
+/*
+ * Initializes attr, with pthread_attr_init, and sets its affinity to the
+ * CPU of thread number i of the program under policy, so a thread created
+ * with attr starts on its CPU and is never moved.  For AFF_NONE, attr is
+ * only initialized (topo is then not used, and need not have been
+ * discovered).  The caller destroys attr once the thread is created.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int aff_attr_init(pthread_attr_t *attr, const struct cpu_topology *topo,
+                         int policy, long i);
+
+#else /* !AFFINITY: no placement, and nothing to link with */
+
+#include <string.h>
+
+static inline int topo_discover(struct cpu_topology *topo) {
+    memset(topo, 0, sizeof(*topo));
+    fprintf(stderr, "topo_discover: compile with -DAFFINITY and affinity.c\n");
+    return -1;
+}
+
+static inline void topo_free(struct cpu_topology *topo) {
+    (void)topo;
+}
+
+static inline void topo_print(const struct cpu_topology *topo, FILE *out) {
+    (void)topo;
+    (void)out;
+}
+
+static inline int aff_parse(const char *name) {
+    if (strcmp(name, "none") == 0) return AFF_NONE;
+    fprintf(stderr, "aff_parse: policy %s needs -DAFFINITY and affinity.c\n", name);
+    return -1;
+}
+
+static inline int aff_cpu(const struct cpu_topology *topo, int policy, long i) {
+    (void)topo;
+    (void)policy;
+    (void)i;
+    return -1;
+}
+
+static inline int aff_attr_init(pthread_attr_t *attr, const struct cpu_topology *topo,
+                                int policy, long i) {
+    (void)topo;
+    (void)policy;
+    (void)i;
+    return pthread_attr_init(attr) == 0 ? 0 : -1;
+}
+
+#endif /* AFFINITY */
+
+#endif
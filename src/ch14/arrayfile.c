@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the arrayfile library (see arrayfile.h).
+ *
+ * Compile it together with a program that uses it, for example:
+ *   gcc -O2 -o countSort_file countSort_file.c arrayfile.c
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arrayfile.h"
+
+size_t af_type_size(int type) {
+    switch (type) {
+        case AF_INT8:   return 1;
+        case AF_INT16:  return 2;
+        case AF_INT32:  return 4;
+        case AF_INT64:  return 8;
+        case AF_FLOAT:  return sizeof(float);
+        case AF_DOUBLE: return sizeof(double);
+    }
+    return 0;
+}
+
+/* computes the number of elements of an array of shape (ndims, dims) of
+ * elem_size-byte elements into *count.  returns 0 on success, -1 if the
+ * shape is not valid or the array would be too large to map */
+static int shape_count(int ndims, const uint64_t *dims, size_t elem_size,
+                       uint64_t *count) {
+    int i;
+
+    if (ndims < 1 || ndims > AF_MAX_DIMS || elem_size == 0) {
+        return -1;
+    }
+    *count = 1;
+    for (i = 0; i < ndims; i++) {
+        if (dims[i] != 0 && *count > UINT64_MAX / dims[i]) {
+            return -1;
+        }
+        *count *= dims[i];
+    }
+    //the header and data must fit in a size_t, the length of a mapping
+    if (*count > (SIZE_MAX - AF_ALIGN) / elem_size) {
+        return -1;
+    }
+    return 0;
+}
+
+/* fills in a header for an array of type type and shape (ndims, dims).
+ * returns 0 on success, -1 if the type or shape is not valid */
+static int fill_header(struct arrayfile_header *h, int type, int ndims,
+                       const uint64_t *dims) {
+    int i;
+
+    memset(h, 0, sizeof(*h));
+    if (shape_count(ndims, dims, af_type_size(type), &h->count) == -1) {
+        return -1;
+    }
+    memcpy(h->magic, AF_MAGIC, sizeof(h->magic));
+    h->version = AF_VERSION;
+    h->elem_type = type;
+    h->elem_size = af_type_size(type);
+    h->ndims = ndims;
+    for (i = 0; i < ndims; i++) {
+        h->dims[i] = dims[i];
+    }
+    return 0;
+}
+
+const char *af_check_header(const struct arrayfile_header *h,
+                            uint64_t file_size) {
+    uint64_t count;
+    int i;
+
+    if (memcmp(h->magic, AF_MAGIC, sizeof(h->magic)) != 0
+        || h->version != AF_VERSION) {
+        return "not an array file";
+    }
+    if (af_type_size(h->elem_type) == 0
+        || h->elem_size != af_type_size(h->elem_type)) {
+        return "bad element type";
+    }
+    if (h->ndims < 1 || h->ndims > AF_MAX_DIMS) {
+        return "bad number of dimensions";
+    }
+    for (i = h->ndims; i < AF_MAX_DIMS; i++) {
+        if (h->dims[i] != 0) {
+            return "bad shape (unused dimension is not 0)";
+        }
+    }
+    if (shape_count(h->ndims, h->dims, h->elem_size, &count) == -1) {
+        return "array is too large";
+    }
+    if (h->count != count) {
+        return "element count does not match the shape";
+    }
+    if (file_size < AF_ALIGN + count * h->elem_size) {
+        return "file is truncated";
+    }
+    return NULL;
+}
+
+int af_open(const char *path, int writable, struct arrayfile *af) {
+    struct arrayfile_header h;
+    struct stat st;
+    const char *problem;
+    int fd, prot, flags;
+    void *map;
+
+    fd = open(path, writable == 2 ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "af_open: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    //check the header before mapping anything
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        fprintf(stderr, "af_open: %s: not an array file\n", path);
+        close(fd);
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "af_open: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((problem = af_check_header(&h, st.st_size)) != NULL) {
+        fprintf(stderr, "af_open: %s: %s\n", path, problem);
+        close(fd);
+        return -1;
+    }
+
+    prot = PROT_READ;
+    flags = MAP_PRIVATE;
+    if (writable) {
+        prot |= PROT_WRITE;
+    }
+    if (writable == 2) {
+        flags = MAP_SHARED;
+    }
+
+    map = mmap(NULL, st.st_size, prot, flags, fd, 0);
+    close(fd);  //the mapping stays valid after the file is closed
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "af_open: %s: mmap: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    //the kernels read the data front to back
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    af->header = map;
+    af->data = (char *)map + AF_ALIGN;
+    af->map_len = st.st_size;
+    return 0;
+}
+
+int af_create(const char *path, int type, int ndims, const uint64_t *dims,
+              struct arrayfile *af) {
+    struct arrayfile_header h;
+    size_t len;
+    int fd;
+    void *map;
+
+    if (fill_header(&h, type, ndims, dims) == -1) {
+        fprintf(stderr, "af_create: %s: bad type or shape\n", path);
+        return -1;
+    }
+    len = AF_ALIGN + h.count * h.elem_size;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "af_create: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, len) == -1) {
+        fprintf(stderr, "af_create: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "af_create: %s: mmap: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memcpy(map, &h, sizeof(h));
+    af->header = map;
+    af->data = (char *)map + AF_ALIGN;
+    af->map_len = len;
+    return 0;
+}
+
+void af_close(struct arrayfile *af) {
+    munmap(af->header, af->map_len);
+    af->header = NULL;
+    af->data = NULL;
+    af->map_len = 0;
+}
+
+int af_write(const char *path, int type, int ndims, const uint64_t *dims,
+             const void *data) {
+    struct arrayfile_header h;
+    size_t left;
+    off_t off;
+    ssize_t ret;
+    const char *p = data;
+    int fd;
+
+    if (fill_header(&h, type, ndims, dims) == -1) {
+        fprintf(stderr, "af_write: %s: bad type or shape\n", path);
+        return -1;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "af_write: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    //the gap between the header and AF_ALIGN is left as a hole (zeros)
+    if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        goto fail;
+    }
+    left = h.count * h.elem_size;
+    off = AF_ALIGN;
+    while (left > 0) {
+        ret = pwrite(fd, p, left, off);
+        if (ret <= 0) {
+            goto fail;
+        }
+        p += ret;
+        off += ret;
+        left -= ret;
+    }
+    //make sure the file is full length even if there is no data
+    if (ftruncate(fd, AF_ALIGN + h.count * h.elem_size) == -1) {
+        goto fail;
+    }
+
+    close(fd);
+    return 0;
+
+fail:
+    fprintf(stderr, "af_write: %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+}
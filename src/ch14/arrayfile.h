@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * arrayfile: a simple binary file format for the arrays and matrices used
+ * as inputs and outputs of the example kernels.
+ *
+ * File layout:
+ *
+ *   offset 0:           struct arrayfile_header (padded with zeros)
+ *   offset data_offset: count elements of elem_size bytes each, stored
+ *                       contiguously in native byte order (row-major for
+ *                       matrices)
+ *
+ * data_offset is always a multiple of the page size (AF_ALIGN), so a file
+ * can be mmap'ed and its data used directly as an array, without reading
+ * or parsing it first.
+ */
+#ifndef _ARRAYFILE_H_
+#define _ARRAYFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AF_MAGIC     "DISARRAY"  /* first 8 bytes of every array file */
+#define AF_VERSION   1
+#define AF_ALIGN     4096        /* alignment of the data section */
+#define AF_MAX_DIMS  4
+
+/* element types that can be stored in an array file */
+enum af_type {
+    AF_INT8 = 1,
+    AF_INT16,
+    AF_INT32,
+    AF_INT64,
+    AF_FLOAT,
+    AF_DOUBLE
+};
+
+/* the header at the start of every array file (64 bytes on disk) */
+struct arrayfile_header {
+    char magic[8];         // AF_MAGIC, not null terminated
+    uint32_t version;      // AF_VERSION
+    uint32_t elem_type;    // one of enum af_type
+    uint32_t elem_size;    // bytes per element
+    uint32_t ndims;        // number of dimensions (1 for an array)
+    uint64_t count;        // total number of elements (product of dims)
+    uint64_t dims[AF_MAX_DIMS]; // size of each dimension, unused ones are 0
+};
+
+/* an array file that has been mapped into memory */
+struct arrayfile {
+    struct arrayfile_header *header; // points at the start of the mapping
+    void *data;            // the elements, ready to be used as an array
+    size_t map_len;        // length of the mapping (for af_close)
+};
+
+/*
+ * Returns the size in bytes of one element of type type, or 0 if type
+ * is not a valid af_type.
+ */
+extern size_t af_type_size(int type);
+
+/*
+ * Maps an existing array file into memory.  The data is not copied: pages
+ * are read from the file the first time they are touched.  The header is
+ * checked first: its type, shape and element count must agree, and the
+ * file must be long enough to hold all of the elements.
+ *  path:     the file to open
+ *  writable: if 0, the mapping is read-only; if 1, the program may modify
+ *            the data in memory without changing the file (copy-on-write);
+ *            if 2, changes to the data are written back to the file
+ *  af:       filled in with the mapping
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int af_open(const char *path, int writable, struct arrayfile *af);
+
+/*
+ * Checks a header read from an array file of file_size bytes, as af_open
+ * does: its type, shape and element count must agree, and the file must be
+ * long enough to hold all of the elements.  For programs that read array
+ * files some other way (with MPI-IO, for example).
+ *  returns NULL if it is valid, or else a message saying what is wrong
+ */
+extern const char *af_check_header(const struct arrayfile_header *h,
+                                   uint64_t file_size);
+
+/*
+ * Creates (or truncates) an array file of the given type and shape and
+ * maps it for writing.  A kernel can write its results directly into
+ * af->data; they reach the file when af_close is called.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int af_create(const char *path, int type, int ndims,
+                     const uint64_t *dims, struct arrayfile *af);
+
+/*
+ * Unmaps an array file opened with af_open or af_create.
+ */
+extern void af_close(struct arrayfile *af);
+
+/*
+ * Writes the elements of an array of type type and shape (ndims, dims)
+ * from data to a new array file at path.
+ *  returns 0 on success, -1 on error (with a message printed to stderr)
+ */
+extern int af_write(const char *path, int type, int ndims,
+                    const uint64_t *dims, const void *data);
+
+#endif
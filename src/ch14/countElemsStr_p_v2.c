@@ -4,6 +4,9 @@
 #include <sys/time.h>
 #include <string.h>
 #include <pthread.h>
+/* thread placement (see affinity.h).  For the placement policies, compile with
+ *   gcc -DAFFINITY -o countElemsStr_p_v2 countElemsStr_p_v2.c affinity.c -pthread */
+#include "affinity.h"
 
 #define MAX 10 //the maximum value of an element. (10 means 0-9)
 pthread_mutex_t mutex; //declare mutex
@@ -103,12 +106,13 @@ void *countElemsStr(void *args) {
 */
 int main(int argc, char **argv) {
 
-    if (argc != 4) { //checks to ensure we have the correct number of args
-        fprintf(stderr, "usage: %s <n> <p?> <t>\n", argv[0]);
+    if (argc != 4 && argc != 5) { //checks to ensure we have the correct number of args
+        fprintf(stderr, "usage: %s <n> <p?> <t> [policy]\n", argv[0]);
         fprintf(stderr, "where <n> is the number of digits in the string and\n");
         fprintf(stderr, "<p?> is a binary value (0/1) indicating if counts");
         fprintf(stderr, " should be printed and\n");
         fprintf(stderr, "<t> is the number of threads\n");
+        fprintf(stderr, "and [policy] places the threads: none, compact, scatter or cores\n");
         return 1;
     }
 
@@ -117,6 +121,16 @@ int main(int argc, char **argv) {
 
     long length = strtol(argv[1], NULL, 10);
     if (length < nthreads) print_error("ERROR: length must be greater than number of threads");
+
+    //optional thread placement policy (see affinity.h)
+    struct cpu_topology topo = {0};
+    int policy = AFF_NONE;
+    pthread_attr_t attr; //each thread's placement
+    if (argc == 5) {
+        policy = aff_parse(argv[4]);
+        if (policy == -1) print_error("ERROR: unknown placement policy");
+        if (policy != AFF_NONE && topo_discover(&topo)) return 1;
+    }
     int verbose = atoi(argv[2]);
     int ret; //used for error checking
     srand(10); //seed random number generator with static seed
@@ -150,7 +164,9 @@ int main(int argc, char **argv) {
     }
 
     for (t = 0; t < nthreads; t++) {
-        ret = pthread_create( &thread_array[t], NULL, countElemsStr, &thread_args[t] );
+        if (aff_attr_init(&attr, &topo, policy, t)) return 1;
+        ret = pthread_create( &thread_array[t], &attr, countElemsStr, &thread_args[t] );
+        pthread_attr_destroy(&attr);
         if (ret) print_error("ERROR: pthread_create failed");
     }
     for (t = 0; t < nthreads; t++) {
@@ -169,5 +185,6 @@ int main(int argc, char **argv) {
     //free(thread_args);
     //free(inputString);
 
+    topo_free(&topo);
     return 0;
 }
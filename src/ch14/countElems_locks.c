@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Runs the parallel countElems (step 1 of CountSort) with each of the lock
+ * implementations in locks.h, instead of only pthread_mutex_t, at 1, 2, 4,
+ * ... threads, including more threads than there are CPUs.  Three ways of
+ * using the lock are compared:
+ *
+ *   merge:   each thread counts into local counts, then adds them to the
+ *            shared counts while holding the lock (countElems_p_v3.c): one
+ *            short critical section per thread
+ *   loop:    each thread holds the lock for its whole loop
+ *            (countElems_p_v2.c): the threads run one at a time
+ *   element: each thread takes the lock for every element it counts: the
+ *            lock is passed between threads as often as it can be, so its
+ *            own cost dominates
+ *
+ * For each, it prints the time and the throughput in elements counted per
+ * second.  For element, it also prints the lock's fairness: each thread
+ * counts how many times it has acquired the lock, and when the first thread
+ * finishes, each count is divided by that thread's chunk length, and the
+ * fairness is Jain's index of those fractions (1 if every thread got the
+ * lock equally often; 1/t if one thread got it every time while the others
+ * waited).  merge and loop take the lock once per thread, so there is no
+ * window in which to compare the threads, and their fairness is shown as -.
+ *
+ * To compile: gcc -O2 -o countElems_locks countElems_locks.c locks.c -pthread
+ *
+ * To run: ./countElems_locks <n> <max_threads> [lock]
+ *   n:           the length of the array
+ *   max_threads: the most threads to run
+ *   lock:        mutex, ttas, ticket or mcs (default: all of them)
+ *
+ *   ./countElems_locks 10000000 16 mcs
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "locks.h"
+
+#define MAX 10              //the maximum value of an element. (10 means 0-9)
+
+/* the ways of using the lock */
+enum { K_MERGE, K_LOOP, K_ELEMENT, NKERNELS };
+static const char *kernel_names[NKERNELS] = { "merge", "loop", "element" };
+
+/* one thread's lock acquisitions so far, and the length of its chunk,
+ * alone in a cache line */
+struct progress {
+    long acquired;
+    long length;
+} __attribute__((aligned(LOCK_LINE)));
+
+struct t_arg {
+    long id; //thread id
+    long numthreads; //number of threads
+    int *ap; //pointer to array to be counted
+    long length; //length of array
+    long *countp; //pointer to shared counts array
+    int kernel; //K_MERGE, K_LOOP or K_ELEMENT
+};
+
+struct lock lock;              //the lock protecting the shared counts
+struct progress *progress;     //each thread's lock acquisitions
+double *fraction_at_first;     //each thread's acquisitions per element of its
+                               //chunk, when the first thread finished
+int first_done;                //set by the first thread to finish
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: computes wall clock time */
+double getTime(struct timeval ts, struct timeval te) {
+    double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+    return time;
+}
+
+/* helper function: genRandomArray
+ * fills an input array of specified length (length) with random
+ * values from 0 to MAX-1
+ */
+void genRandomArray(int *array, long length) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = rand() % MAX;
+    }
+}
+
+/* Called by each thread when it finishes: the first one records how often
+ * every thread had acquired the lock, for each element of its chunk. */
+void finished(long nthreads) {
+    long t;
+    if (__atomic_exchange_n(&first_done, 1, __ATOMIC_ACQ_REL)) return;
+    for (t = 0; t < nthreads; t++) {
+        fraction_at_first[t] = (double)__atomic_load_n(&progress[t].acquired,
+                                                       __ATOMIC_RELAXED)
+                               / progress[t].length;
+    }
+}
+
+void *countElems(void *args) {
+    //extract arguments
+    struct t_arg *myargs = (struct t_arg *)args;
+    long myid = myargs->id;
+    long nthreads = myargs->numthreads;
+    long length = myargs->length;
+    int *array = myargs->ap;
+    long *counts = myargs->countp;
+    struct lock_node me;
+
+    //local declaration of counts array (initialize all elements to zero)
+    long local_counts[MAX] = {0};
+
+    //assign work to the thread
+    long chunk = length / nthreads; //nominal chunk size
+    long start = myid * chunk;
+    long end = (myid + 1) * chunk;
+    long val, i;
+    if (myid == nthreads - 1) {
+        end = length;
+    }
+
+    if (myargs->kernel == K_MERGE) {
+        for (i = start; i < end; i++) {
+            val = array[i];
+            local_counts[val] = local_counts[val] + 1;
+        }
+        lock_acquire(&lock, &me);
+        for (i = 0; i < MAX; i++) {
+            counts[i] += local_counts[i];
+        }
+        lock_release(&lock, &me);
+
+    } else if (myargs->kernel == K_LOOP) {
+        lock_acquire(&lock, &me);
+        for (i = start; i < end; i++) {
+            val = array[i];
+            counts[val] = counts[val] + 1;
+        }
+        lock_release(&lock, &me);
+
+    } else { // K_ELEMENT
+        for (i = start; i < end; i++) {
+            val = array[i];
+            lock_acquire(&lock, &me);
+            counts[val] = counts[val] + 1;
+            lock_release(&lock, &me);
+            //only this thread writes its count, so no atomic add is needed
+            __atomic_store_n(&progress[myid].acquired, i - start + 1, __ATOMIC_RELAXED);
+        }
+        finished(nthreads);
+    }
+    return NULL;
+}
+
+/* Jain's fairness index of x[0..n-1]: (sum x)^2 / (n * sum x^2) */
+double jain(double *x, long n) {
+    double sum = 0, sum_sq = 0;
+    long i;
+    for (i = 0; i < n; i++) {
+        sum += x[i];
+        sum_sq += x[i] * x[i];
+    }
+    return sum_sq > 0 ? sum * sum / (n * sum_sq) : 1;
+}
+
+/* Runs kernel with lock kind on nthreads threads and prints the results.
+ * Returns 1 if the counts are wrong. */
+int run(int kernel, int kind, int *array, long length, long nthreads, long *expected) {
+    pthread_t *thread_array = malloc(nthreads * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(nthreads * sizeof(struct t_arg));
+    long counts[MAX] = {0};
+    struct timeval tstart, tend;
+    double time;
+    long t;
+    int ret;
+
+    progress = aligned_alloc(LOCK_LINE, nthreads * sizeof(struct progress));
+    fraction_at_first = malloc(nthreads * sizeof(double));
+    if (!thread_array || !thread_args || !progress || !fraction_at_first) {
+        print_error("ERROR: malloc failed");
+    }
+    memset(progress, 0, nthreads * sizeof(struct progress));
+    first_done = 0;
+    lock_init(&lock, kind);
+
+    for (t = 0; t < nthreads; t++) {
+        thread_args[t].id = t;
+        thread_args[t].numthreads = nthreads;
+        thread_args[t].ap = array;
+        thread_args[t].length = length;
+        thread_args[t].countp = counts;
+        thread_args[t].kernel = kernel;
+        //(set here, not by the thread, in case a thread finishes before
+        //another has even started)
+        progress[t].length = (t == nthreads - 1) ? length - t * (length / nthreads)
+                                                 : length / nthreads;
+    }
+
+    gettimeofday(&tstart, NULL);
+    for (t = 0; t < nthreads; t++) {
+        ret = pthread_create(&thread_array[t], NULL, countElems, &thread_args[t]);
+        if (ret) print_error("ERROR: pthread_create failed");
+    }
+    for (t = 0; t < nthreads; t++) {
+        ret = pthread_join(thread_array[t], NULL);
+        if (ret) print_error("ERROR: pthread_join failed");
+    }
+    gettimeofday(&tend, NULL);
+    time = getTime(tstart, tend);
+
+    printf("%-8s %-7s %7ld %10.4f %10.2f ", kernel_names[kernel],
+           lock_name(kind), nthreads, time, length / time / 1e6);
+    if (kernel == K_ELEMENT) {
+        printf("%9.3f\n", jain(fraction_at_first, nthreads));
+    } else {
+        printf("%9s\n", "-");
+    }
+    fflush(stdout);
+
+    lock_destroy(&lock);
+    free(thread_array);
+    free(thread_args);
+    free(progress);
+    free(fraction_at_first);
+    return memcmp(counts, expected, sizeof(counts)) != 0;
+}
+
+int main(int argc, char **argv) {
+    long length, max_threads, t, i, expected[MAX] = {0};
+    int kernel, kind, first_kind = 0, last_kind = LOCK_NKINDS - 1, errors = 0;
+    int *array;
+
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <n> <max_threads> [lock]\n", argv[0]);
+        fprintf(stderr, "where <n> is the length of the array\n");
+        fprintf(stderr, "and <max_threads> is the most threads to run\n");
+        fprintf(stderr, "and [lock] is mutex, ttas, ticket or mcs (default: all)\n");
+        return 1;
+    }
+    length = strtol(argv[1], NULL, 10);
+    max_threads = strtol(argv[2], NULL, 10);
+    if (max_threads < 1) print_error("ERROR: max_threads must be at least 1");
+    if (length < max_threads) print_error("ERROR: length must be at least max_threads");
+    if (argc == 4) {
+        first_kind = last_kind = lock_parse(argv[3]);
+        if (first_kind == -1) print_error("ERROR: unknown lock");
+    }
+
+    srand(10);
+    array = malloc(length * sizeof(int));
+    if (!array) print_error("ERROR: malloc failed");
+    genRandomArray(array, length);
+    for (i = 0; i < length; i++) expected[array[i]]++;
+
+    printf("%ld elements, %ld CPUs online\n", length, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %-7s %7s %10s %10s %9s\n", "kernel", "lock", "threads", "time (s)",
+           "Melem/s", "fairness");
+    for (kernel = 0; kernel < NKERNELS; kernel++) {
+        for (kind = first_kind; kind <= last_kind; kind++) {
+            for (t = 1; ; t = (t * 2 < max_threads) ? t * 2 : max_threads) {
+                errors += run(kernel, kind, array, length, t, expected);
+                if (t == max_threads) break;
+            }
+        }
+    }
+
+    free(array);
+    printf("%s\n", errors ? "ERROR: wrong counts" : "all counts verified");
+    return errors ? 1 : 0;
+}
@@ -3,6 +3,9 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
+/* thread placement (see affinity.h).  For the placement policies, compile with
+ *   gcc -DAFFINITY -o countElems_p countElems_p.c affinity.c -pthread */
+#include "affinity.h"
 
 #define MAX 10
 
@@ -90,11 +93,12 @@ void *countElems(void *args) {
 
 int main(int argc, char **argv) {
 
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s <n> <p?> <t>\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "usage: %s <n> <p?> <t> [policy]\n", argv[0]);
         fprintf(stderr, "where <n> is the length of the array\n");
         fprintf(stderr, "and <p?> is the print option (0/1)\n");
         fprintf(stderr, "and <t> is the number of threads\n");
+        fprintf(stderr, "and [policy] places the threads: none, compact, scatter or cores\n");
         return 1;
     }
 
@@ -106,6 +110,16 @@ int main(int argc, char **argv) {
     long nthreads = strtol(argv[3], NULL, 10);
     if (nthreads < 1) print_error("ERROR: need a positive number of threads");
     if (length < nthreads) print_error("ERROR: length must be greater than nthreads");
+
+    //optional thread placement policy (see affinity.h)
+    struct cpu_topology topo = {0};
+    int policy = AFF_NONE;
+    pthread_attr_t attr; //each thread's placement
+    if (argc == 5) {
+        policy = aff_parse(argv[4]);
+        if (policy == -1) print_error("ERROR: unknown placement policy");
+        if (policy != AFF_NONE && topo_discover(&topo)) return 1;
+    }
     int ret; //for error checking
 
     //generate random array of elements of specified length
@@ -133,7 +147,9 @@ int main(int argc, char **argv) {
     }
 
     for (t = 0; t < nthreads; t++) {
-        ret = pthread_create( &thread_array[t], NULL, countElems, &thread_args[t]);
+        if (aff_attr_init(&attr, &topo, policy, t)) return 1;
+        ret = pthread_create( &thread_array[t], &attr, countElems, &thread_args[t]);
+        pthread_attr_destroy(&attr);
         if (ret) print_error("ERROR: pthread_create failed");
     }
 
@@ -149,5 +165,6 @@ int main(int argc, char **argv) {
         printf("Counts array:\n");
         printCounts(counts);
     }
+    topo_free(&topo);
     return 0;
 }
@@ -3,6 +3,9 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
+/* thread placement (see affinity.h).  For the placement policies, compile with
+ *   gcc -DAFFINITY -o countElems_p_v3 countElems_p_v3.c affinity.c -pthread */
+#include "affinity.h"
 
 #define MAX 10
 
@@ -105,11 +108,12 @@ void *countElems(void *args) {
 
 int main(int argc, char **argv) {
 
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s <n> <p?> <t>\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "usage: %s <n> <p?> <t> [policy]\n", argv[0]);
         fprintf(stderr, "where <n> is the length of the array\n");
         fprintf(stderr, "and <p?> is the print option (0/1)\n");
         fprintf(stderr, "and <t> is the number of threads\n");
+        fprintf(stderr, "and [policy] places the threads: none, compact, scatter or cores\n");
         return 1;
     }
 
@@ -124,6 +128,16 @@ int main(int argc, char **argv) {
     if (nthreads < 1) print_error("ERROR: nthreads needs to be greater than 1");
     if (length < nthreads ) print_error("ERROR: length must be greater nthreads");
 
+    //optional thread placement policy (see affinity.h)
+    struct cpu_topology topo = {0};
+    int policy = AFF_NONE;
+    pthread_attr_t attr; //each thread's placement
+    if (argc == 5) {
+        policy = aff_parse(argv[4]);
+        if (policy == -1) print_error("ERROR: unknown placement policy");
+        if (policy != AFF_NONE && topo_discover(&topo)) return 1;
+    }
+
     //generate random array of elements of specified length
     int *array = malloc(length * sizeof(int));
     if (!array) print_error("ERROR: cannot malloc");
@@ -156,7 +170,9 @@ int main(int argc, char **argv) {
     if (ret) print_error("ERROR: pthread_mutex_init failed");
 
     for (t = 0; t < nthreads; t++) {
-        ret = pthread_create( &thread_array[t], NULL, countElems, &thread_args[t] );
+        if (aff_attr_init(&attr, &topo, policy, t)) return 1;
+        ret = pthread_create( &thread_array[t], &attr, countElems, &thread_args[t] );
+        pthread_attr_destroy(&attr);
         if (ret) print_error("ERROR: pthread_create failed");
     }
 
@@ -179,6 +195,7 @@ int main(int argc, char **argv) {
         double time = tend.tv_sec - tstart.tv_sec + (tend.tv_usec - tstart.tv_usec)/1.e6;
         printf("Time for Step 1 is %g s\n", time);
     }
+    topo_free(&topo);
     return 0;
 }
 
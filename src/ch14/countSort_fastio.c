@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ *
+ * https://diveintosystems.org/
+ */
+
+/*
+ * CountSort with a fast output path.
+ *
+ * The printArray function used by the other CountSort examples calls
+ * printf("%d ", ...) once for every element.  For large arrays, printing the
+ * sorted result takes far longer than sorting it: every call re-parses the
+ * format string and goes through stdio's locking.  This version replaces it
+ * with an output writer that:
+ *
+ *   - converts integers to text two digits at a time using a lookup table
+ *   - collects the text in a large user-space buffer
+ *   - hands full buffers to the OS with write() (or writev() for several)
+ *   - can optionally write the raw binary values instead of text
+ *   - can format chunks of the array in parallel, with each thread
+ *     formatting the next round of chunks while the current one is written
+ *     out in order, so the output is unchanged
+ *
+ * Timing information is printed to stderr so that stdout only contains the
+ * array values.
+ *
+ * To compile: gcc -O2 -o countSort_fastio countSort_fastio.c -lpthread
+ *
+ * To run: ./countSort_fastio <n> <p> <t> > out.txt
+ *   n: length of the array
+ *   p: print mode (0: none, 1: printf, 2: buffered text, 3: binary)
+ *   t: number of threads used to format the output (mode 2 only)
+ *
+ *   # compare printf and the buffered writer on 10 million elements:
+ *   ./countSort_fastio 10000000 1 1 > /dev/null
+ *   ./countSort_fastio 10000000 2 4 > /dev/null
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+
+#define MAX 10 //the maximum value of an element. (10 means 0-9)
+
+#define OUTBUF_SIZE (1 << 20)   /* bytes in the writer's user-space buffer */
+#define MAX_INT_CHARS 12        /* "-2147483648" plus a separator */
+#define PAR_CHUNK (1 << 18)     /* elements formatted by a thread per round */
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* print modes selected on the command line */
+enum { PRINT_NONE, PRINT_PRINTF, PRINT_TEXT, PRINT_BINARY };
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: genRandomArray
+ * fills an input array of specified length (length) with random
+   values from 0 to MAX-1
+*/
+void genRandomArray(int *array, long length) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = rand() % MAX;
+    }
+}
+
+/* helper function: printArray
+ * prints out all the values in the input array separated by spaces
+ * (the original, one printf call per element)
+ */
+void printArray(int *array, long length) {
+    long i;
+    for (i = 0; i < length; i++) {
+        printf("%d ", array[i]);
+    }
+    printf("\n");
+}
+
+/*step 1: compute the frequency of all the elements in the input array */
+void countElems(int *counts, int *array_A, long length) {
+    long i;
+    int val;
+    for (i = 0; i < length; i++) {
+        val = array_A[i]; //read the value at index i
+        counts[val] = counts[val] + 1; //update corresponding location in counts
+    }
+}
+
+/* step 2: overwrite the input array using the frequencies in counts */
+void writeArray(int *counts, int *array_A) {
+    int i, amt;
+    long j = 0;
+
+    for (i = 0; i < MAX; i++) { //iterate over the counts array
+        amt = counts[i]; //capture frequency of element i
+        while (amt > 0) { //while all values aren't written
+            array_A[j] = i; //replace value at index j of array_A with i
+            j++; //go to next position in array_A
+            amt--; //decrease the amount written by 1
+        }
+    }
+}
+
+/***********************************************************/
+/* The output writer */
+
+/* "00" "01" ... "99": the two characters for every value 0-99.  Converting
+ * two digits per step halves the number of divisions compared to the usual
+ * one-digit-at-a-time loop. */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Converts val to decimal text starting at dst.  dst must have room for at
+ * least MAX_INT_CHARS characters.  Returns the number of characters written
+ * (no null terminator is added). */
+int format_int(char *dst, int val) {
+    char tmp[MAX_INT_CHARS];
+    char *p = tmp + MAX_INT_CHARS;  /* digits are produced right to left */
+    unsigned int u;
+    int len, neg = 0;
+
+    if (val < 0) {
+        neg = 1;
+        u = 0u - (unsigned int)val;  /* safe for INT_MIN */
+    } else {
+        u = val;
+    }
+
+    while (u >= 100) {
+        unsigned int pair = (u % 100) * 2;
+        u /= 100;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+    }
+    if (u >= 10) {
+        p -= 2;
+        p[0] = digit_pairs[u * 2];
+        p[1] = digit_pairs[u * 2 + 1];
+    } else {
+        *--p = '0' + u;
+    }
+    if (neg) {
+        *--p = '-';
+    }
+
+    len = tmp + MAX_INT_CHARS - p;
+    memcpy(dst, p, len);
+    return len;
+}
+
+/* Formats length values from array into dst, each followed by a space.
+ * dst must hold at least length * MAX_INT_CHARS bytes.  Returns the number
+ * of bytes written. */
+long format_ints(char *dst, int *array, long length) {
+    long i;
+    char *p = dst;
+    for (i = 0; i < length; i++) {
+        p += format_int(p, array[i]);
+        *p++ = ' ';
+    }
+    return p - dst;
+}
+
+/* Writes all len bytes of buf to fd, retrying on short writes. */
+void write_all(int fd, const char *buf, size_t len) {
+    ssize_t ret;
+    while (len > 0) {
+        ret = write(fd, buf, len);
+        if (ret < 0) print_error("ERROR: write failed");
+        buf += ret;
+        len -= ret;
+    }
+}
+
+/* Writes every buffer described by iov (iovcnt entries) to fd in order,
+ * using as few writev calls as possible.  iov is modified. */
+void writev_all(int fd, struct iovec *iov, int iovcnt) {
+    ssize_t ret;
+    while (iovcnt > 0) {
+        ret = writev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+        if (ret < 0) print_error("ERROR: writev failed");
+        //skip over the buffers (or part of a buffer) that were written
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+}
+
+/* A buffered writer: text accumulates in buf until it is nearly full, and
+ * is then passed to the OS in a single write call. */
+struct out_buf {
+    int fd;     //file descriptor the output goes to
+    char *buf;  //user-space buffer
+    long len;   //number of bytes currently in buf
+};
+
+void outbuf_init(struct out_buf *ob, int fd) {
+    ob->fd = fd;
+    ob->len = 0;
+    ob->buf = malloc(OUTBUF_SIZE);
+    if (!ob->buf) print_error("ERROR: malloc failed");
+}
+
+void outbuf_flush(struct out_buf *ob) {
+    write_all(ob->fd, ob->buf, ob->len);
+    ob->len = 0;
+}
+
+void outbuf_free(struct out_buf *ob) {
+    outbuf_flush(ob);
+    free(ob->buf);
+}
+
+/* Appends one integer followed by sep to the buffer. */
+void outbuf_put_int(struct out_buf *ob, int val, char sep) {
+    if (ob->len >= OUTBUF_SIZE - MAX_INT_CHARS) {
+        outbuf_flush(ob);
+    }
+    ob->len += format_int(ob->buf + ob->len, val);
+    ob->buf[ob->len++] = sep;
+}
+
+/* Appends one character to the buffer. */
+void outbuf_put_char(struct out_buf *ob, char c) {
+    if (ob->len >= OUTBUF_SIZE) {
+        outbuf_flush(ob);
+    }
+    ob->buf[ob->len++] = c;
+}
+
+/* Buffered replacement for printArray: same output, far fewer calls. */
+void printArrayFast(int *array, long length) {
+    struct out_buf ob;
+    long i;
+
+    fflush(stdout); //anything already in stdio's buffer must come first
+    outbuf_init(&ob, STDOUT_FILENO);
+    for (i = 0; i < length; i++) {
+        outbuf_put_int(&ob, array[i], ' ');
+    }
+    outbuf_put_char(&ob, '\n');
+    outbuf_free(&ob);
+}
+
+/* Writes the array as raw native-endian ints: no formatting at all.  Large
+ * arrays go straight from the array's memory to the OS. */
+void printArrayBinary(int *array, long length) {
+    fflush(stdout);
+    write_all(STDOUT_FILENO, (char *)array, length * sizeof(int));
+}
+
+/* parallel formatting: in round r, thread t formats the t-th PAR_CHUNK
+ * elements of the round into its buffer buf[r % 2].  Every thread has two
+ * buffers, so while main writes out round r's buffers in thread order
+ * (with one writev call), the threads are already formatting round r+1
+ * into their other buffers.  The threads are created once, and meet main
+ * at a barrier at the end of each round. */
+struct t_arg {
+    long id;                    //thread id
+    long nthreads;              //number of formatting threads
+    int *array;                 //the whole array
+    long length;                //length of the array
+    long nrounds;               //number of rounds
+    char *buf[2];               //this thread's two output buffers
+    long len[2];                //number of bytes formatted into each
+    pthread_barrier_t *barrier; //shared with main and the other threads
+};
+
+void *formatChunks(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long r, start, n;
+
+    for (r = 0; r < myargs->nrounds; r++) {
+        //the last round may not have a chunk for every thread
+        start = (r * myargs->nthreads + myargs->id) * PAR_CHUNK;
+        n = myargs->length - start;
+        if (n > PAR_CHUNK) n = PAR_CHUNK;
+        if (n < 0) n = 0;
+        //buf[r % 2] was written out by main before it let round r-1 end
+        myargs->len[r % 2] = format_ints(myargs->buf[r % 2], myargs->array + start, n);
+        pthread_barrier_wait(myargs->barrier); //round r is formatted
+    }
+    return NULL;
+}
+
+void printArrayParallel(int *array, long length, long nthreads) {
+    long t, r, nrounds = (length + nthreads * PAR_CHUNK - 1) / (nthreads * PAR_CHUNK);
+    int ret;
+    char newline = '\n';
+    pthread_barrier_t barrier;
+
+    pthread_t *thread_array = malloc(nthreads * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(nthreads * sizeof(struct t_arg));
+    struct iovec *iov = malloc(nthreads * sizeof(struct iovec));
+    if (!thread_array || !thread_args || !iov) print_error("ERROR: malloc failed");
+    pthread_barrier_init(&barrier, NULL, nthreads + 1); //the threads and main
+
+    fflush(stdout);
+    for (t = 0; t < nthreads; t++) {
+        thread_args[t].id = t;
+        thread_args[t].nthreads = nthreads;
+        thread_args[t].array = array;
+        thread_args[t].length = length;
+        thread_args[t].nrounds = nrounds;
+        thread_args[t].barrier = &barrier;
+        thread_args[t].buf[0] = malloc((long)PAR_CHUNK * MAX_INT_CHARS);
+        thread_args[t].buf[1] = malloc((long)PAR_CHUNK * MAX_INT_CHARS);
+        if (!thread_args[t].buf[0] || !thread_args[t].buf[1]) {
+            print_error("ERROR: malloc failed");
+        }
+        ret = pthread_create(&thread_array[t], NULL, formatChunks, &thread_args[t]);
+        if (ret) print_error("ERROR: pthread_create failed");
+    }
+
+    for (r = 0; r < nrounds; r++) {
+        pthread_barrier_wait(&barrier); //wait for round r to be formatted
+        //ordered flush: chunk t is always written before chunk t+1.  The
+        //threads format round r+1 meanwhile, but cannot start round r+2 (in
+        //these buffers) until main reaches the barrier again.
+        for (t = 0; t < nthreads; t++) {
+            iov[t].iov_base = thread_args[t].buf[r % 2];
+            iov[t].iov_len = thread_args[t].len[r % 2];
+        }
+        writev_all(STDOUT_FILENO, iov, nthreads);
+    }
+    write_all(STDOUT_FILENO, &newline, 1);
+
+    for (t = 0; t < nthreads; t++) {
+        ret = pthread_join(thread_array[t], NULL);
+        if (ret) print_error("ERROR: pthread_join failed");
+        free(thread_args[t].buf[0]);
+        free(thread_args[t].buf[1]);
+    }
+    pthread_barrier_destroy(&barrier);
+    free(iov);
+    free(thread_args);
+    free(thread_array);
+}
+
+/***********************************************************/
+/* main function:
+ * sorts a random array with CountSort, then prints the result with the
+ * selected print mode, timing the sort and the print separately.
+*/
+int main(int argc, char **argv) {
+
+    if (argc != 4) { //checks to ensure we have the correct number of args
+        fprintf(stderr, "usage: %s <n> <p> <t>\n", argv[0]);
+        fprintf(stderr, "where <n> is the length of the array\n");
+        fprintf(stderr, "and <p> is the print mode (0: none, 1: printf, ");
+        fprintf(stderr, "2: buffered text, 3: binary)\n");
+        fprintf(stderr, "and <t> is the number of formatting threads\n");
+        return 1;
+    }
+
+    srand(10); //use of static seed ensures the output is the same every run
+
+    long length = strtol(argv[1], NULL, 10);
+    if (length < 1) print_error("ERROR: length must be greater than 0");
+    if (length > INT_MAX) print_error("ERROR: length must fit in an int");
+
+    int mode = atoi(argv[2]);
+    if (mode < PRINT_NONE || mode > PRINT_BINARY) print_error("ERROR: bad print mode");
+
+    long nthreads = strtol(argv[3], NULL, 10);
+    if (nthreads < 1) print_error("ERROR: nthreads must be greater than 0");
+
+    //generate random array of elements of specified length
+    int *array = malloc(length * sizeof(int));
+    if (!array) print_error("ERROR: malloc failed");
+    genRandomArray(array, length);
+
+    struct timeval tstart, tend;
+    double time;
+
+    //sort
+    int counts[MAX] = {0};
+    gettimeofday(&tstart, NULL);
+    countElems(counts, array, length);
+    writeArray(counts, array);
+    gettimeofday(&tend, NULL);
+    time = tend.tv_sec - tstart.tv_sec + (tend.tv_usec - tstart.tv_usec)/1.e6;
+    fprintf(stderr, "Time to sort: %g s\n", time);
+
+    //print
+    gettimeofday(&tstart, NULL);
+    if (mode == PRINT_PRINTF) {
+        printArray(array, length);
+        fflush(stdout);
+    }
+    else if (mode == PRINT_TEXT && nthreads == 1) {
+        printArrayFast(array, length);
+    }
+    else if (mode == PRINT_TEXT) {
+        printArrayParallel(array, length, nthreads);
+    }
+    else if (mode == PRINT_BINARY) {
+        printArrayBinary(array, length);
+    }
+    gettimeofday(&tend, NULL);
+    time = tend.tv_sec - tstart.tv_sec + (tend.tv_usec - tstart.tv_usec)/1.e6;
+    if (mode != PRINT_NONE) {
+        fprintf(stderr, "Time to print: %g s\n", time);
+    }
+
+    free(array);
+
+    return 0;
+}
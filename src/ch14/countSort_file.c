@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ *
+ * https://diveintosystems.org/
+ */
+
+/*
+ * CountSort on an input array read from an array file (see arrayfile.h)
+ * instead of one generated with rand().
+ *
+ * The input file is mapped into memory with af_open, so countElems reads the
+ * values straight out of the page cache: there is no read() into a separate
+ * buffer and no text to parse.  The sorted result is written by writeArray
+ * directly into a mapped output file created with af_create.
+ *
+ * To compile: gcc -O2 -o countSort_file countSort_file.c arrayfile.c
+ *
+ * To run: ./countSort_file <in> [out]
+ *   in:  an array file of 32-bit ints with values 0 to MAX-1
+ *   out: (optional) the array file to write the sorted result to
+ *
+ *   ./genArrayFile input.arr skewed 10 100000000
+ *   ./countSort_file input.arr sorted.arr
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "arrayfile.h"
+
+#define MAX 10 //the maximum value of an element. (10 means 0-9)
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/*helper function: printCounts
+ * prints out all the values in the counts array, separated by spaces
+*/
+void printCounts(long *counts) {
+    int i;
+    for (i = 0; i < MAX; i++) {
+        printf("%ld ", counts[i]);
+    }
+    printf("\n");
+}
+
+/*step 1:
+ * compute the frequency of all the elements in the input array and store
+ * the associated counts of each element in array counts.  Unlike the
+ * rand()-generated arrays, a file may hold any value, so values outside
+ * 0 to MAX-1 are counted in bad instead of corrupting memory.
+*/
+void countElems(long *counts, const int *array_A, long length, long *bad) {
+    long i;
+    int val;
+    for (i = 0; i < length; i++) {
+        val = array_A[i]; //read the value at index i
+        if ((unsigned int)val < MAX) {
+            counts[val] = counts[val] + 1; //update corresponding location in counts
+        } else {
+            *bad = *bad + 1;
+        }
+    }
+}
+
+/* step 2:
+ * write the sorted values into array_B using the frequencies stored in
+ * the array counts
+*/
+void writeArray(long *counts, int *array_B) {
+    int i;
+    long j = 0, amt;
+
+    for (i = 0; i < MAX; i++) { //iterate over the counts array
+        amt = counts[i]; //capture frequency of element i
+        while (amt > 0) { //while all values aren't written
+            array_B[j] = i; //replace value at index j of array_B with i
+            j++; //go to next position in array_B
+            amt--; //decrease the amount written by 1
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    struct arrayfile in, out;
+    struct timeval tstart, tend;
+    double time;
+    long counts[MAX] = {0};
+    long bad = 0;
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <in> [out]\n", argv[0]);
+        fprintf(stderr, "where <in> is an array file of ints 0 to %d\n", MAX - 1);
+        fprintf(stderr, "and [out] is the array file to write the result to\n");
+        return 1;
+    }
+
+    //without an output file, sort a private (copy-on-write) mapping in place
+    if (af_open(argv[1], argc == 2, &in) == -1) {
+        print_error("ERROR: cannot open input file");
+    }
+    if (in.header->elem_type != AF_INT32) {
+        print_error("ERROR: input file must contain 32-bit ints");
+    }
+    long length = in.header->count;
+    printf("%s: %ld elements\n", argv[1], length);
+
+    gettimeofday(&tstart, NULL);
+    countElems(counts, in.data, length, &bad);
+    gettimeofday(&tend, NULL);
+    time = tend.tv_sec - tstart.tv_sec + (tend.tv_usec - tstart.tv_usec)/1.e6;
+    printf("Time for Step 1 is %g s\n", time);
+    if (bad) {
+        fprintf(stderr, "ERROR: %ld values are outside 0 to %d\n", bad, MAX - 1);
+        af_close(&in);
+        return 2;
+    }
+
+    if (argc == 3) {
+        uint64_t dims[1] = { length };
+        if (af_create(argv[2], AF_INT32, 1, dims, &out) == -1) {
+            print_error("ERROR: cannot create output file");
+        }
+    } else {
+        out = in;
+    }
+
+    gettimeofday(&tstart, NULL);
+    writeArray(counts, out.data);
+    gettimeofday(&tend, NULL);
+    time = tend.tv_sec - tstart.tv_sec + (tend.tv_usec - tstart.tv_usec)/1.e6;
+    printf("Time for Step 2 is %g s\n", time);
+
+    printf("Counts array:\n");
+    printCounts(counts);
+
+    if (argc == 3) {
+        af_close(&out);
+    }
+    af_close(&in);
+
+    return 0;
+}
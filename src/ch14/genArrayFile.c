@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ *
+ * https://diveintosystems.org/
+ */
+
+/*
+ * Generates input files in the arrayfile format (see arrayfile.h) for the
+ * example kernels, with different distributions of values.  Real inputs
+ * are rarely uniformly random, so this makes it easy to see how a kernel
+ * behaves on sorted or skewed data.  Any other program can produce inputs
+ * for the kernels by writing the same format with af_write.
+ *
+ * To compile: gcc -O2 -o genArrayFile genArrayFile.c arrayfile.c -lm
+ *
+ * To run: ./genArrayFile <file> <dist> <max> <n> [m]
+ *   file: the array file to create
+ *   dist: uniform, skewed, sorted or reversed
+ *   max:  values are in the range 0 to max-1
+ *   n:    the number of elements (or of rows, if m is given)
+ *   m:    the number of columns, to create an n x m matrix
+ *
+ *   # 100 million values 0-9 where small values are far more common:
+ *   ./genArrayFile skewed.arr skewed 10 100000000
+ *   ./countSort_file skewed.arr sorted.arr
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "arrayfile.h"
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* uniform: every value in 0 to max-1 is equally likely */
+void genUniform(int *array, long length, int max) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = rand() % max;
+    }
+}
+
+/* skewed: value v is chosen with probability proportional to 1/(v+1)
+ * (a Zipf distribution), so 0 is the most common value */
+void genSkewed(int *array, long length, int max) {
+    double *cdf = malloc(max * sizeof(double));
+    double total = 0, r;
+    long i;
+    int v, lo, hi;
+
+    if (!cdf) print_error("ERROR: malloc failed");
+    for (v = 0; v < max; v++) {
+        total += 1.0 / (v + 1);
+        cdf[v] = total;
+    }
+
+    for (i = 0; i < length; i++) {
+        //binary search for the first value whose cdf exceeds r
+        r = total * rand() / ((double)RAND_MAX + 1);
+        lo = 0;
+        hi = max - 1;
+        while (lo < hi) {
+            v = (lo + hi) / 2;
+            if (cdf[v] > r) {
+                hi = v;
+            } else {
+                lo = v + 1;
+            }
+        }
+        array[i] = lo;
+    }
+    free(cdf);
+}
+
+/* sorted: values in nondecreasing order, evenly spread over 0 to max-1 */
+void genSorted(int *array, long length, int max) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = (int)((double)i * max / length);
+    }
+}
+
+/* reversed: values in nonincreasing order */
+void genReversed(int *array, long length, int max) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = max - 1 - (int)((double)i * max / length);
+    }
+}
+
+int main(int argc, char **argv) {
+    struct arrayfile af;
+    uint64_t dims[2];
+    int ndims = 1;
+
+    if (argc != 5 && argc != 6) {
+        fprintf(stderr, "usage: %s <file> <dist> <max> <n> [m]\n", argv[0]);
+        fprintf(stderr, "where <file> is the array file to create\n");
+        fprintf(stderr, "and <dist> is uniform, skewed, sorted or reversed\n");
+        fprintf(stderr, "and <max> is the number of distinct values\n");
+        fprintf(stderr, "and <n> is the number of elements (or rows)\n");
+        fprintf(stderr, "and [m] is the number of columns of a matrix\n");
+        return 1;
+    }
+
+    srand(10); //static seed: the same arguments always produce the same file
+
+    //find the distribution before creating the file, so that a bad name
+    //does not leave a file of zeros behind
+    char *dist = argv[2];
+    void (*gen)(int *array, long length, int max);
+    if (strcmp(dist, "uniform") == 0) {
+        gen = genUniform;
+    }
+    else if (strcmp(dist, "skewed") == 0) {
+        gen = genSkewed;
+    }
+    else if (strcmp(dist, "sorted") == 0) {
+        gen = genSorted;
+    }
+    else if (strcmp(dist, "reversed") == 0) {
+        gen = genReversed;
+    }
+    else {
+        print_error("ERROR: unknown distribution");
+    }
+
+    int max = atoi(argv[3]);
+    if (max < 1) print_error("ERROR: max must be greater than 0");
+
+    dims[0] = strtol(argv[4], NULL, 10);
+    if (argc == 6) {
+        dims[1] = strtol(argv[5], NULL, 10);
+        ndims = 2;
+    }
+    long length = ndims == 2 ? dims[0] * dims[1] : dims[0];
+    if (length < 1) print_error("ERROR: the array must have at least 1 element");
+
+    //the values are generated directly into the mapped output file
+    if (af_create(argv[1], AF_INT32, ndims, dims, &af) == -1) {
+        print_error("ERROR: cannot create output file");
+    }
+
+    gen(af.data, length, max);
+    af_close(&af);
+    return 0;
+}
@@ -1,6 +1,25 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Each thread says hello, and which CPU it is running on.  With a placement
+ * policy (see affinity.h), each thread is created pinned to the CPU the
+ * policy gives it.
+ *
+ * To compile: gcc -o hellothreads hellothreads.c -pthread
+ *   or, for the placement policies:
+ *             gcc -DAFFINITY -o hellothreads hellothreads.c affinity.c -pthread
+ *
+ * To run: ./hellothreads <n> [policy]
+ *   n:      the number of threads
+ *   policy: none (the default), compact, scatter or cores
+ */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <pthread.h>
+#include "affinity.h"
 
 /*error handling function: prints out error message*/
 int print_error(char *msg) {
@@ -16,7 +35,7 @@ void *HelloWorld(void *id) {
      * generic (void *) to a (long *). */
     long *myid = (long *)id;
 
-    printf("Hello world! I am thread %ld\n", *myid);
+    printf("Hello world! I am thread %ld, on CPU %d\n", *myid, sched_getcpu());
 
     /* We don't need our threads to return anything. */
     return NULL;
@@ -28,16 +47,30 @@ int main(int argc, char **argv) {
     pthread_t *thread_array; //pointer to future thread array
     long *thread_ids;
     int ret; //useful for error detection
+    struct cpu_topology topo = {0}; //the machine's CPUs (if a policy is used)
+    int policy = AFF_NONE; //thread placement policy
+    pthread_attr_t attr; //a thread's placement
 
     /* Read the number of threads to create from the command line. */
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <n>\n", argv[0]);
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <n> [policy]\n", argv[0]);
         fprintf(stderr, "where <n> is the number of threads\n");
+        fprintf(stderr, "and [policy] is none, compact, scatter or cores\n");
         return 1;
     }
     nthreads = strtol(argv[1], NULL, 10);
     if (nthreads < 1) print_error("ERROR: enter a positive number of threads");
 
+    /* Read the placement policy, and the topology it needs. */
+    if (argc == 3) {
+        policy = aff_parse(argv[2]);
+        if (policy == -1) print_error("ERROR: unknown placement policy");
+        if (policy != AFF_NONE) {
+            if (topo_discover(&topo)) return 1;
+            topo_print(&topo, stdout);
+        }
+    }
+
     /* Allocate space for thread structs and identifiers. */
     thread_array = malloc(nthreads * sizeof(pthread_t));
     thread_ids = malloc(nthreads * sizeof(long));
@@ -46,7 +79,9 @@ int main(int argc, char **argv) {
     /* Assign each thread an ID and create all the threads. */
     for (i = 0; i < nthreads; i++) {
         thread_ids[i] = i;
-        ret = pthread_create(&thread_array[i], NULL, HelloWorld, &thread_ids[i]);
+        if (aff_attr_init(&attr, &topo, policy, i)) return 1;
+        ret = pthread_create(&thread_array[i], &attr, HelloWorld, &thread_ids[i]);
+        pthread_attr_destroy(&attr);
         if (ret) print_error("ERROR: pthread create failed");
     }
 
@@ -59,6 +94,7 @@ int main(int argc, char **argv) {
 
     free(thread_array);
     free(thread_ids);
+    topo_free(&topo);
 
     return 0;
 }
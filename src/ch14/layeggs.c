@@ -14,8 +14,11 @@
  * it lays and egg.
  *
  * To compile: gcc -g -o layeggs layeggs.c -lpthread
+ *   or, for the placement policies:
+ *             gcc -g -DAFFINITY -o layeggs layeggs.c affinity.c -lpthread
  *
- * To run: ./layeggs <n> <t>   # n: num eggs, t: num chicken & farmer threads
+ * To run: ./layeggs <n> <t> [policy]   # n: num eggs, t: num chicken & farmer threads
+ *                                      # policy: thread placement (see affinity.h)
  *
  *   # 4 chickens each lay 10 eggs, and 4 farmers each collect 10 eggs:
  *   ./layeggs 10 4
@@ -25,6 +28,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include "affinity.h" //thread placement
 
 #define EGGTIME 100000   /* the number of microseconds it takes to lay an egg */
 
@@ -60,11 +64,15 @@ int main(int argc, char **argv) {
     int num_eggs;           // number of eggs ready to collect
     pthread_mutex_t mutex;  // mutex associated with cond variable
     pthread_cond_t  eggs;   // used to block/wake-up farmer waiting for eggs
+    struct cpu_topology topo = {0}; // the machine's CPUs, for thread placement
+    int policy = AFF_NONE;    // thread placement policy
+    pthread_attr_t attr;      // a thread's placement
 
-    if (argc != 3) {
-        fprintf(stderr, "usage: %s <n> <t>\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <n> <t> [policy]\n", argv[0]);
         fprintf(stderr, "where <n> is the number of eggs to create/collect\n");
         fprintf(stderr, "and <t> is the number of threads\n");
+        fprintf(stderr, "and [policy] places the threads: none, compact, scatter or cores\n");
         return 1;
     }
     total_eggs = atoi(argv[1]);
@@ -74,6 +82,13 @@ int main(int argc, char **argv) {
     if (total_eggs <= 0) {  total_eggs = 10; }
     if (nthreads <= 0) { nthreads = 3; }
 
+    //optional thread placement policy (see affinity.h)
+    if (argc == 4) {
+        policy = aff_parse(argv[3]);
+        if (policy == -1) print_error("ERROR: unknown placement policy");
+        if (policy != AFF_NONE && topo_discover(&topo)) return 1;
+    }
+
     num_eggs = 0; // number of eggs ready to collect
     ret = pthread_mutex_init(&mutex, NULL); //initialize the mutex
     if (ret) print_error("ERROR pthread_mutex_init failed");
@@ -94,12 +109,14 @@ int main(int argc, char **argv) {
         thread_args[i].num_eggs = &num_eggs;
         thread_args[i].mutex = &mutex;
         thread_args[i].eggs = &eggs;
+        if (aff_attr_init(&attr, &topo, policy, i)) return 1;
         if ( (i % 2) == 0 ) {
-            ret = pthread_create( &thread_array[i], NULL, chicken, &thread_args[i] );
+            ret = pthread_create( &thread_array[i], &attr, chicken, &thread_args[i] );
         }
         else {
-            ret = pthread_create( &thread_array[i], NULL, farmer, &thread_args[i] );
+            ret = pthread_create( &thread_array[i], &attr, farmer, &thread_args[i] );
         }
+        pthread_attr_destroy(&attr);
         if (ret) print_error("ERROR: pthread create failed");
     }
 
@@ -116,6 +133,7 @@ int main(int argc, char **argv) {
     free(thread_array);
     free(thread_args);
 
+    topo_free(&topo);
     return 0;
 }
 
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * Implementation of the locks library (see locks.h).
+ *
+ * Compile it together with a program that uses it, for example:
+ *   gcc -O2 -o countElems_locks countElems_locks.c locks.c -pthread
+ */
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "locks.h"
+
+#define SPIN_LIMIT 100   /* spins before yielding the CPU */
+#define MAX_BACKOFF 1024 /* most pauses a ttas waiter backs off for */
+
+static const char *lock_names[LOCK_NKINDS] = { "mutex", "ttas", "ticket", "mcs" };
+
+/* tells the CPU this is a spin loop: saves power and, on a CPU with
+ * hyperthreads, gives the other hardware thread more of the core */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* one step of a spin loop: yields the CPU every SPIN_LIMIT steps */
+static inline void spin_wait(int *spins) {
+    if (++*spins == SPIN_LIMIT) {
+        sched_yield();
+        *spins = 0;
+    } else {
+        cpu_relax();
+    }
+}
+
+const char *lock_name(int kind) {
+    return kind >= 0 && kind < LOCK_NKINDS ? lock_names[kind] : "?";
+}
+
+int lock_parse(const char *name) {
+    int kind;
+    for (kind = 0; kind < LOCK_NKINDS; kind++) {
+        if (strcmp(name, lock_names[kind]) == 0) return kind;
+    }
+    return -1;
+}
+
+void lock_init(struct lock *l, int kind) {
+    memset(l, 0, sizeof(*l));
+    l->kind = kind;
+    if (kind == LOCK_MUTEX) pthread_mutex_init(&l->mutex, NULL);
+}
+
+void lock_destroy(struct lock *l) {
+    if (l->kind == LOCK_MUTEX) pthread_mutex_destroy(&l->mutex);
+}
+
+void lock_acquire(struct lock *l, struct lock_node *me) {
+    struct lock_node *pred;
+    unsigned ticket;
+    int spins = 0, backoff = 1, i;
+
+    switch (l->kind) {
+        case LOCK_MUTEX:
+            pthread_mutex_lock(&l->mutex);
+            break;
+
+        case LOCK_TTAS:
+            while (1) {
+                // test: wait, reading only, until the lock looks free
+                while (__atomic_load_n(&l->ttas, __ATOMIC_RELAXED)) spin_wait(&spins);
+                // and test-and-set: try to take it
+                if (!__atomic_exchange_n(&l->ttas, 1, __ATOMIC_ACQUIRE)) break;
+                for (i = 0; i < backoff; i++) cpu_relax();
+                if (backoff < MAX_BACKOFF) backoff *= 2;
+            }
+            break;
+
+        case LOCK_TICKET:
+            ticket = __atomic_fetch_add(&l->ticket_next, 1, __ATOMIC_RELAXED);
+            while (__atomic_load_n(&l->ticket_serving, __ATOMIC_ACQUIRE) != ticket) {
+                spin_wait(&spins);
+            }
+            break;
+
+        case LOCK_MCS:
+            me->next = NULL;
+            me->locked = 1;
+            // join the end of the queue; whoever was there hands us the lock
+            pred = __atomic_exchange_n(&l->mcs_tail, me, __ATOMIC_ACQ_REL);
+            if (pred != NULL) {
+                __atomic_store_n(&pred->next, me, __ATOMIC_RELEASE);
+                while (__atomic_load_n(&me->locked, __ATOMIC_ACQUIRE)) spin_wait(&spins);
+            }
+            break;
+    }
+}
+
+void lock_release(struct lock *l, struct lock_node *me) {
+    struct lock_node *expected, *next;
+    int spins = 0;
+
+    switch (l->kind) {
+        case LOCK_MUTEX:
+            pthread_mutex_unlock(&l->mutex);
+            break;
+
+        case LOCK_TTAS:
+            __atomic_store_n(&l->ttas, 0, __ATOMIC_RELEASE);
+            break;
+
+        case LOCK_TICKET:
+            // only the holder writes ticket_serving, so no atomic add is needed
+            __atomic_store_n(&l->ticket_serving, l->ticket_serving + 1, __ATOMIC_RELEASE);
+            break;
+
+        case LOCK_MCS:
+            next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE);
+            if (next == NULL) {
+                // no one behind us: empty the queue, unless someone is
+                // joining it right now
+                expected = me;
+                if (__atomic_compare_exchange_n(&l->mcs_tail, &expected, NULL, 0,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    return;
+                }
+                // someone is: wait until they have linked themselves in
+                while ((next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE)) == NULL) {
+                    spin_wait(&spins);
+                }
+            }
+            __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+            break;
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC (https://diveintosystems.org/)
+ *
+ * locks: several ways of implementing a mutual exclusion lock, behind one
+ * interface, so a program can choose among them when it runs:
+ *
+ *   mutex:  pthread_mutex_t.  A waiting thread spins briefly, then sleeps
+ *           in the kernel until the lock is released.
+ *   ttas:   test-and-test-and-set spinlock.  Waiters spin reading the lock
+ *           (which hits in their own cache) and only try to take it, with
+ *           an atomic exchange, when it looks free; after each failed try
+ *           a waiter backs off for twice as long, up to a limit, so fewer
+ *           threads fight over the cache line at once.  Not fair: the
+ *           thread that gets the lock is whichever tries first.
+ *   ticket: a thread takes a ticket (an atomic increment) and waits until
+ *           its number is served, like at a deli counter.  Fair (first
+ *           come, first served), but every waiter spins on the same
+ *           counter, so each release invalidates it in every waiter's cache.
+ *   mcs:    the Mellor-Crummey and Scott queue lock.  Waiters form a linked
+ *           list, each spinning on a flag in its own node, and a release
+ *           hands the lock to the next node only.  Fair, and a release
+ *           touches only one other waiter's cache.
+ *
+ * The spinning locks yield the CPU (sched_yield) after spinning for a while,
+ * so that they still make progress when there are more threads than CPUs
+ * and the thread that holds the lock, or is next in line, is not running.
+ *
+ * Every thread passes its own struct lock_node to lock_acquire and
+ * lock_release; only mcs uses it.
+ */
+#ifndef _LOCKS_H_
+#define _LOCKS_H_
+
+#include <pthread.h>
+
+#define LOCK_LINE 64
+
+enum lock_kind { LOCK_MUTEX, LOCK_TTAS, LOCK_TICKET, LOCK_MCS, LOCK_NKINDS };
+
+/* a thread's place in an mcs lock's queue */
+struct lock_node {
+    struct lock_node *next;
+    int locked;
+} __attribute__((aligned(LOCK_LINE)));
+
+/* a lock of any kind (the fields are private) */
+struct lock {
+    int kind;
+    pthread_mutex_t mutex;
+    int ttas __attribute__((aligned(LOCK_LINE)));               // 1 when held
+    unsigned ticket_next __attribute__((aligned(LOCK_LINE)));   // next ticket
+    unsigned ticket_serving __attribute__((aligned(LOCK_LINE)));
+    struct lock_node *mcs_tail __attribute__((aligned(LOCK_LINE)));
+};
+
+/*
+ * Returns the name of a kind of lock ("mutex", "ttas", "ticket" or "mcs").
+ */
+extern const char *lock_name(int kind);
+
+/*
+ * Returns the kind of lock named name, or -1 if there is no such kind.
+ */
+extern int lock_parse(const char *name);
+
+/*
+ * Initializes l as an unlocked lock of the given kind.
+ */
+extern void lock_init(struct lock *l, int kind);
+
+/*
+ * Frees anything lock_init allocated.
+ */
+extern void lock_destroy(struct lock *l);
+
+/*
+ * Waits until the lock is free, and takes it.  me is the calling thread's
+ * node, which it must not use for anything else until lock_release.
+ */
+extern void lock_acquire(struct lock *l, struct lock_node *me);
+
+/*
+ * Releases the lock, which the calling thread holds.
+ */
+extern void lock_release(struct lock *l, struct lock_node *me);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ *
+ * https://diveintosystems.org/
+ */
+
+/*
+ * STREAM-style memory bandwidth benchmark.
+ *
+ * The scalar_multiply kernel (ch15) and many others in these examples do
+ * almost no computation per element: their speed is set by how fast
+ * memory can deliver and accept data.  This program measures that limit
+ * with four such kernels, on arrays a, b and c of ints:
+ *
+ *   copy:   c[i] = a[i]                 (8 bytes moved per element)
+ *   scale:  b[i] = scalar * c[i]        (8 bytes, as in scalar_multiply)
+ *   add:    c[i] = a[i] + b[i]          (12 bytes)
+ *   triad:  a[i] = b[i] + scalar * c[i] (12 bytes)
+ *
+ * It repeats them on footprints (the size of all three arrays together)
+ * from one that fits in the L1 cache up to many times the last-level
+ * cache, and prints the best bandwidth of each kernel at each footprint.
+ * The bandwidth at the largest footprints is the main memory bandwidth:
+ * no kernel that streams through large arrays can run faster.
+ *
+ * Variants:
+ *
+ *   plain: ordinary loads and stores, in 4 KiB pages
+ *   nt:    non-temporal ("streaming") stores, which write around the
+ *          caches.  An ordinary store first reads the cache line it writes
+ *          (a "write allocate"), so it really moves the destination twice;
+ *          streaming stores avoid that extra read, but are slow when the
+ *          data would have fit in cache.  (x86 only.)
+ *   huge:  ordinary loads and stores, in 2 MiB pages, which need far fewer
+ *          TLB entries to cover large arrays.  Reserved huge pages
+ *          (MAP_HUGETLB) are used if available, else transparent huge
+ *          pages are requested with madvise.
+ *
+ * The work is divided among t threads, each of which initializes its own
+ * part of the arrays (so that, on a multi-socket machine, that part is
+ * placed in memory near the thread), and the threads synchronize with a
+ * barrier around each timed kernel.  As in STREAM, the bytes counted do
+ * not include write allocates.
+ *
+ * The scalar is -1, so that repeating the four kernels leaves the values
+ * unchanged in magnitude, and the results can be checked exactly.
+ *
+ * To compile: gcc -O2 -o stream_bench stream_bench.c -lpthread
+ *
+ * To run: ./stream_bench <t> <variant> [max_mib]
+ *   t:       number of threads
+ *   variant: plain, nt, huge or all
+ *   max_mib: largest footprint in MiB (default 8 times the LLC size)
+ *
+ *   ./stream_bench 8 all 2048
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MIN_FOOTPRINT (12L << 10) /* smallest footprint: 3 arrays of 4 KiB */
+#define LLC_MULTIPLE 8            /* default largest footprint, in LLCs */
+#define DEFAULT_LLC (32L << 20)   /* LLC size if it cannot be found */
+#define MIN_REPS 10
+#define MAX_REPS 20000
+#define TARGET_BYTES (2L << 30)   /* aim to move this much per kernel */
+#define HUGE_PAGE (2L << 20)
+#define ALIGN_ELEMS 16            /* thread parts start on 64-byte lines */
+
+enum { COPY, SCALE, ADD, TRIAD, NKERNELS };
+static const char *kernel_names[NKERNELS] = { "copy", "scale", "add", "triad" };
+static const int bytes_per_elem[NKERNELS] = { 8, 8, 12, 12 };
+
+enum { V_PLAIN, V_NT, V_HUGE, NVARIANTS };
+static const char *variant_names[NVARIANTS] = { "plain", "nt", "huge" };
+
+/* 4 ints, for non-temporal stores of 16 bytes at a time */
+typedef int v4si __attribute__((vector_size(16)));
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: returns the current time in seconds.  clock_gettime is
+ * used instead of gettimeofday because the kernels on the smallest arrays
+ * take only a few microseconds. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+/* one array allocated with alloc_array */
+struct region {
+    int *data;
+    size_t len;    // length of the mapping
+    int hugetlb;   // 1 if it is in reserved huge pages
+};
+
+/* Allocates an array of bytes bytes for the given variant.  Every array is
+ * page aligned (so also aligned for non-temporal stores). */
+void alloc_array(struct region *r, long bytes, int variant) {
+    r->hugetlb = 0;
+    if (variant == V_HUGE) {
+        r->len = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        r->data = mmap(NULL, r->len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (r->data != MAP_FAILED) {
+            r->hugetlb = 1;
+            return;
+        }
+    } else {
+        r->len = bytes;
+    }
+    r->data = mmap(NULL, r->len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->data == MAP_FAILED) print_error("ERROR: cannot mmap arrays");
+
+    // request (or, for the other variants, rule out) transparent huge
+    // pages, so that the variants differ only where they say they do
+    madvise(r->data, r->len, variant == V_HUGE ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+}
+
+struct t_arg {
+    long id; //thread id
+    long numthreads; //number of threads
+    int *a, *b, *c; //the arrays
+    long length; //elements in each array
+    int variant; //V_PLAIN, V_NT or V_HUGE
+    long reps; //number of timed repetitions
+    double *best; //best time of each kernel (written by thread 0)
+};
+
+pthread_barrier_t barrier; //global declaration of barrier, initialized in main()
+
+/* ordinary version of a kernel, on elements start to end-1 */
+void run_kernel(int k, int *a, int *b, int *c, int scalar, long start, long end) {
+    long i;
+    switch (k) {
+        case COPY:
+            for (i = start; i < end; i++) c[i] = a[i];
+            break;
+        case SCALE:
+            for (i = start; i < end; i++) b[i] = scalar * c[i];
+            break;
+        case ADD:
+            for (i = start; i < end; i++) c[i] = a[i] + b[i];
+            break;
+        case TRIAD:
+            for (i = start; i < end; i++) a[i] = b[i] + scalar * c[i];
+            break;
+    }
+}
+
+#ifdef __SSE2__
+/* non-temporal version of a kernel: the results are computed 4 at a time
+ * and stored with _mm_stream_si128, which writes around the caches.  start
+ * must be a multiple of 4, and the arrays 16-byte aligned. */
+void run_kernel_nt(int k, int *a, int *b, int *c, int scalar, long start, long end) {
+    long i;
+    v4si s = { scalar, scalar, scalar, scalar };
+    v4si *va = (v4si *)a, *vb = (v4si *)b, *vc = (v4si *)c;
+    long vend = start + (end - start) / 4 * 4;
+
+    for (i = start / 4; i < vend / 4; i++) {
+        switch (k) {
+            case COPY:  _mm_stream_si128((__m128i *)&vc[i], (__m128i)va[i]); break;
+            case SCALE: _mm_stream_si128((__m128i *)&vb[i], (__m128i)(s * vc[i])); break;
+            case ADD:   _mm_stream_si128((__m128i *)&vc[i], (__m128i)(va[i] + vb[i])); break;
+            case TRIAD: _mm_stream_si128((__m128i *)&va[i], (__m128i)(vb[i] + s * vc[i])); break;
+        }
+    }
+    run_kernel(k, a, b, c, scalar, vend, end); // the last few elements
+    _mm_sfence(); // make the streaming stores visible before the barrier
+}
+#endif
+
+/* The thread function: initializes this thread's part of the arrays, then
+ * runs every kernel reps times (plus one untimed warm-up), with a barrier
+ * before and after each so that thread 0 can time all threads together. */
+void *stream(void *args) {
+    //extract arguments
+    struct t_arg *myargs = (struct t_arg *)args;
+    long myid = myargs->id;
+    long nthreads = myargs->numthreads;
+    long length = myargs->length;
+    int *a = myargs->a, *b = myargs->b, *c = myargs->c;
+    int scalar = -1;
+    long i, rep;
+    int k;
+    double t;
+
+    //assign work to the thread, in whole cache lines
+    long blocks = length / ALIGN_ELEMS;
+    long start = blocks * myid / nthreads * ALIGN_ELEMS;
+    long end = blocks * (myid + 1) / nthreads * ALIGN_ELEMS;
+    if (myid == nthreads - 1) {
+        end = length;
+    }
+
+    //first touch: this thread's part is placed near this thread
+    for (i = start; i < end; i++) {
+        a[i] = 1;
+        b[i] = 2;
+        c[i] = 0;
+    }
+
+    for (rep = 0; rep <= myargs->reps; rep++) {
+        for (k = 0; k < NKERNELS; k++) {
+            pthread_barrier_wait(&barrier);
+            t = now();
+#ifdef __SSE2__
+            if (myargs->variant == V_NT) {
+                run_kernel_nt(k, a, b, c, scalar, start, end);
+            } else
+#endif
+            run_kernel(k, a, b, c, scalar, start, end);
+            pthread_barrier_wait(&barrier);
+            t = now() - t;
+            //rep 0 is a warm-up, and is not timed
+            if (myid == 0 && rep > 0 && t < myargs->best[k]) {
+                myargs->best[k] = t;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Checks the arrays after reps+1 repetitions of the kernels, by doing the
+ * same arithmetic on single values.  Returns the number of wrong elements. */
+long check(int *a, int *b, int *c, long length, long reps) {
+    int aj = 1, bj = 2, cj = 0, scalar = -1;
+    long i, rep, errors = 0;
+
+    for (rep = 0; rep <= reps; rep++) {
+        cj = aj;
+        bj = scalar * cj;
+        cj = aj + bj;
+        aj = bj + scalar * cj;
+    }
+    for (i = 0; i < length; i++) {
+        if (a[i] != aj || b[i] != bj || c[i] != cj) errors++;
+    }
+    return errors;
+}
+
+/* Runs all four kernels on arrays of length elements with nthreads threads,
+ * and fills in the best time of each.  Returns the number of elements with
+ * wrong results; *hugetlb is set to 1 if reserved huge pages were used. */
+long run_footprint(long length, long nthreads, int variant, double *best, int *hugetlb) {
+    struct region ra, rb, rc;
+    long t, reps, errors;
+    int k, ret;
+
+    alloc_array(&ra, length * sizeof(int), variant);
+    alloc_array(&rb, length * sizeof(int), variant);
+    alloc_array(&rc, length * sizeof(int), variant);
+    *hugetlb = ra.hugetlb && rb.hugetlb && rc.hugetlb;
+
+    //enough repetitions to move about TARGET_BYTES per kernel
+    reps = TARGET_BYTES / (3 * length * sizeof(int));
+    if (reps < MIN_REPS) reps = MIN_REPS;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    for (k = 0; k < NKERNELS; k++) best[k] = 1e30;
+
+    //allocate threads and args array
+    pthread_t *thread_array = malloc(nthreads * sizeof(pthread_t));
+    struct t_arg *thread_args = malloc(nthreads * sizeof(struct t_arg));
+    if (!thread_array || !thread_args) print_error("ERROR: cannot malloc");
+
+    ret = pthread_barrier_init(&barrier, NULL, nthreads);
+    if (ret) print_error("ERROR: pthread_barrier_init failed");
+
+    for (t = 0; t < nthreads; t++) {
+        thread_args[t].id = t;
+        thread_args[t].numthreads = nthreads;
+        thread_args[t].a = ra.data;
+        thread_args[t].b = rb.data;
+        thread_args[t].c = rc.data;
+        thread_args[t].length = length;
+        thread_args[t].variant = variant;
+        thread_args[t].reps = reps;
+        thread_args[t].best = best;
+    }
+    for (t = 0; t < nthreads; t++) {
+        ret = pthread_create(&thread_array[t], NULL, stream, &thread_args[t]);
+        if (ret) print_error("ERROR: pthread_create failed");
+    }
+    for (t = 0; t < nthreads; t++) {
+        ret = pthread_join(thread_array[t], NULL);
+        if (ret) print_error("ERROR: pthread_join failed");
+    }
+    pthread_barrier_destroy(&barrier);
+
+    errors = check(ra.data, rb.data, rc.data, length, reps);
+
+    free(thread_array);
+    free(thread_args);
+    munmap(ra.data, ra.len);
+    munmap(rb.data, rb.len);
+    munmap(rc.data, rc.len);
+    return errors;
+}
+
+/* helper function: returns the size in bytes of the last-level cache */
+long llc_size(void) {
+    long size = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return size > 0 ? size : DEFAULT_LLC;
+}
+
+int main(int argc, char **argv) {
+    int v, k, first_variant, last_variant, hugetlb;
+    long nthreads, max_footprint, footprint, errors = 0;
+    double best[NKERNELS], last_triad = 0;
+
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s <t> <variant> [max_mib]\n", argv[0]);
+        fprintf(stderr, "where <t> is the number of threads\n");
+        fprintf(stderr, "and <variant> is plain, nt, huge or all\n");
+        fprintf(stderr, "and [max_mib] is the largest footprint in MiB "
+                        "(default %d times the LLC)\n", LLC_MULTIPLE);
+        return 1;
+    }
+
+    nthreads = strtol(argv[1], NULL, 10);
+    if (nthreads < 1) print_error("ERROR: nthreads needs to be at least 1");
+
+    if (strcmp(argv[2], "all") == 0) {
+        first_variant = 0;
+        last_variant = NVARIANTS - 1;
+    } else {
+        for (v = 0; v < NVARIANTS; v++) {
+            if (strcmp(argv[2], variant_names[v]) == 0) break;
+        }
+        if (v == NVARIANTS) print_error("ERROR: variant must be plain, nt, huge or all");
+        first_variant = last_variant = v;
+    }
+#ifndef __SSE2__
+    if (first_variant <= V_NT && last_variant >= V_NT) {
+        print_error("ERROR: the nt variant needs x86 SSE2 streaming stores");
+    }
+#endif
+
+    max_footprint = argc == 4 ? strtol(argv[3], NULL, 10) << 20
+                              : LLC_MULTIPLE * llc_size();
+    if (max_footprint < MIN_FOOTPRINT) print_error("ERROR: max_mib is too small");
+
+    printf("%ld threads, L1d %ld KiB, L2 %ld KiB, LLC %ld KiB\n", nthreads,
+           sysconf(_SC_LEVEL1_DCACHE_SIZE) >> 10, sysconf(_SC_LEVEL2_CACHE_SIZE) >> 10,
+           llc_size() >> 10);
+
+    for (v = first_variant; v <= last_variant; v++) {
+        printf("\n%s: best bandwidth in GB/s\n", variant_names[v]);
+        printf("%14s", "footprint KiB");
+        for (k = 0; k < NKERNELS; k++) printf(" %10s", kernel_names[k]);
+        printf("\n");
+
+        for (footprint = MIN_FOOTPRINT; footprint <= max_footprint; footprint *= 2) {
+            long length = footprint / 3 / sizeof(int);
+            errors += run_footprint(length, nthreads, v, best, &hugetlb);
+            printf("%14ld", footprint >> 10);
+            for (k = 0; k < NKERNELS; k++) {
+                printf(" %10.2f", (double)bytes_per_elem[k] * length / best[k] / 1e9);
+            }
+            if (v == V_HUGE && !hugetlb) printf("  (THP)");
+            printf("\n");
+            fflush(stdout);
+            last_triad = (double)bytes_per_elem[TRIAD] * length / best[TRIAD] / 1e9;
+        }
+        printf("%s memory bandwidth (triad, largest footprint): %.2f GB/s\n",
+               variant_names[v], last_triad);
+    }
+
+    if (errors) {
+        printf("ERROR: %ld wrong results\n", errors);
+        return 1;
+    }
+    return 0;
+}
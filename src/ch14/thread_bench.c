@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Measures how long the basic thread operations take, to show how much
+ * work a parallel task needs to do before creating threads for it, or
+ * synchronizing them, is worth it:
+ *
+ *   create+join:      pthread_create and pthread_join of a thread that does
+ *                     nothing (as hellothreads.c does)
+ *   mutex uncontended: pthread_mutex_lock and unlock, by one thread
+ *   mutex contended:  how long each pthread_mutex_lock takes when t threads
+ *                     all increment a shared counter under the mutex
+ *   condvar pingpong: two threads taking turns, waiting on a condition
+ *                     variable for the other (as the chickens and farmers
+ *                     of layeggs.c do); the time for one round trip
+ *   futex wake:       from one thread calling FUTEX_WAKE until a thread
+ *                     asleep in FUTEX_WAIT runs again (the operation mutexes
+ *                     and condition variables use to wake a waiting thread)
+ *   pthread_barrier:  the time between consecutive barriers of t threads
+ *                     that do nothing else
+ *   spin barrier:     the same for a sense-reversing barrier, in which the
+ *                     threads spin instead of sleeping in the kernel (and
+ *                     yield the CPU if they spin for long, in case there
+ *                     are more threads than CPUs)
+ *
+ * Each is measured many times, and the median, 90th and 99th percentile
+ * and maximum times are printed.  Times include reading the clock, about
+ * 20-50 ns, except for mutex uncontended, which is timed in batches.
+ *
+ * If an output directory is given, the results are also written to the
+ * file thread_bench-<hostname>.csv in it, so results from several machines
+ * can be kept side by side.
+ *
+ * To compile: gcc -O2 -o thread_bench thread_bench.c -pthread
+ *
+ * To run: ./thread_bench <max_threads> [outdir]
+ *   max_threads: the most threads for the contended mutex and the barriers
+ *                (run at 1, 2, 4, ... and max_threads threads), at most
+ *                NSAMPLES
+ *   outdir:      where to write the CSV file
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define NSAMPLES 10000    /* samples of each operation (per thread count) */
+#define NCREATE 2000      /* samples of create+join */
+#define BATCH 100         /* uncontended lock/unlock pairs timed together */
+#define SPIN_LIMIT 1000   /* spins before a spin barrier yields the CPU */
+#define HOST_LEN 256
+
+FILE *csv;              // the CSV output file, or NULL
+char host[HOST_LEN];
+
+/*error handling function: prints out error message*/
+int print_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(2);
+}
+
+/* helper function: returns the current time in ns */
+long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+long *alloc_samples(long n) {
+    long *samples = malloc(n * sizeof(long));
+    if (samples == NULL) print_error("ERROR: malloc failed");
+    return samples;
+}
+
+/* comparison function for qsort */
+int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* sorts the n samples (in ns) of benchmark name at t threads, and prints
+ * their percentiles, to the screen and to the CSV file */
+void report(const char *name, int t, long *samples, long n) {
+    long p50, p90, p99, max;
+    qsort(samples, n, sizeof(long), cmp_long);
+    p50 = samples[n / 2];
+    p90 = samples[n * 90 / 100];
+    p99 = samples[n * 99 / 100];
+    max = samples[n - 1];
+    printf("%-18s %7d %8ld %10ld %10ld %10ld %10ld\n", name, t, n, p50, p90, p99, max);
+    fflush(stdout);
+    if (csv) {
+        fprintf(csv, "%s,%s,%d,%ld,%ld,%ld,%ld,%ld\n", host, name, t, n, p50, p90,
+                p99, max);
+    }
+}
+
+/* creates t threads running func on args[i], and joins them */
+void run_threads(int t, void *(*func)(void *), void *args, size_t arg_size) {
+    pthread_t *threads = malloc(t * sizeof(pthread_t));
+    int i;
+    if (threads == NULL) print_error("ERROR: malloc failed");
+    for (i = 0; i < t; i++) {
+        if (pthread_create(&threads[i], NULL, func, (char *)args + i * arg_size)) {
+            print_error("ERROR: pthread_create failed");
+        }
+    }
+    for (i = 0; i < t; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/******** create+join ************/
+
+void *do_nothing(void *arg) {
+    return arg;
+}
+
+void bench_create(void) {
+    long *samples = alloc_samples(NCREATE);
+    pthread_t thread;
+    long i, start;
+    for (i = 0; i < NCREATE; i++) {
+        start = now_ns();
+        if (pthread_create(&thread, NULL, do_nothing, NULL)) {
+            print_error("ERROR: pthread_create failed");
+        }
+        pthread_join(thread, NULL);
+        samples[i] = now_ns() - start;
+    }
+    report("create+join", 1, samples, NCREATE);
+    free(samples);
+}
+
+/******** mutexes ************/
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_barrier_t start_barrier;
+long counter;
+
+void bench_mutex_uncontended(void) {
+    long *samples = alloc_samples(NSAMPLES);
+    long i, j, start;
+    for (i = 0; i < NSAMPLES; i++) {
+        start = now_ns();
+        for (j = 0; j < BATCH; j++) {
+            pthread_mutex_lock(&mutex);
+            counter++;
+            pthread_mutex_unlock(&mutex);
+        }
+        samples[i] = (now_ns() - start) / BATCH;
+    }
+    report("mutex uncontended", 1, samples, NSAMPLES);
+    free(samples);
+}
+
+struct t_arg {
+    long id; //thread id
+    long nthreads; //number of threads
+    long nsamples; //samples this thread takes
+    long *samples; //where it stores them
+};
+
+void *contend(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long i, start;
+    pthread_barrier_wait(&start_barrier);
+    for (i = 0; i < myargs->nsamples; i++) {
+        start = now_ns();
+        pthread_mutex_lock(&mutex);
+        myargs->samples[i] = now_ns() - start;
+        counter++;
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+void bench_mutex_contended(int t) {
+    long *samples = alloc_samples(NSAMPLES);
+    struct t_arg *args = malloc(t * sizeof(struct t_arg));
+    long i, per_thread = NSAMPLES / t;
+    if (args == NULL) print_error("ERROR: malloc failed");
+
+    pthread_barrier_init(&start_barrier, NULL, t);
+    for (i = 0; i < t; i++) {
+        args[i].id = i;
+        args[i].nthreads = t;
+        args[i].nsamples = per_thread;
+        args[i].samples = samples + i * per_thread;
+    }
+    run_threads(t, contend, args, sizeof(struct t_arg));
+    pthread_barrier_destroy(&start_barrier);
+    report("mutex contended", t, samples, per_thread * t);
+    free(args);
+    free(samples);
+}
+
+/******** condition variable ping-pong ************/
+
+pthread_cond_t turn_cond = PTHREAD_COND_INITIALIZER;
+int turn; //0: the main thread's turn, 1: the partner's, 2: the partner quits
+
+void *partner(void *arg) {
+    pthread_mutex_lock(&mutex);
+    while (1) {
+        while (turn == 0) {
+            pthread_cond_wait(&turn_cond, &mutex);
+        }
+        if (turn == 2) break;
+        turn = 0;
+        pthread_cond_signal(&turn_cond);
+    }
+    pthread_mutex_unlock(&mutex);
+    return arg;
+}
+
+void bench_condvar(void) {
+    long *samples = alloc_samples(NSAMPLES);
+    pthread_t thread;
+    long i, start;
+
+    turn = 0;
+    if (pthread_create(&thread, NULL, partner, NULL)) {
+        print_error("ERROR: pthread_create failed");
+    }
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < NSAMPLES; i++) {
+        start = now_ns();
+        turn = 1;
+        pthread_cond_signal(&turn_cond);
+        while (turn != 0) {
+            pthread_cond_wait(&turn_cond, &mutex);
+        }
+        samples[i] = now_ns() - start;
+    }
+    turn = 2;
+    pthread_cond_signal(&turn_cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    report("condvar pingpong", 2, samples, NSAMPLES);
+    free(samples);
+}
+
+/******** futex wake ************/
+
+uint32_t futex_word; //1 when the sleeper should wake
+int armed;           //1 when the sleeper is about to sleep
+long wake_time;      //when the waker called FUTEX_WAKE
+long *wake_samples;
+
+void *sleeper(void *arg) {
+    long i;
+    for (i = 0; i < NSAMPLES; i++) {
+        __atomic_store_n(&armed, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&futex_word, __ATOMIC_ACQUIRE) == 0) {
+            syscall(SYS_futex, &futex_word, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+        }
+        wake_samples[i] = now_ns() - wake_time;
+        __atomic_store_n(&futex_word, 0, __ATOMIC_RELEASE);
+    }
+    return arg;
+}
+
+void bench_futex(void) {
+    struct timespec pause = { 0, 20000 }; //20 us
+    pthread_t thread;
+    long i;
+
+    wake_samples = alloc_samples(NSAMPLES);
+    futex_word = 0;
+    armed = 0;
+    if (pthread_create(&thread, NULL, sleeper, NULL)) {
+        print_error("ERROR: pthread_create failed");
+    }
+    for (i = 0; i < NSAMPLES; i++) {
+        // wait until the sleeper is going to sleep, then give it time to
+        // get there, so the wake-up has a sleeping thread to wake
+        while (!__atomic_load_n(&armed, __ATOMIC_SEQ_CST)) sched_yield();
+        __atomic_store_n(&armed, 0, __ATOMIC_RELAXED);
+        nanosleep(&pause, NULL);
+        wake_time = now_ns();
+        __atomic_store_n(&futex_word, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        // and until it is awake, before the next round
+        while (__atomic_load_n(&futex_word, __ATOMIC_ACQUIRE) != 0) sched_yield();
+    }
+    pthread_join(thread, NULL);
+    report("futex wake", 2, wake_samples, NSAMPLES);
+    free(wake_samples);
+}
+
+/******** barriers ************/
+
+/* A sense-reversing barrier: each thread flips its own sense, and waits
+ * for the barrier's sense to match it.  The last thread to arrive resets
+ * the count and flips the barrier's sense, releasing the others.  Since
+ * the sense alternates, a fast thread that reaches the next barrier early
+ * cannot be let through by the previous one. */
+struct spin_barrier {
+    int count;  //threads still to arrive
+    int sense;
+    int n;
+};
+
+void spin_barrier_wait(struct spin_barrier *b, int *my_sense) {
+    int spins = 0;
+    *my_sense = !*my_sense;
+    if (__atomic_sub_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_store_n(&b->count, b->n, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->sense, *my_sense, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) != *my_sense) {
+            if (++spins == SPIN_LIMIT) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+pthread_barrier_t bench_barrier;
+struct spin_barrier spin;
+int use_spin; //1 to time the spin barrier, 0 for pthread_barrier
+
+void *barrier_loop(void *args) {
+    struct t_arg *myargs = (struct t_arg *)args;
+    long i, last = 0, t;
+    int my_sense = 0;
+    for (i = 0; i <= myargs->nsamples; i++) {
+        if (use_spin) {
+            spin_barrier_wait(&spin, &my_sense);
+        } else {
+            pthread_barrier_wait(&bench_barrier);
+        }
+        // thread 0 times each barrier from the end of the one before
+        if (myargs->id == 0) {
+            t = now_ns();
+            if (i > 0) myargs->samples[i - 1] = t - last;
+            last = t;
+        }
+    }
+    return NULL;
+}
+
+void bench_barrier_at(int t, int spinning) {
+    long *samples = alloc_samples(NSAMPLES);
+    struct t_arg *args = malloc(t * sizeof(struct t_arg));
+    int i;
+    if (args == NULL) print_error("ERROR: malloc failed");
+
+    use_spin = spinning;
+    pthread_barrier_init(&bench_barrier, NULL, t);
+    spin.count = spin.n = t;
+    spin.sense = 0;
+    for (i = 0; i < t; i++) {
+        args[i].id = i;
+        args[i].nthreads = t;
+        args[i].nsamples = NSAMPLES;
+        args[i].samples = samples;
+    }
+    run_threads(t, barrier_loop, args, sizeof(struct t_arg));
+    pthread_barrier_destroy(&bench_barrier);
+    report(spinning ? "spin barrier" : "pthread_barrier", t, samples, NSAMPLES);
+    free(args);
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    char path[1024];
+    int max_threads, t;
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <max_threads> [outdir]\n", argv[0]);
+        fprintf(stderr, "where <max_threads> is the most threads to run\n");
+        fprintf(stderr, "and [outdir] is where to write thread_bench-<hostname>.csv\n");
+        return 1;
+    }
+    max_threads = strtol(argv[1], NULL, 10);
+    if (max_threads < 1) print_error("ERROR: max_threads must be at least 1");
+    //the contended mutex divides NSAMPLES among the threads
+    if (max_threads > NSAMPLES) {
+        fprintf(stderr, "ERROR: max_threads must be at most %d\n", NSAMPLES);
+        exit(2);
+    }
+
+    gethostname(host, HOST_LEN);
+    host[HOST_LEN - 1] = '\0';
+    if (argc == 3) {
+        snprintf(path, sizeof(path), "%s/thread_bench-%s.csv", argv[2], host);
+        csv = fopen(path, "w");
+        if (csv == NULL) print_error("ERROR: cannot create the CSV file");
+        fprintf(csv, "host,benchmark,threads,samples,p50_ns,p90_ns,p99_ns,max_ns\n");
+    }
+
+    printf("host %s, %ld CPUs online\n", host, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-18s %7s %8s %10s %10s %10s %10s\n", "benchmark (ns)", "threads",
+           "samples", "p50", "p90", "p99", "max");
+
+    bench_create();
+    bench_mutex_uncontended();
+    for (t = 1; ; t = (t * 2 < max_threads) ? t * 2 : max_threads) {
+        bench_mutex_contended(t);
+        if (t == max_threads) break;
+    }
+    bench_condvar();
+    bench_futex();
+    for (t = 1; ; t = (t * 2 < max_threads) ? t * 2 : max_threads) {
+        bench_barrier_at(t, 0);
+        bench_barrier_at(t, 1);
+        if (t == max_threads) break;
+    }
+
+    if (csv) {
+        fclose(csv);
+        printf("results written to %s\n", path);
+    }
+    return 0;
+}
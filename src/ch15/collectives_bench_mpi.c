@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Micro-benchmark for the MPI collective operations used by the boss/worker
+ * examples (MPI_Bcast, MPI_Scatter, MPI_Gather) and by the distributed
+ * sorts (MPI_Allreduce, MPI_Alltoallv).
+ *
+ * For every collective, message size (powers of two from 4 bytes up to a
+ * maximum, 1 GiB by default) and number of processes (2, 4, ... up to all
+ * of them), it times many repetitions of the operation and prints:
+ *
+ *   - the minimum, median (p50), p90 and p99 latency.  The latency of one
+ *     repetition is the time the slowest process spent in the call, with
+ *     all processes starting together after a barrier.
+ *   - the bandwidth, message size divided by median latency
+ *
+ * The "message size" is the size of each process's buffer piece: the whole
+ * buffer for Bcast and Allreduce, each process's piece for Scatter and
+ * Gather, and the block sent to each other process for Alltoallv.
+ *
+ * Sizes whose buffers would need more than MEM_LIMIT bytes on one process
+ * are skipped, and max_bytes may be at most INT_MAX, since MPI counts are
+ * ints.  While the first q processes are measured, the rest wait asleep
+ * (see idle_wait), so they do not take CPU time from them.  The output is
+ * one line per measurement, each starting with the host name (of rank 0),
+ * so results from different machines can be saved, concatenated and
+ * compared.
+ *
+ * To compile: mpicc -O2 -o collectives_bench_mpi collectives_bench_mpi.c
+ *
+ * To run: mpirun -np <p> ./collectives_bench_mpi [max_bytes]
+ *   mpirun -np 8 ./collectives_bench_mpi > bench-$(hostname).txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include "mpi.h"
+
+#define MIN_BYTES 4
+#define MAX_BYTES (1L << 30)
+#define MEM_LIMIT (4L << 30)   /* largest buffer total per process */
+#define WARMUP 2               /* untimed repetitions before timing */
+#define MIN_ITERS 5
+#define MAX_ITERS 1000
+#define ITER_BYTES (64L << 20) /* aim to move this much per measurement */
+#define IDLE_SLEEP 1000        /* microseconds between checks in idle_wait */
+
+enum { BCAST, SCATTER, GATHER, ALLREDUCE, ALLTOALLV, NCOLL };
+static const char *coll_names[NCOLL] = {
+    "Bcast", "Scatter", "Gather", "Allreduce", "Alltoallv"
+};
+
+/* buffers and arguments for one collective at one size */
+struct bench {
+    int coll;
+    long size;            /* message size in bytes (a multiple of 4) */
+    char *sendbuf, *recvbuf;
+    int *counts, *displs; /* for Alltoallv, in ints */
+};
+
+/* returns the number of bytes one process needs to run coll at size with
+ * p processes */
+long bytes_needed(int coll, long size, int p) {
+    switch (coll) {
+        case BCAST:     return size;
+        case SCATTER:   /* the root's send buffer holds all the pieces */
+        case GATHER:    return size * (p + 1);
+        case ALLREDUCE: return 2 * size;
+        case ALLTOALLV: return 2 * size * p;
+    }
+    return 0;
+}
+
+/* allocates buffers for b; returns 0 on success, -1 if the size is too
+ * large to run */
+int setup(struct bench *b, int p) {
+    long n = b->size / sizeof(int), j;
+
+    b->sendbuf = b->recvbuf = NULL;
+    b->counts = b->displs = NULL;
+    if (bytes_needed(b->coll, b->size, p) > MEM_LIMIT) return -1;
+    if (b->coll == ALLTOALLV && n * p > INT_MAX) return -1; /* int displs */
+
+    b->sendbuf = calloc(1, bytes_needed(b->coll, b->size, p));
+    if (b->sendbuf == NULL) return -1;
+    /* the receive buffer follows the send buffer where one is needed */
+    switch (b->coll) {
+        case SCATTER:   b->recvbuf = b->sendbuf + b->size * p; break;
+        case GATHER:    b->recvbuf = b->sendbuf + b->size; break;
+        case ALLREDUCE: b->recvbuf = b->sendbuf + b->size; break;
+        case ALLTOALLV: b->recvbuf = b->sendbuf + b->size * p; break;
+    }
+
+    if (b->coll == ALLTOALLV) {
+        b->counts = malloc(p * sizeof(int));
+        b->displs = malloc(p * sizeof(int));
+        if (b->counts == NULL || b->displs == NULL) return -1;
+        for (j = 0; j < p; j++) {
+            b->counts[j] = n;
+            b->displs[j] = j * n;
+        }
+    }
+    return 0;
+}
+
+void cleanup(struct bench *b) {
+    free(b->sendbuf);
+    free(b->counts);
+    free(b->displs);
+}
+
+/* runs the collective once */
+void run_once(struct bench *b, MPI_Comm comm) {
+    int n = b->size / sizeof(int);
+    switch (b->coll) {
+        case BCAST:
+            MPI_Bcast(b->sendbuf, b->size, MPI_BYTE, 0, comm);
+            break;
+        case SCATTER:
+            MPI_Scatter(b->sendbuf, b->size, MPI_BYTE, b->recvbuf, b->size,
+                        MPI_BYTE, 0, comm);
+            break;
+        case GATHER:
+            MPI_Gather(b->sendbuf, b->size, MPI_BYTE, b->recvbuf, b->size,
+                       MPI_BYTE, 0, comm);
+            break;
+        case ALLREDUCE:
+            MPI_Allreduce(b->sendbuf, b->recvbuf, n, MPI_INT, MPI_SUM, comm);
+            break;
+        case ALLTOALLV:
+            MPI_Alltoallv(b->sendbuf, b->counts, b->displs, MPI_INT,
+                          b->recvbuf, b->counts, b->displs, MPI_INT, comm);
+            break;
+    }
+}
+
+/* Waits until every process in comm has called idle_wait, as in
+ * countSort_mpi.c: an MPI_Ibarrier checked every IDLE_SLEEP microseconds,
+ * so a process left out of a measurement sleeps instead of spinning in
+ * MPI_Comm_split. */
+void idle_wait(MPI_Comm comm) {
+    MPI_Request req;
+    int done = 0;
+
+    MPI_Ibarrier(comm, &req);
+    while (1) {
+        MPI_Test(&req, &done, MPI_STATUS_IGNORE);
+        if (done) break;
+        usleep(IDLE_SLEEP);
+    }
+}
+
+/* comparison function for qsort */
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* returns the q-th percentile (0-100) of n sorted values */
+double percentile(double *sorted, int n, double q) {
+    int i = (int)(q / 100.0 * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+/* Times iters repetitions of b on comm.  On rank 0 of comm, lat is filled
+ * with the slowest process's time for each repetition, sorted. */
+void measure(struct bench *b, MPI_Comm comm, int iters, double *mine, double *lat) {
+    int i, rank;
+    double start;
+
+    MPI_Comm_rank(comm, &rank);
+    for (i = 0; i < WARMUP; i++) {
+        run_once(b, comm);
+    }
+    for (i = 0; i < iters; i++) {
+        MPI_Barrier(comm);
+        start = MPI_Wtime();
+        run_once(b, comm);
+        mine[i] = MPI_Wtime() - start;
+    }
+    MPI_Reduce(mine, lat, iters, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank == 0) {
+        qsort(lat, iters, sizeof(double), cmp_double);
+    }
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, q, c, iters, skip;
+    long size, max_bytes = MAX_BYTES;
+    char hostname[256];
+    double *mine, *lat;
+    MPI_Comm comm;
+    struct bench b;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc == 2) {
+        max_bytes = strtol(argv[1], NULL, 10);
+    }
+    if (argc > 2 || max_bytes < MIN_BYTES || max_bytes > INT_MAX) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s [max_bytes]\n", argv[0]);
+            fprintf(stderr, "where %d <= [max_bytes] <= %d is the largest message size\n",
+                    MIN_BYTES, INT_MAX);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    gethostname(hostname, sizeof(hostname));
+    hostname[sizeof(hostname) - 1] = '\0';
+    mine = malloc(MAX_ITERS * sizeof(double));
+    lat = malloc(MAX_ITERS * sizeof(double));
+    if (mine == NULL || lat == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (rank == 0) {
+        printf("# host %s, %d processes\n", hostname, process_count);
+        printf("# %-14s %-10s %5s %11s %6s %11s %11s %11s %11s %11s\n", "host",
+               "collective", "procs", "bytes", "iters", "min (us)", "p50 (us)", "p90 (us)",
+               "p99 (us)", "MB/s");
+    }
+
+    /* q = 2, 4, ... processes, ending with all of them */
+    for (q = process_count > 1 ? 2 : 1; ; q = (q * 2 < process_count) ? q * 2 : process_count) {
+        MPI_Comm_split(MPI_COMM_WORLD, rank < q, rank, &comm);
+
+        if (rank < q) {
+            for (c = 0; c < NCOLL; c++) {
+                for (size = MIN_BYTES; size <= max_bytes; size *= 2) {
+                    b.coll = c;
+                    b.size = size;
+
+                    /* every process must agree on whether to skip */
+                    skip = setup(&b, q) != 0;
+                    MPI_Allreduce(MPI_IN_PLACE, &skip, 1, MPI_INT, MPI_MAX, comm);
+                    if (skip) {
+                        cleanup(&b);
+                        if (rank == 0) {
+                            printf("  %-14s %-10s %5d %11ld   (skipped: buffers too large)\n",
+                                   hostname, coll_names[c], q, size);
+                        }
+                        break; /* larger sizes will not fit either */
+                    }
+
+                    iters = ITER_BYTES / size;
+                    if (iters < MIN_ITERS) iters = MIN_ITERS;
+                    if (iters > MAX_ITERS) iters = MAX_ITERS;
+
+                    measure(&b, comm, iters, mine, lat);
+                    cleanup(&b);
+
+                    if (rank == 0) {
+                        double p50 = percentile(lat, iters, 50);
+                        printf("  %-14s %-10s %5d %11ld %6d %11.2f %11.2f %11.2f %11.2f %11.2f\n",
+                               hostname, coll_names[c], q, size, iters, lat[0] * 1e6,
+                               p50 * 1e6, percentile(lat, iters, 90) * 1e6,
+                               percentile(lat, iters, 99) * 1e6,
+                               size / p50 / 1e6);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+        //everyone meets here before the next split, those not measured asleep
+        idle_wait(MPI_COMM_WORLD);
+        MPI_Comm_free(&comm);
+        if (q == process_count) break;
+    }
+
+    free(mine);
+    free(lat);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Distributed CountSort (see ch14/countSort.c) with MPI.
+ *
+ * The array is never held by a single process.  Each process owns a shard
+ * of it and:
+ *
+ *   1. counts the values in its shard with countElems, as in countSort.c
+ *   2. adds up every process's counts with MPI_Allreduce, so every process
+ *      knows how many times each value appears in the whole array
+ *   3. uses MPI_Exscan on the shard sizes to find where its shard starts
+ *      in the whole array, and overwrites its shard with the values that
+ *      belong at those positions of the sorted array
+ *
+ * Only MAX counts and one shard size are communicated per process, so the
+ * sort works on arrays much larger than one node's memory.
+ *
+ * To measure scaling, the program repeats the sort on 1, 2, 4, ... and
+ * finally all of the processes, using a communicator of just those
+ * processes.  In strong scaling, the total array size stays the same; in
+ * weak scaling, each process's shard size stays the same.  The processes
+ * left out of a run wait for it to end while asleep (see idle_wait), so
+ * they do not take CPU time from the processes being timed.
+ *
+ * To compile: mpicc -O2 -o countSort_mpi countSort_mpi.c
+ *
+ * To run: mpirun -np <p> ./countSort_mpi <n> <strong|weak>
+ *   n: total array size (strong) or shard size per process (weak)
+ *
+ *   mpirun -np 8 ./countSort_mpi 400000000 strong
+ *   mpirun -np 8 ./countSort_mpi 50000000 weak
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mpi.h"
+
+#define MAX 10 //the maximum value of an element. (10 means 0-9)
+#define IDLE_SLEEP 1000 //microseconds between checks in idle_wait
+
+/* helper function: genRandomShard
+ * fills a shard of specified length with random values from 0 to MAX-1.
+ * Each process uses its own seed, so the shards are different. */
+void genRandomShard(int *array, long length, unsigned int seed) {
+    long i;
+    for (i = 0; i < length; i++) {
+        array[i] = rand_r(&seed) % MAX;
+    }
+}
+
+/*step 1: compute the frequency of all the elements in this shard (as in
+ * countSort.c, but with long counts) */
+void countElems(long *counts, int *array_A, long length) {
+    long i;
+    int val;
+    for (i = 0; i < length; i++) {
+        val = array_A[i]; //read the value at index i
+        counts[val] = counts[val] + 1; //update corresponding location in counts
+    }
+}
+
+/* step 3: overwrite this shard, which holds positions start to
+ * start+length-1 of the whole array, with the values that belong at those
+ * positions of the sorted array.  counts are the global counts. */
+void writeShard(long *counts, int *array_A, long start, long length) {
+    long pos = 0, first, last, j;
+    int i;
+
+    for (i = 0; i < MAX; i++) {
+        //value i occupies global positions pos to pos+counts[i]-1
+        first = pos > start ? pos : start;
+        last = pos + counts[i] < start + length ? pos + counts[i] : start + length;
+        for (j = first; j < last; j++) {
+            array_A[j - start] = i;
+        }
+        pos += counts[i];
+    }
+}
+
+/* checks that the sorted shards form one sorted array: each shard must be
+ * sorted, and must start with a value no smaller than the last value of
+ * the previous shard.  Returns the number of problems found (on all
+ * processes). */
+long verify(MPI_Comm comm, int *array, long length, long *counts, long total) {
+    int rank, size;
+    long j, errors = 0, sum = 0;
+    int prev_last = -1, my_last;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    for (j = 1; j < length; j++) {
+        if (array[j - 1] > array[j]) errors++;
+    }
+    //a shard may be empty, so pass along the last value seen so far
+    my_last = length > 0 ? array[length - 1] : -1;
+    if (rank > 0) {
+        MPI_Recv(&prev_last, 1, MPI_INT, rank - 1, 0, comm, MPI_STATUS_IGNORE);
+        if (length > 0 && array[0] < prev_last) errors++;
+        if (length == 0) my_last = prev_last;
+    }
+    if (rank < size - 1) {
+        MPI_Send(&my_last, 1, MPI_INT, rank + 1, 0, comm);
+    }
+
+    //every element must have been counted exactly once
+    for (j = 0; j < MAX; j++) sum += counts[j];
+    if (sum != total) errors++;
+
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_SUM, comm);
+    return errors;
+}
+
+/* Waits until every process in comm has called idle_wait.  MPI's blocking
+ * calls (MPI_Barrier, and MPI_Comm_split) usually spin while they wait, so a
+ * process waiting in one for a run it is not part of would use a whole
+ * CPU; on a node with more processes than cores, or with hyperthreads, it
+ * would slow down the processes being timed.  Here the wait is an
+ * MPI_Ibarrier that is checked every IDLE_SLEEP microseconds, sleeping in
+ * between. */
+void idle_wait(MPI_Comm comm) {
+    MPI_Request req;
+    int done = 0;
+
+    MPI_Ibarrier(comm, &req);
+    while (1) {
+        MPI_Test(&req, &done, MPI_STATUS_IGNORE);
+        if (done) break;
+        usleep(IDLE_SLEEP);
+    }
+}
+
+/* Sorts a random distributed array on the processes in comm, each holding
+ * a shard of length elements.  Returns the time for the slowest process,
+ * and adds any problems found to *errors. */
+double run_sort(MPI_Comm comm, long length, long *errors) {
+    int rank;
+    long counts[MAX] = {0}, start = 0, total;
+    double t_start, elapsed;
+
+    MPI_Comm_rank(comm, &rank);
+
+    int *array = malloc((length > 0 ? length : 1) * sizeof(int));
+    if (!array) {
+        fprintf(stderr, "ERROR: malloc failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 2);
+    }
+    genRandomShard(array, length, 10 + rank);
+
+    MPI_Barrier(comm);
+    t_start = MPI_Wtime();
+
+    countElems(counts, array, length); //step 1: local histogram
+
+    //step 2: global histogram, available on every process
+    MPI_Allreduce(MPI_IN_PLACE, counts, MAX, MPI_LONG, MPI_SUM, comm);
+
+    //step 3: the sum of the shard sizes of lower ranks is where ours starts
+    MPI_Exscan(&length, &start, 1, MPI_LONG, MPI_SUM, comm);
+    if (rank == 0) start = 0; //MPI_Exscan leaves rank 0's result undefined
+    writeShard(counts, array, start, length);
+
+    elapsed = MPI_Wtime() - t_start;
+    MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    MPI_Allreduce(&length, &total, 1, MPI_LONG, MPI_SUM, comm);
+    *errors += verify(comm, array, length, counts, total);
+
+    free(array);
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, q, in_group;
+    long n, length, errors = 0;
+    double time, base_time = 0;
+    MPI_Comm comm;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc != 3 || (n = strtol(argv[1], NULL, 10)) < 1
+        || (strcmp(argv[2], "strong") != 0 && strcmp(argv[2], "weak") != 0)) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <n> <strong|weak>\n", argv[0]);
+            fprintf(stderr, "where <n> is the total array size (strong scaling)\n");
+            fprintf(stderr, "or the size of each process's shard (weak scaling)\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    int weak = strcmp(argv[2], "weak") == 0;
+
+    if (rank == 0) {
+        printf("%s scaling, %s %ld\n", weak ? "weak" : "strong",
+               weak ? "elements per process" : "total elements", n);
+        printf("%6s %14s %12s %10s %11s\n", "procs", "total elems", "time (s)",
+               weak ? "" : "speedup", "efficiency");
+    }
+
+    //run on the first q processes, for q = 1, 2, 4, ..., process_count
+    for (q = 1; ; q = (q * 2 < process_count) ? q * 2 : process_count) {
+        in_group = rank < q;
+        MPI_Comm_split(MPI_COMM_WORLD, in_group, rank, &comm);
+
+        if (in_group) {
+            if (weak) {
+                length = n;
+            } else {
+                length = n / q + (rank < n % q); //balanced shards
+            }
+            time = run_sort(comm, length, &errors);
+
+            if (rank == 0) {
+                if (q == 1) base_time = time;
+                if (weak) {
+                    printf("%6d %14ld %12.6f %10s %10.1f%%\n", q, n * q, time, "",
+                           100.0 * base_time / time);
+                } else {
+                    printf("%6d %14ld %12.6f %10.2f %10.1f%%\n", q, n, time,
+                           base_time / time, 100.0 * base_time / time / q);
+                }
+            }
+        }
+        //everyone meets here before the next split, those not in the run asleep
+        idle_wait(MPI_COMM_WORLD);
+        MPI_Comm_free(&comm);
+        if (q == process_count) break;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("%s\n", errors ? "ERROR: array not sorted" : "all sorts verified");
+    }
+
+    MPI_Finalize();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * cuda_cpu.h: runs simple CUDA kernels on the CPU, so that CUDA examples
+ * can be compiled with plain g++ and run on machines without a GPU.
+ *
+ * A kernel is written exactly as for CUDA (a __global__ function that uses
+ * blockIdx, blockDim, threadIdx and gridDim), and launched with
+ *
+ *   CUDA_LAUNCH(kernel, blocks, threads_per_block, args...);
+ *
+ * in place of kernel<<<blocks, threads_per_block>>>(args...).
+ *
+ * How kernels are run:
+ *
+ *   - the blocks of the grid are divided among a pool of CPU threads (one
+ *     per CPU, or CUDA_CPU_THREADS if that environment variable is set);
+ *     a thread takes a few blocks at a time, until none are left
+ *   - a block's CUDA threads are run by one CPU thread, as a loop over
+ *     threadIdx.x (inside loops over threadIdx.y and threadIdx.z).  The
+ *     kernel is inlined into that loop, so the compiler can vectorize it:
+ *     consecutive CUDA threads of a block become the lanes of SIMD
+ *     instructions, much as they are the lanes of a warp on a GPU.
+ *
+ * blockIdx and friends are per-CPU-thread variables.  Their fields hold
+ * longs, which the compiler knows cannot be changed by a kernel's stores
+ * to int or float arrays, but they read as ints, so a kernel's index
+ * arithmetic is int arithmetic, as on the GPU.  Both are needed for the
+ * loop over threadIdx.x to vectorize.
+ *
+ * Limitations: kernels run to completion one at a time, and launches are
+ * synchronous.  Kernels that use __shared__ memory or __syncthreads()
+ * (which would need every thread of a block to run concurrently) are not
+ * supported, and fail to compile.  "Device" memory is ordinary memory.
+ *
+ * To compile a program that uses it (C++17, the default since g++ 11):
+ *   g++ -O3 -march=native -pthread prog.cpp
+ */
+#ifndef _CUDA_CPU_H_
+#define _CUDA_CPU_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define __global__ static inline __attribute__((always_inline))
+#define __device__ static inline
+#define __host__
+
+/******** device memory: ordinary host memory ************/
+
+enum cudaError_t { cudaSuccess = 0, cudaErrorMemoryAllocation = 2 };
+
+enum cudaMemcpyKind {
+    cudaMemcpyHostToHost,
+    cudaMemcpyHostToDevice,
+    cudaMemcpyDeviceToHost,
+    cudaMemcpyDeviceToDevice
+};
+
+template <typename T>
+inline cudaError_t cudaMalloc(T **ptr, size_t size) {
+    // 64-byte aligned, like a cache line, so vector loads are aligned
+    if (posix_memalign((void **)ptr, 64, size) != 0) {
+        return cudaErrorMemoryAllocation;
+    }
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpy(void *dst, const void *src, size_t size,
+                              cudaMemcpyKind kind) {
+    (void)kind;
+    memcpy(dst, src, size);
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaFree(void *ptr) {
+    free(ptr);
+    return cudaSuccess;
+}
+
+// launches finish before returning, so there is nothing to wait for
+inline cudaError_t cudaDeviceSynchronize(void) {
+    return cudaSuccess;
+}
+
+/******** grid and block coordinates ************/
+
+// one coordinate: stored as a long, read as an int (see the top of the file)
+struct cuda_cpu_index {
+    long v;
+    operator int() const { return (int)v; }
+    cuda_cpu_index &operator=(long n) { v = n; return *this; }
+};
+
+struct cuda_cpu_index3 {
+    cuda_cpu_index x, y, z;
+};
+
+// the size of a grid or block, as passed to CUDA_LAUNCH
+struct dim3 {
+    unsigned int x, y, z;
+    dim3(unsigned int x = 1, unsigned int y = 1, unsigned int z = 1)
+        : x(x), y(y), z(z) {}
+};
+
+inline thread_local cuda_cpu_index3 threadIdx, blockIdx, blockDim, gridDim;
+
+/******** the thread pool ************/
+
+// a launch, as seen by the pool: run(ctx, first, last) runs blocks first
+// to last-1 of the grid
+struct cuda_cpu_job {
+    void (*run)(void *ctx, long first, long last);
+    void *ctx;
+    long nblocks;
+    long chunk;       // blocks taken at a time
+    long next;        // the next block not yet taken (updated atomically)
+    int running;      // pool threads still working on this launch
+};
+
+struct cuda_cpu_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    int nthreads;         // pool threads, plus the launching thread
+    long generation;      // incremented at every launch
+    struct cuda_cpu_job job;
+};
+
+inline cuda_cpu_pool cuda_cpu_the_pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, 0, 0, {}
+};
+
+// takes chunks of blocks of the current job until there are none left
+inline void cuda_cpu_run_blocks(cuda_cpu_job *job) {
+    long first;
+    while ((first = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED))
+           < job->nblocks) {
+        long last = first + job->chunk;
+        job->run(job->ctx, first, last < job->nblocks ? last : job->nblocks);
+    }
+}
+
+inline void *cuda_cpu_worker(void *arg) {
+    cuda_cpu_pool *pool = (cuda_cpu_pool *)arg;
+    long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        cuda_cpu_run_blocks(&pool->job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->job.running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    return NULL;
+}
+
+// starts the pool threads the first time a kernel is launched
+inline void cuda_cpu_pool_init(cuda_cpu_pool *pool) {
+    int i;
+    long n;
+    pthread_t thread;
+    char *env = getenv("CUDA_CPU_THREADS");
+
+    n = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    pool->nthreads = n > 0 ? n : 1;
+    for (i = 1; i < pool->nthreads; i++) { // the launching thread is the other one
+        if (pthread_create(&thread, NULL, cuda_cpu_worker, pool) != 0) {
+            fprintf(stderr, "cuda_cpu: pthread_create failed\n");
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+}
+
+// runs job on the pool and the calling thread, returning when it is done
+inline void cuda_cpu_pool_run(cuda_cpu_job *job) {
+    cuda_cpu_pool *pool = &cuda_cpu_the_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nthreads == 0) {
+        cuda_cpu_pool_init(pool);
+    }
+    // about 8 chunks per thread, so a slow thread does not hold up the rest
+    job->chunk = job->nblocks / (8L * pool->nthreads);
+    if (job->chunk < 1) job->chunk = 1;
+    job->next = 0;
+    job->running = pool->nthreads - 1;
+    pool->job = *job;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    cuda_cpu_run_blocks(&pool->job);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->job.running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/******** launching kernels ************/
+
+// one launch: the grid and block sizes, and a call of the kernel with its
+// arguments
+template <typename Body>
+struct cuda_cpu_launch_ctx {
+    dim3 grid, block;
+    Body body;
+};
+
+// Runs blocks first to last-1 (numbered x fastest) of the launch in ctx.
+// The launch is copied into local variables first: the kernel's stores
+// could otherwise change them, as far as the compiler knows, and it would
+// have to reload them for every CUDA thread instead of vectorizing.
+template <typename Body>
+void cuda_cpu_run(void *ctx, long first, long last) {
+    cuda_cpu_launch_ctx<Body> c = *(cuda_cpu_launch_ctx<Body> *)ctx;
+    long b;
+    int tx, ty, tz;
+    int bx = c.block.x, by = c.block.y, bz = c.block.z;
+
+    blockDim.x = bx; blockDim.y = by; blockDim.z = bz;
+    gridDim.x = c.grid.x; gridDim.y = c.grid.y; gridDim.z = c.grid.z;
+    for (b = first; b < last; b++) {
+        blockIdx.x = b % c.grid.x;
+        blockIdx.y = b / c.grid.x % c.grid.y;
+        blockIdx.z = b / c.grid.x / c.grid.y;
+        for (tz = 0; tz < bz; tz++) {
+            threadIdx.z = tz;
+            for (ty = 0; ty < by; ty++) {
+                threadIdx.y = ty;
+                for (tx = 0; tx < bx; tx++) { // the loop that is vectorized
+                    threadIdx.x = tx;
+                    c.body();
+                }
+            }
+        }
+    }
+}
+
+// kernel<<<grid, block>>>(args...)
+template <auto Kernel, typename... Args>
+void cuda_cpu_launch(dim3 grid, dim3 block, Args... args) {
+    auto body = [=]() { Kernel(args...); };
+    cuda_cpu_launch_ctx<decltype(body)> ctx = { grid, block, body };
+    cuda_cpu_job job;
+
+    job.run = cuda_cpu_run<decltype(body)>;
+    job.ctx = &ctx;
+    job.nblocks = (long)grid.x * grid.y * grid.z;
+    cuda_cpu_pool_run(&job);
+}
+
+#define CUDA_LAUNCH(kernel, grid, block, ...) \
+    cuda_cpu_launch<kernel>((grid), (block), __VA_ARGS__)
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Distributed matrix-vector multiplication y = A * x with MPI.
+ *
+ * Two ways of dividing an n x m matrix among p processes are compared:
+ *
+ *   1D (row) decomposition: each process owns n/p whole rows.  It needs
+ *     all m entries of x, so x is broadcast to every process, and each
+ *     process computes n/p entries of y.
+ *
+ *   2D (block) decomposition: the processes are arranged in a pr x pc grid
+ *     with MPI_Cart_create, and process (r, c) owns the block of rows r and
+ *     columns c of A, about (n/pr) x (m/pc) entries.  It only needs the
+ *     m/pc entries of x for its columns, which are broadcast down each
+ *     column of the grid.  Its dot products are only partial sums (over its
+ *     own columns), so the partial sums are added up across each row of the
+ *     grid with MPI_Reduce, leaving y's pieces in grid column 0.
+ *
+ * Either way each process holds n*m/p matrix entries, but with the 2D
+ * decomposition the pieces of x and y each process communicates shrink
+ * like 1/sqrt(p), while with 1D every process still needs all m entries
+ * of x.
+ *
+ * Every process generates its own part of the matrix (entry (i, j) is a
+ * simple function of i and j), so no process ever holds the whole matrix.
+ *
+ * To compile: mpicc -O2 -o matrixVector_mpi matrixVector_mpi.c
+ *
+ * To run: mpirun -np <p> ./matrixVector_mpi <n> <m>
+ *   mpirun -np 16 ./matrixVector_mpi 40000 40000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi.h"
+
+#define NITER 10 /* times each version is run (time is averaged) */
+
+/* entry (i, j) of the matrix and entry j of the vector */
+#define MAT(i, j) ((int)(1 + ((i) * 31 + (j) * 17) % 100))
+#define VEC(j) ((int)(1 + (j) % 10))
+
+/* Balanced decomposition of n items over p parts: part k gets items
+ * *start to *start + *count - 1. */
+void block_range(long n, int p, int k, long *start, long *count) {
+    *count = n / p + (k < n % p);
+    *start = k * (n / p) + (k < n % p ? k : n % p);
+}
+
+/* Allocates a rows x cols block of the matrix whose top-left entry is
+ * (row0, col0), stored row-major, and fills it in. */
+int *build_block(long row0, long rows, long col0, long cols) {
+    long i, j;
+    int *block = malloc((rows * cols > 0 ? rows * cols : 1) * sizeof(int));
+    if (block == NULL) {
+        fprintf(stderr, "cannot allocate a %ld x %ld block\n", rows, cols);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (i = 0; i < rows; i++) {
+        for (j = 0; j < cols; j++) {
+            block[i * cols + j] = MAT(row0 + i, col0 + j);
+        }
+    }
+    return block;
+}
+
+/* y = block * x for a rows x cols block, accumulating in longs */
+void local_gemv(int *block, int *x, long *y, long rows, long cols) {
+    long i, j;
+    for (i = 0; i < rows; i++) {
+        long sum = 0;
+        for (j = 0; j < cols; j++) {
+            sum += (long)block[i * cols + j] * x[j];
+        }
+        y[i] = sum;
+    }
+}
+
+/* A weighted sum of the y entries this process holds, starting at global
+ * row row0.  Adding these up over all processes gives a checksum that the
+ * two versions must agree on. */
+long checksum(long *y, long row0, long rows) {
+    long i, sum = 0;
+    for (i = 0; i < rows; i++) {
+        sum += y[i] * ((row0 + i) % 7 + 1);
+    }
+    return sum;
+}
+
+/* results of one version: time, per-process memory, communication volume */
+struct result {
+    double time;       /* average time per multiply */
+    long mat_elems;    /* matrix entries held by this process */
+    long comm_elems;   /* vector entries this process sends and receives */
+    long check;        /* this process's part of the checksum */
+};
+
+/* 1D row decomposition: rank 0 builds x and broadcasts all of it. */
+struct result run_1d(long n, long m) {
+    struct result res;
+    int rank, p, iter;
+    long row0, rows, j;
+    double start;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    block_range(n, p, rank, &row0, &rows);
+
+    int *block = build_block(row0, rows, 0, m);
+    int *x = malloc(m * sizeof(int));
+    long *y = malloc((rows > 0 ? rows : 1) * sizeof(long));
+    if (x == NULL || y == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        if (rank == 0) {
+            for (j = 0; j < m; j++) x[j] = VEC(j);
+        }
+        MPI_Bcast(x, m, MPI_INT, 0, MPI_COMM_WORLD);
+        local_gemv(block, x, y, rows, m);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    res.time = (MPI_Wtime() - start) / NITER;
+
+    res.mat_elems = rows * m;
+    res.comm_elems = p > 1 ? m : 0;
+    res.check = checksum(y, row0, rows);
+
+    free(block);
+    free(x);
+    free(y);
+    return res;
+}
+
+/* 2D block decomposition on a pr x pc process grid. */
+struct result run_2d(long n, long m, int *grid) {
+    struct result res;
+    int p, rank, iter, coords[2], periods[2] = {0, 0}, keep[2];
+    long row0, rows, col0, cols, j;
+    double start;
+    MPI_Comm grid_comm, row_comm, col_comm;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    grid[0] = grid[1] = 0;
+    MPI_Dims_create(p, 2, grid); /* as square a grid as possible */
+    MPI_Cart_create(MPI_COMM_WORLD, 2, grid, periods, 1, &grid_comm);
+    MPI_Comm_rank(grid_comm, &rank);
+    MPI_Cart_coords(grid_comm, rank, 2, coords);
+
+    /* row_comm: the processes in my grid row (same coords[0]);
+     * col_comm: the processes in my grid column (same coords[1]) */
+    keep[0] = 0; keep[1] = 1;
+    MPI_Cart_sub(grid_comm, keep, &row_comm);
+    keep[0] = 1; keep[1] = 0;
+    MPI_Cart_sub(grid_comm, keep, &col_comm);
+
+    block_range(n, grid[0], coords[0], &row0, &rows);
+    block_range(m, grid[1], coords[1], &col0, &cols);
+
+    int *block = build_block(row0, rows, col0, cols);
+    int *x = malloc((cols > 0 ? cols : 1) * sizeof(int));
+    long *ypart = malloc((rows > 0 ? rows : 1) * sizeof(long));
+    long *y = malloc((rows > 0 ? rows : 1) * sizeof(long));
+    if (x == NULL || ypart == NULL || y == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    MPI_Barrier(grid_comm);
+    start = MPI_Wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        /* the top process of each grid column holds that column's piece of
+         * x, and broadcasts it down the column */
+        if (coords[0] == 0) {
+            for (j = 0; j < cols; j++) x[j] = VEC(col0 + j);
+        }
+        MPI_Bcast(x, cols, MPI_INT, 0, col_comm);
+
+        /* partial sums over this block's columns */
+        local_gemv(block, x, ypart, rows, cols);
+
+        /* add up the partial sums across the grid row, into column 0 */
+        MPI_Reduce(ypart, y, rows, MPI_LONG, MPI_SUM, 0, row_comm);
+    }
+    MPI_Barrier(grid_comm);
+    res.time = (MPI_Wtime() - start) / NITER;
+
+    res.mat_elems = rows * cols;
+    res.comm_elems = (grid[0] > 1 ? cols : 0) + (grid[1] > 1 ? rows : 0);
+    res.check = coords[1] == 0 ? checksum(y, row0, rows) : 0;
+
+    free(block);
+    free(x);
+    free(ypart);
+    free(y);
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    MPI_Comm_free(&grid_comm);
+    return res;
+}
+
+int main(int argc, char **argv) {
+    int rank, p, grid[2];
+    long n, m;
+    struct result r1, r2;
+    double times[2];
+    long maxes[4], mine[4], checks[2], sums[2];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc != 3 || (n = strtol(argv[1], NULL, 10)) < 1
+        || (m = strtol(argv[2], NULL, 10)) < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <n> <m>\n", argv[0]);
+            fprintf(stderr, "where <n> is the number of rows and <m> is the number of cols\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    r1 = run_1d(n, m);
+    r2 = run_2d(n, m, grid);
+
+    /* slowest time, largest memory and communication, total checksums */
+    times[0] = r1.time;
+    times[1] = r2.time;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : times, times, 2, MPI_DOUBLE,
+               MPI_MAX, 0, MPI_COMM_WORLD);
+    mine[0] = r1.mat_elems;
+    mine[1] = r1.comm_elems;
+    mine[2] = r2.mat_elems;
+    mine[3] = r2.comm_elems;
+    MPI_Reduce(mine, maxes, 4, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    checks[0] = r1.check;
+    checks[1] = r2.check;
+    MPI_Reduce(checks, sums, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        printf("%ld x %ld matrix on %d processes\n", n, m, p);
+        printf("%-14s %12s %22s %24s\n", "decomposition", "time (s)",
+               "max matrix MiB/proc", "max vector elems/proc");
+        printf("%-14s %12.6f %22.2f %24ld\n", "1D rows", times[0],
+               maxes[0] * sizeof(int) / 1048576.0, maxes[1]);
+        printf("%-8s%2dx%-2d  %12.6f %22.2f %24ld\n", "2D grid", grid[0], grid[1],
+               times[1], maxes[2] * sizeof(int) / 1048576.0, maxes[3]);
+        printf("%s\n", sums[0] == sums[1] ? "results agree" : "ERROR: results differ");
+    }
+
+    MPI_Bcast(sums, 2, MPI_LONG, 0, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return sums[0] == sums[1] ? 0 : 1;
+}
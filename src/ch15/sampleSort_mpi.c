@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Distributed sample sort with MPI, for keys of any size.
+ *
+ * CountSort only works when keys come from a small range (0 to MAX-1).
+ * Sample sort works for any keys that can be compared; here they are
+ * 64-bit unsigned integers.  Every process starts with a shard of the
+ * keys, and at the end each process holds a sorted range of them, with
+ * all of process i's keys no larger than any of process i+1's keys:
+ *
+ *   1. every process sorts its shard locally (with qsort)
+ *   2. regular sampling: every process picks p-1 evenly spaced keys from
+ *      its sorted shard and sends them to the boss, which sorts all the
+ *      samples and picks p-1 evenly spaced "splitters" from them.  The
+ *      boss broadcasts the splitters to everyone.
+ *   3. every process cuts its sorted shard into p buckets at the
+ *      splitters; bucket j goes to process j.  MPI_Alltoall exchanges the
+ *      bucket sizes, and MPI_Alltoallv exchanges the buckets themselves.
+ *   4. every process merges the p sorted buckets it received
+ *
+ * No process ever holds more than its final share of the keys (plus its
+ * original shard), so the total data can be far larger than the memory
+ * of any one process.  Regular sampling guarantees that no process ends
+ * up with more than about twice its fair share; the program reports how
+ * balanced the result actually is, and verifies it.  For every process, it
+ * prints the number of keys it ends up with and its smallest and largest
+ * key, which show the range of keys it was given.
+ *
+ * To compile: mpicc -O2 -o sampleSort_mpi sampleSort_mpi.c
+ *
+ * To run: mpirun -np <p> ./sampleSort_mpi <n> <dist>
+ *   n:    number of keys per process
+ *   dist: uniform or skewed (most keys are small)
+ *
+ *   mpirun -np 8 ./sampleSort_mpi 10000000 skewed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include "mpi.h"
+
+typedef uint64_t sortkey_t;  /* the type of the keys being sorted */
+#define KEY_MPI_TYPE MPI_UINT64_T
+
+/* the phases that are timed */
+enum { T_LOCAL, T_SPLIT, T_EXCHANGE, T_MERGE, NPHASES };
+static const char *phase_names[NPHASES] = {
+    "local sort", "splitters", "exchange", "merge"
+};
+
+/* xorshift random number generator: fast, and every process can have its
+ * own independent stream */
+uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* Fills a shard with random keys.  With skewed, keys are the product of two
+ * random numbers divided down, so small keys are much more common. */
+void genShard(sortkey_t *keys, long n, int skewed, int rank) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL * (rank + 1);
+    long i;
+    for (i = 0; i < n; i++) {
+        if (skewed) {
+            keys[i] = (next_random(&state) >> 40) * (next_random(&state) >> 40);
+        } else {
+            keys[i] = next_random(&state);
+        }
+    }
+}
+
+/* comparison function for qsort */
+int cmp_keys(const void *a, const void *b) {
+    sortkey_t x = *(const sortkey_t *)a, y = *(const sortkey_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Returns the number of keys in the sorted array keys[0..n-1] that are
+ * less than or equal to split (a binary search). */
+long count_le(sortkey_t *keys, long n, sortkey_t split) {
+    long lo = 0, hi = n, mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (keys[mid] <= split) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Merges p sorted runs, run j being in[displs[j]] to in[displs[j]+counts[j]-1],
+ * into out.  A binary min-heap holds the next key of every nonempty run, so
+ * each output key takes O(log p) work. */
+void merge_runs(sortkey_t *in, int *counts, int *displs, int p, sortkey_t *out) {
+    long *pos = malloc(p * sizeof(long));  //next index in each run
+    long *end = malloc(p * sizeof(long));  //end of each run
+    int *heap = malloc(p * sizeof(int));   //run numbers, ordered by next key
+    int hsize = 0, j, i, child, run;
+    long o = 0;
+
+    if (!pos || !end || !heap) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (j = 0; j < p; j++) {
+        pos[j] = displs[j];
+        end[j] = (long)displs[j] + counts[j];
+        if (pos[j] < end[j]) {
+            //sift the new run up to its place
+            i = hsize++;
+            while (i > 0 && in[pos[heap[(i - 1) / 2]]] > in[pos[j]]) {
+                heap[i] = heap[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            heap[i] = j;
+        }
+    }
+
+    while (hsize > 0) {
+        run = heap[0];
+        out[o++] = in[pos[run]++];
+        if (pos[run] == end[run]) { //run is used up: replace it with the last
+            run = heap[--hsize];
+        }
+        //sift run down from the root
+        i = 0;
+        while ((child = 2 * i + 1) < hsize) {
+            if (child + 1 < hsize && in[pos[heap[child + 1]]] < in[pos[heap[child]]]) {
+                child++;
+            }
+            if (in[pos[heap[child]]] >= in[pos[run]]) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        if (hsize > 0) heap[i] = run;
+    }
+
+    free(pos);
+    free(end);
+    free(heap);
+}
+
+/* Checks that the keys are sorted across all processes, and that no key was
+ * lost or duplicated (the number of keys and their sum, modulo 2^64, must
+ * match the input's).  Returns the number of problems found. */
+long verify(sortkey_t *keys, long n, long n_in, uint64_t sum_in, int rank, int p) {
+    long i, errors = 0, totals[2], totals_in[2];
+    uint64_t sum = 0, sums[2] = {sum_in, 0}, sums_all[2];
+    sortkey_t prev_last, my_last;
+    int has_prev;
+
+    for (i = 0; i < n; i++) {
+        sum += keys[i];
+        if (i > 0 && keys[i - 1] > keys[i]) errors++;
+    }
+
+    //pass the largest key so far along the chain of processes; a process
+    //that received no keys passes on what it got
+    has_prev = 0;
+    prev_last = 0;
+    if (rank > 0) {
+        sortkey_t msg[2];
+        MPI_Recv(msg, 2, KEY_MPI_TYPE, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        has_prev = (int)msg[0];
+        prev_last = msg[1];
+        if (has_prev && n > 0 && keys[0] < prev_last) errors++;
+    }
+    if (rank < p - 1) {
+        sortkey_t msg[2];
+        my_last = n > 0 ? keys[n - 1] : prev_last;
+        msg[0] = n > 0 || has_prev;
+        msg[1] = my_last;
+        MPI_Send(msg, 2, KEY_MPI_TYPE, rank + 1, 0, MPI_COMM_WORLD);
+    }
+
+    totals[0] = n_in;
+    totals[1] = n;
+    MPI_Allreduce(totals, totals_in, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    sums[1] = sum;
+    MPI_Allreduce(sums, sums_all, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (totals_in[0] != totals_in[1] || sums_all[0] != sums_all[1]) errors++;
+
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    int rank, p, i, j, skewed = 0;
+    long n, nrecv, errors;
+    double t[NPHASES], tmax[NPHASES], start;
+    uint64_t sum_in = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* Boss reads the parameters and broadcasts them. */
+    if (rank == 0) {
+        n = -1;
+        if (argc == 3 && (strcmp(argv[2], "uniform") == 0 || strcmp(argv[2], "skewed") == 0)) {
+            n = strtol(argv[1], NULL, 10);
+            skewed = strcmp(argv[2], "skewed") == 0;
+        }
+        if (n < 1 || n > INT_MAX) {
+            fprintf(stderr, "usage: %s <n> <uniform|skewed>\n", argv[0]);
+            fprintf(stderr, "where 0 < <n> <= %d is the number of keys per process\n",
+                    INT_MAX);
+            n = -1;
+        }
+    }
+    MPI_Bcast(&n, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&skewed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (n < 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    sortkey_t *keys = malloc(n * sizeof(sortkey_t));
+    int *sendcounts = malloc(p * sizeof(int));
+    int *sdispls = malloc(p * sizeof(int));
+    int *recvcounts = malloc(p * sizeof(int));
+    int *rdispls = malloc(p * sizeof(int));
+    sortkey_t *samples = malloc(p * sizeof(sortkey_t));
+    sortkey_t *all_samples = NULL;
+    if (!keys || !sendcounts || !sdispls || !recvcounts || !rdispls || !samples) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    genShard(keys, n, skewed, rank);
+    for (i = 0; i < n; i++) sum_in += keys[i];
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /* 1. sort locally */
+    start = MPI_Wtime();
+    qsort(keys, n, sizeof(sortkey_t), cmp_keys);
+    t[T_LOCAL] = MPI_Wtime() - start;
+
+    /* 2. regular sampling: p-1 samples from each process, and p-1
+     * splitters chosen by the boss from all p*(p-1) of them */
+    start = MPI_Wtime();
+    for (i = 1; i < p; i++) {
+        samples[i - 1] = keys[(long)i * n / p];
+    }
+    if (rank == 0) {
+        all_samples = malloc((long)p * (p - 1) * sizeof(sortkey_t) + 1);
+        if (!all_samples) MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Gather(samples, p - 1, KEY_MPI_TYPE, all_samples, p - 1, KEY_MPI_TYPE,
+               0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        qsort(all_samples, (long)p * (p - 1), sizeof(sortkey_t), cmp_keys);
+        for (i = 1; i < p; i++) {
+            samples[i - 1] = all_samples[(long)i * (p - 1)];
+        }
+        free(all_samples);
+    }
+    //samples now holds the splitters on the boss; send them to everyone
+    MPI_Bcast(samples, p - 1, KEY_MPI_TYPE, 0, MPI_COMM_WORLD);
+    t[T_SPLIT] = MPI_Wtime() - start;
+
+    /* 3. cut the shard at the splitters and exchange the buckets: bucket j
+     * holds keys greater than splitter j-1 and at most splitter j */
+    start = MPI_Wtime();
+    long prev = 0, cut;
+    for (j = 0; j < p; j++) {
+        cut = (j < p - 1) ? count_le(keys, n, samples[j]) : n;
+        sendcounts[j] = cut - prev;
+        sdispls[j] = prev;
+        prev = cut;
+    }
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    nrecv = 0;
+    for (j = 0; j < p; j++) {
+        rdispls[j] = nrecv;
+        nrecv += recvcounts[j];
+        if (nrecv > INT_MAX) {
+            fprintf(stderr, "rank %d: too many keys to receive\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    sortkey_t *buckets = malloc((nrecv > 0 ? nrecv : 1) * sizeof(sortkey_t));
+    if (!buckets) MPI_Abort(MPI_COMM_WORLD, 1);
+    MPI_Alltoallv(keys, sendcounts, sdispls, KEY_MPI_TYPE,
+                  buckets, recvcounts, rdispls, KEY_MPI_TYPE, MPI_COMM_WORLD);
+    t[T_EXCHANGE] = MPI_Wtime() - start;
+
+    /* 4. merge the p sorted buckets; the original shard is no longer
+     * needed, so it is freed before the output is allocated */
+    start = MPI_Wtime();
+    free(keys);
+    keys = malloc((nrecv > 0 ? nrecv : 1) * sizeof(sortkey_t));
+    if (!keys) MPI_Abort(MPI_COMM_WORLD, 1);
+    merge_runs(buckets, recvcounts, rdispls, p, keys);
+    free(buckets);
+    t[T_MERGE] = MPI_Wtime() - start;
+
+    /* report timings and load balance: each process sends the boss its
+     * number of keys and its smallest and largest key */
+    long nmin, nmax;
+    uint64_t range[3] = { nrecv, nrecv > 0 ? keys[0] : 0,
+                          nrecv > 0 ? keys[nrecv - 1] : 0 };
+    uint64_t *ranges = NULL;
+    if (rank == 0) {
+        ranges = malloc(3L * p * sizeof(uint64_t));
+        if (!ranges) MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Gather(range, 3, MPI_UINT64_T, ranges, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    MPI_Reduce(t, tmax, NPHASES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&nrecv, &nmin, 1, MPI_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&nrecv, &nmax, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    errors = verify(keys, nrecv, n, sum_in, rank, p);
+
+    if (rank == 0) {
+        double total = 0;
+        printf("%ld keys per process, %d processes, %s keys\n", n, p,
+               skewed ? "skewed" : "uniform");
+        for (i = 0; i < NPHASES; i++) {
+            printf("  %-11s %10.6f s\n", phase_names[i], tmax[i]);
+            total += tmax[i];
+        }
+        printf("  %-11s %10.6f s\n", "total", total);
+        printf("%6s %12s %22s %22s\n", "rank", "keys", "smallest key", "largest key");
+        for (j = 0; j < p; j++) {
+            if (ranges[3 * j] == 0) {
+                printf("%6d %12d %22s %22s\n", j, 0, "-", "-");
+            } else {
+                printf("%6d %12" PRIu64 " %22" PRIu64 " %22" PRIu64 "\n", j,
+                       ranges[3 * j], ranges[3 * j + 1], ranges[3 * j + 2]);
+            }
+        }
+        free(ranges);
+        printf("keys per process after sort: min %ld, max %ld, imbalance %.3f "
+               "(max / average)\n", nmin, nmax, (double)nmax / n);
+        printf("%s\n", errors ? "ERROR: keys not sorted" : "sort verified");
+    }
+
+    free(keys);
+    free(samples);
+    free(sendcounts);
+    free(sdispls);
+    free(recvcounts);
+    free(rdispls);
+    MPI_Finalize();
+    return errors ? 1 : 0;
+}
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <cuda.h>
+#include "scalar_multiply_kernel.h"
 
 /* define these so that N is evenly divided by BLOCK_SIZE */
 #define BLOCK_SIZE       64    /* threads per block */ 
@@ -23,8 +24,6 @@
 void init_array(int *vector, int size, int step);
 /* host-size: print out some vector values */
 void print_some(int *vector, int size, int step);
-/* cuda scalar multiply kernel */
-__global__ void scalar_multiply(int *array, int scalar); 
 
 
 /***************************************************/
@@ -83,25 +82,6 @@ int main(int argc, char **argv) {
   return 0;
 }
 /***************************************************/
-/*
- * CUDA kernel function that performs scalar multiply 
- * of a vector on the GPU device
- *
- * This assumes that there are enough threads to associated
- * each array[i] element with a signal thread
- * (in general, each thread would be responsible for a set of data elements)
- */
-__global__ void scalar_multiply(int *array, int scalar) {
-
-  int index;
-
-  // get the thread's index value based on its 
-  // position in the enclosing block and grid
-  index = blockIdx.x * blockDim.x + threadIdx.x;
-
-  array[index] = array[index] * scalar;
-}
-/***************************************************/
 /* host-side: vector initialization function */
 void init_array(int *vector, int size, int step) {
 
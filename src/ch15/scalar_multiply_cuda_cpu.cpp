@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * scalar_multiply_cuda.cu run on the CPU with cuda_cpu.h, so it can be
+ * compiled with g++ and run without a GPU.  Both programs include the
+ * same kernel, from scalar_multiply_kernel.h; only the launch syntax
+ * differs.
+ *
+ * After the example's launch, the kernel is timed over NITER more launches,
+ * so that different BLOCK_SIZE and N values can be compared:
+ *
+ * to compile:
+ *  g++ -O3 -march=native -pthread -o scalar_multiply_cuda_cpu scalar_multiply_cuda_cpu.cpp
+ *
+ * to compare block sizes on a larger vector:
+ *  for b in 32 64 256 1024; do
+ *    g++ -O3 -march=native -pthread -DBLOCK_SIZE=$b -DN=102400000 \
+ *        -o scalar_multiply_cuda_cpu scalar_multiply_cuda_cpu.cpp
+ *    ./scalar_multiply_cuda_cpu
+ *  done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "cuda_cpu.h"
+#include "scalar_multiply_kernel.h"
+
+/* define these so that N is evenly divided by BLOCK_SIZE */
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE       64    /* threads per block */
+#endif
+#ifndef N
+#define N              10240   /* vector size */
+#endif
+#define DEFAULT_VALUE  3       /* default scalar value */
+#define NITER          20      /* timed launches */
+
+/******** prototypes ************/
+/* host-side: vector initialization function */
+void init_array(int *vector, int size, int step);
+/* host-size: print out some vector values */
+void print_some(int *vector, int size, int step);
+
+/* host-side: computes wall clock time */
+double getTime(struct timeval ts, struct timeval te) {
+  double time = te.tv_sec - ts.tv_sec + (te.tv_usec - ts.tv_usec)/1.e6;
+  return time;
+}
+
+/***************************************************/
+// host-side main:
+int main(int argc, char **argv) {
+
+  int *vector, *dev_vector, scalar, i, errors;
+  volatile int identity = 1; // not a constant, so launches are not optimized away
+  struct timeval tstart, tend;
+  double time;
+
+  scalar = DEFAULT_VALUE;
+  if(argc == 2) {
+    scalar = atoi(argv[1]);
+  }
+
+  // allocate host memory space for the vector
+  vector = (int *)malloc(sizeof(int)*N);
+  if (vector == NULL) {
+    printf("Error: malloc failed\n");
+    exit(1);
+  }
+  // initialize vector in host memory
+  init_array(vector, N, 7);
+
+  // allocate "device" memory for vector
+  if (cudaMalloc(&dev_vector, sizeof(int)*N) != cudaSuccess) {
+    printf("Error: cudaMalloc failed\n");
+    exit(1);
+  }
+
+  // copy host vector to device memory
+  if (cudaMemcpy(dev_vector, vector, sizeof(int)*N, cudaMemcpyHostToDevice)
+      != cudaSuccess)
+  {
+    printf("Error: cudaMemcpy host to dev failed\n");
+    exit(1);
+  }
+
+  // call the scalar_multiply kernel: on a GPU, this would be
+  //   scalar_multiply<<<(N/BLOCK_SIZE), BLOCK_SIZE>>>(dev_vector, scalar);
+  CUDA_LAUNCH(scalar_multiply, (N/BLOCK_SIZE), BLOCK_SIZE, dev_vector, scalar);
+
+  // copy device vector to host memory
+  if (cudaMemcpy(vector, dev_vector, sizeof(int)*N, cudaMemcpyDeviceToHost)
+      != cudaSuccess)
+  {
+    printf("Error: cudaMemcpy dev to host failed\n");
+    exit(1);
+  }
+
+  // print out some of the result to check
+  print_some(vector, N, N/10 > 117 ? N/10 : 117);
+  errors = 0;
+  for (i = 0; i < N; i++) {
+    if (vector[i] != (i % 7) * scalar) {
+      errors++;
+    }
+  }
+  printf("%s\n", errors ? "ERROR: wrong result" : "result verified");
+
+  // time more launches (multiplying by 1, so the values do not overflow)
+  CUDA_LAUNCH(scalar_multiply, (N/BLOCK_SIZE), BLOCK_SIZE, dev_vector, identity);
+  gettimeofday(&tstart, NULL);
+  for (i = 0; i < NITER; i++) {
+    CUDA_LAUNCH(scalar_multiply, (N/BLOCK_SIZE), BLOCK_SIZE, dev_vector, identity);
+  }
+  gettimeofday(&tend, NULL);
+  time = getTime(tstart, tend) / NITER;
+  printf("N = %d, BLOCK_SIZE = %d: %g s per launch, %.2f GB/s\n",
+         N, BLOCK_SIZE, time, 2.0 * sizeof(int) * N / time / 1e9);
+
+  // free space
+  cudaFree(dev_vector);
+  free(vector);
+
+  return errors ? 1 : 0;
+}
+/***************************************************/
+/* host-side: vector initialization function */
+void init_array(int *vector, int size, int step) {
+
+  int i;
+
+  for(i=0; i < size; i++) {
+    vector[i] = i % step;
+  }
+
+}
+/* host-size: print out some vector values */
+void print_some(int *vector, int size, int step) {
+
+  int i;
+
+  i = 0;
+  while( i < size) {
+    printf("v[%d] = %d\n", i, vector[i]);
+    i = i + step;
+  }
+
+}
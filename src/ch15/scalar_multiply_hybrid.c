@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Hybrid MPI + OpenMP version of the scalar multiply and histogram
+ * (countElems) kernels.
+ *
+ * Instead of one single-threaded MPI process per core, a hybrid program
+ * runs fewer MPI processes (for example one per socket) and uses OpenMP
+ * threads inside each one.  Fewer processes means less MPI communication
+ * and less duplicated memory, and the threads of a process share its data.
+ *
+ *   - MPI is initialized with MPI_Init_thread(MPI_THREAD_FUNNELED): threads
+ *     are used, but only the main thread makes MPI calls
+ *   - the local kernels are OpenMP parallel loops with proc_bind(close),
+ *     so each process's threads are kept on the cores nearest to it,
+ *     within the places listed by OMP_PLACES
+ *
+ * Each run measures one configuration: the processes it was started with,
+ * and <threads> threads in each.  It prints the time of each kernel, along
+ * with the CPUs the first process's threads ran on.  Each configuration
+ * needs its own launch, because each needs its own binding: every process
+ * must be given as many cores as it has threads.
+ *
+ * To compile: mpicc -O2 -fopenmp -o scalar_multiply_hybrid scalar_multiply_hybrid.c
+ *
+ * To run: mpirun -np <procs> ./scalar_multiply_hybrid <n> <threads>
+ *
+ *   # the same problem on 32 cores, as 1 x 32, 2 x 16, ..., 32 x 1
+ *   # (--map-by slot:PE=t binds each process to t cores of its own):
+ *   for q in 1 2 4 8 16 32; do
+ *       OMP_PLACES=cores mpirun -np $q --map-by slot:PE=$((32 / q)) --bind-to core \
+ *           ./scalar_multiply_hybrid 400000000 $((32 / q))
+ *   done
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <omp.h>
+#include "mpi.h"
+
+#define SCALAR (10)
+#define MAX 10        /* histogram values are 0 to MAX-1 */
+#define NITER 5       /* times each kernel is run (time is averaged) */
+#define SHOW_CPUS 8   /* number of threads whose CPU is printed */
+
+/* Multiply each element of an array by a scalar value, with the iterations
+ * divided among the threads. */
+void scalar_multiply(int *array, long array_size, int scalar) {
+    long i;
+    #pragma omp parallel for proc_bind(close) schedule(static)
+    for (i = 0; i < array_size; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* countElems from ch14/countSort_mp.c: each thread builds a private
+ * histogram of its part of the array, then adds it to counts. */
+void countElems(long *counts, int *array, long length) {
+    #pragma omp parallel proc_bind(close)
+    {
+        long i, local[MAX] = {0};
+        #pragma omp for schedule(static)
+        for (i = 0; i < length; i++) {
+            local[array[i]]++;
+        }
+
+        #pragma omp critical
+        {
+            for (i = 0; i < MAX; i++) {
+                counts[i] += local[i];
+            }
+        }
+    }
+}
+
+/* Fills the array in parallel.  Because each thread first touches the
+ * same part of the array it will later compute on, the operating system
+ * places those pages in the memory nearest that thread's socket. */
+void fill_array(int *array, long length, long offset) {
+    long i;
+    #pragma omp parallel for proc_bind(close) schedule(static)
+    for (i = 0; i < length; i++) {
+        array[i] = (offset + i) % MAX;
+    }
+}
+
+/* Records the CPU that each of the first SHOW_CPUS threads is running on. */
+void thread_cpus(int *cpus) {
+    int i;
+    for (i = 0; i < SHOW_CPUS; i++) cpus[i] = -1;
+    #pragma omp parallel proc_bind(close)
+    {
+        int t = omp_get_thread_num();
+        if (t < SHOW_CPUS) cpus[t] = sched_getcpu();
+    }
+}
+
+/* Runs both kernels on the processes in comm with nthreads threads each, on
+ * a total of n elements.  Returns the slowest process's times in t_mult and
+ * t_count, and counts wrong results in *errors. */
+void run_config(MPI_Comm comm, long n, int nthreads, double *t_mult,
+                double *t_count, int *cpus, long *errors) {
+    int rank, p, iter, v;
+    long length, offset, i, counts[MAX], total;
+    double start, t[2];
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    omp_set_num_threads(nthreads);
+
+    length = n / p + (rank < n % p);
+    offset = rank * (n / p) + (rank < n % p ? rank : n % p);
+    int *array = malloc((length > 0 ? length : 1) * sizeof(int));
+    if (array == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+    fill_array(array, length, offset);
+    thread_cpus(cpus);
+
+    /* histogram: local counts with threads, then a global sum with MPI
+     * (called only by the main thread, as MPI_THREAD_FUNNELED requires) */
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        for (v = 0; v < MAX; v++) counts[v] = 0;
+        countElems(counts, array, length);
+        MPI_Allreduce(MPI_IN_PLACE, counts, MAX, MPI_LONG, MPI_SUM, comm);
+    }
+    t[1] = (MPI_Wtime() - start) / NITER;
+    total = 0;
+    for (v = 0; v < MAX; v++) total += counts[v];
+    if (total != n) (*errors)++;
+
+    /* scalar multiply (by -1, so repeating it cannot overflow) */
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        scalar_multiply(array, length, -1);
+    }
+    t[0] = (MPI_Wtime() - start) / NITER;
+    scalar_multiply(array, length, SCALAR);
+    for (i = 0; i < length; i++) {
+        if (array[i] != ((offset + i) % MAX) * SCALAR * (NITER % 2 ? -1 : 1)) {
+            (*errors)++;
+            break;
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, t, 2, MPI_DOUBLE, MPI_MAX, comm);
+    *t_mult = t[0];
+    *t_count = t[1];
+    free(array);
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, provided, nthreads, i, cpus[SHOW_CPUS];
+    long n, errors = 0;
+    double t_mult, t_count;
+
+    /* Only the main thread of each process will call MPI. */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) fprintf(stderr, "MPI library does not support threads\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (argc != 3 || (n = strtol(argv[1], NULL, 10)) < 1
+        || (nthreads = strtol(argv[2], NULL, 10)) < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <n> <threads>\n", argv[0]);
+            fprintf(stderr, "where <n> is the total array size\n");
+            fprintf(stderr, "and <threads> is the number of threads in each process\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    run_config(MPI_COMM_WORLD, n, nthreads, &t_mult, &t_count, cpus, &errors);
+    if (rank == 0) {
+        printf("%ld elements, %d procs x %d threads, OMP_PLACES=%s\n", n,
+               process_count, nthreads,
+               getenv("OMP_PLACES") ? getenv("OMP_PLACES") : "(unset)");
+        printf("  multiply %.6f s, histogram %.6f s, rank 0's threads on CPUs",
+               t_mult, t_count);
+        for (i = 0; i < SHOW_CPUS && i < nthreads; i++) {
+            printf(" %d", cpus[i]);
+        }
+        printf("%s\n", nthreads > SHOW_CPUS ? " ..." : "");
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("%s\n", errors ? "ERROR: wrong result" : "results verified");
+    }
+
+    MPI_Finalize();
+    return errors ? 1 : 0;
+}
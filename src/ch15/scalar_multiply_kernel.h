@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * The scalar multiply kernel, shared by scalar_multiply_cuda.cu (compiled
+ * with nvcc for a GPU) and scalar_multiply_cuda_cpu.cpp (compiled with g++,
+ * where cuda_cpu.h defines __global__ and the thread index variables).
+ * Include it after cuda.h or cuda_cpu.h.
+ */
+#ifndef _SCALAR_MULTIPLY_KERNEL_H_
+#define _SCALAR_MULTIPLY_KERNEL_H_
+
+/*
+ * CUDA kernel function that performs scalar multiply
+ * of a vector on the GPU device
+ *
+ * This assumes that there are enough threads to associated
+ * each array[i] element with a signal thread
+ * (in general, each thread would be responsible for a set of data elements)
+ */
+__global__ void scalar_multiply(int *array, int scalar) {
+
+  int index;
+
+  // get the thread's index value based on its
+  // position in the enclosing block and grid
+  index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  array[index] = array[index] * scalar;
+}
+
+#endif
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * scalar_multiply_mpi.c with its input read from, and its output written
+ * to, array files (see ../ch14/arrayfile.h) with MPI-IO.
+ *
+ * Two ways of doing the I/O are compared:
+ *
+ *   boss:     as suggested in scalar_multiply_mpi.c, the boss reads the whole
+ *             input file, scatters it, gathers the results and writes the
+ *             whole output file.  All of the data passes through rank 0,
+ *             which must also have enough memory to hold all of it.
+ *
+ *   parallel: every process opens the files, reads only its own slice of
+ *             the input with the collective MPI_File_read_at_all, and writes
+ *             its slice of the output with MPI_File_write_at_all.  Nothing
+ *             is scattered or gathered, and each process only ever holds
+ *             its own slice.  Because the calls are collective, the MPI
+ *             library can combine the processes' requests into large
+ *             contiguous file accesses.
+ *
+ * Both modes print the time of each phase (for the slowest process) and
+ * the largest buffer any process allocated, then re-read the input and
+ * output files and check every element of the output.
+ *
+ * To compile:
+ *   mpicc -O2 -I../ch14 -o scalar_multiply_mpi_io scalar_multiply_mpi_io.c ../ch14/arrayfile.c
+ *
+ * To run: mpirun -np <p> ./scalar_multiply_mpi_io <input> <output> <boss|parallel>
+ *   ../ch14/genArrayFile in.arr uniform 100 100000000
+ *   mpirun -np 8 ./scalar_multiply_mpi_io in.arr out.arr parallel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "mpi.h"
+#include "arrayfile.h"
+
+#define SCALAR (10)
+#ifndef CHUNK
+#define CHUNK (1L << 28) /* most elements moved by one MPI-IO call */
+#endif
+
+/* Prints an MPI error message for the call that returned rc and aborts. */
+void check(int rc, const char *what) {
+    char msg[MPI_MAX_ERROR_STRING];
+    int len;
+
+    if (rc != MPI_SUCCESS) {
+        MPI_Error_string(rc, msg, &len);
+        fprintf(stderr, "%s: %s\n", what, msg);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+/* Allocates an array of count ints, aborting if there is not enough memory. */
+int *alloc_ints(long count) {
+    int *array = malloc((count > 0 ? count : 1) * sizeof(int));
+    if (array == NULL) {
+        fprintf(stderr, "cannot allocate %ld ints\n", count);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return array;
+}
+
+/* Multiply each element of an array by a scalar value. */
+void scalar_multiply(int *array, long array_size, int scalar) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* Reads the header of an array file on rank 0 and broadcasts it, aborting
+ * if the file is not a one-dimensional array of ints, or is shorter than
+ * its header says. */
+void read_header(MPI_File fh, struct arrayfile_header *h) {
+    MPI_Status status;
+    MPI_Offset size;
+    const char *problem;
+    int rank, got, ok = 1;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        check(MPI_File_get_size(fh, &size), "getting input size");
+        check(MPI_File_read_at(fh, 0, h, sizeof(*h), MPI_BYTE, &status),
+              "reading header");
+        MPI_Get_count(&status, MPI_BYTE, &got);
+        /* the same checks as af_open, then this program's own */
+        if (got != sizeof(*h)) {
+            fprintf(stderr, "input is not an array file\n");
+            ok = 0;
+        } else if ((problem = af_check_header(h, size)) != NULL) {
+            fprintf(stderr, "input: %s\n", problem);
+            ok = 0;
+        } else if (h->elem_type != AF_INT32 || h->ndims != 1) {
+            fprintf(stderr, "input must be a one-dimensional array of ints\n");
+            ok = 0;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Bcast(h, sizeof(*h), MPI_BYTE, 0, MPI_COMM_WORLD);
+}
+
+/* Writes the header of an array of n ints. */
+void write_header(MPI_File fh, long n) {
+    char header[AF_ALIGN];
+    struct arrayfile_header *h = (struct arrayfile_header *)header;
+
+    memset(header, 0, sizeof(header));
+    memcpy(h->magic, AF_MAGIC, sizeof(h->magic));
+    h->version = AF_VERSION;
+    h->elem_type = AF_INT32;
+    h->elem_size = sizeof(int);
+    h->ndims = 1;
+    h->count = n;
+    h->dims[0] = n;
+    MPI_Status status;
+    int done;
+
+    check(MPI_File_write_at(fh, 0, header, sizeof(header), MPI_BYTE, &status),
+          "writing header");
+    MPI_Get_count(&status, MPI_BYTE, &done);
+    if (done != sizeof(header)) {
+        fprintf(stderr, "writing header: only %d of %zu bytes written\n",
+                done, sizeof(header));
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+/* Reads (or, if write is 1, writes) count ints starting at element start of
+ * the data section.  The counts of MPI calls are ints, so the transfer is
+ * split into CHUNK-element calls.
+ *
+ * If collective is 1, every process that opened fh must call this, and the
+ * collective MPI_File_read_at_all/write_at_all are used; every process
+ * makes the same number of calls, as collective I/O requires, even if it
+ * has fewer (or no) elements left.  Otherwise the independent
+ * MPI_File_read_at/write_at are used, and only the caller takes part.
+ *
+ * A call that moves fewer elements than asked for (a read past the end of
+ * the file, or a full disk) aborts. */
+void transfer(MPI_File fh, int *buf, long start, long count, int write,
+              int collective) {
+    long rounds = (count + CHUNK - 1) / CHUNK, r, done, len;
+    MPI_Offset offset;
+    MPI_Status status;
+    int rc, moved;
+
+    if (collective) {
+        MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+    }
+    for (r = 0; r < rounds; r++) {
+        done = r * CHUNK < count ? r * CHUNK : count;
+        len = count - done < CHUNK ? count - done : CHUNK;
+        offset = AF_ALIGN + (MPI_Offset)(start + done) * sizeof(int);
+        if (write && collective) {
+            rc = MPI_File_write_at_all(fh, offset, buf + done, len, MPI_INT,
+                                       &status);
+        } else if (write) {
+            rc = MPI_File_write_at(fh, offset, buf + done, len, MPI_INT,
+                                   &status);
+        } else if (collective) {
+            rc = MPI_File_read_at_all(fh, offset, buf + done, len, MPI_INT,
+                                      &status);
+        } else {
+            rc = MPI_File_read_at(fh, offset, buf + done, len, MPI_INT,
+                                  &status);
+        }
+        check(rc, write ? "writing data" : "reading data");
+        MPI_Get_count(&status, MPI_INT, &moved);
+        if (moved != len) {
+            fprintf(stderr, "%s data: only %d of %ld elements at element %ld\n",
+                    write ? "writing" : "reading", moved, len, start + done);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+}
+
+/* per-phase times and the largest buffer (in elements) of one process */
+struct result {
+    double t[3];   /* read, compute (including scatter/gather), write */
+    long buf_elems;
+};
+
+/* Every process reads and writes its own slice. */
+struct result run_parallel(MPI_File in, MPI_File out, long n) {
+    struct result res;
+    int rank, p;
+    long start, count;
+    double t0;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    count = n / p + (rank < n % p);
+    start = rank * (n / p) + (rank < n % p ? rank : n % p);
+    int *local_array = alloc_ints(count);
+    res.buf_elems = count;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = MPI_Wtime();
+    transfer(in, local_array, start, count, 0, 1);
+    res.t[0] = MPI_Wtime() - t0;
+
+    t0 = MPI_Wtime();
+    scalar_multiply(local_array, count, SCALAR);
+    res.t[1] = MPI_Wtime() - t0;
+
+    t0 = MPI_Wtime();
+    transfer(out, local_array, start, count, 1, 1);
+    res.t[2] = MPI_Wtime() - t0;
+
+    free(local_array);
+    return res;
+}
+
+/* The boss reads the whole input, scatters it, gathers the results and
+ * writes the whole output. */
+struct result run_boss(MPI_File in, MPI_File out, long n) {
+    struct result res;
+    int rank, p, i, local_size;
+    int *array = NULL, *counts = NULL, *displs = NULL;
+    double t0;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    if (n > INT_MAX) {
+        if (rank == 0) {
+            fprintf(stderr, "boss mode needs fewer than %d elements\n", INT_MAX);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    local_size = n / p + (rank < n % p);
+    int *local_array = alloc_ints(local_size);
+    res.buf_elems = local_size;
+
+    if (rank == 0) {
+        array = alloc_ints(n);
+        counts = malloc(p * sizeof(int));
+        displs = malloc(p * sizeof(int));
+        if (counts == NULL || displs == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+        for (i = 0; i < p; i++) {
+            counts[i] = n / p + (i < n % p);
+            displs[i] = i == 0 ? 0 : displs[i - 1] + counts[i - 1];
+        }
+        res.buf_elems += n;
+    }
+
+    /* only the boss touches the files */
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = MPI_Wtime();
+    if (rank == 0) {
+        transfer(in, array, 0, n, 0, 0);
+    }
+    res.t[0] = MPI_Wtime() - t0;
+
+    t0 = MPI_Wtime();
+    MPI_Scatterv(array, counts, displs, MPI_INT, local_array, local_size,
+                 MPI_INT, 0, MPI_COMM_WORLD);
+    scalar_multiply(local_array, local_size, SCALAR);
+    MPI_Gatherv(local_array, local_size, MPI_INT, array, counts, displs,
+                MPI_INT, 0, MPI_COMM_WORLD);
+    res.t[1] = MPI_Wtime() - t0;
+
+    t0 = MPI_Wtime();
+    if (rank == 0) {
+        transfer(out, array, 0, n, 1, 0);
+    }
+    res.t[2] = MPI_Wtime() - t0;
+
+    free(array);
+    free(counts);
+    free(displs);
+    free(local_array);
+    return res;
+}
+
+/* Re-reads this process's slice of the input and output files, using the
+ * same collective reads as parallel mode, and returns the number of output
+ * elements that are not SCALAR times their input element. */
+long check_output(const char *in_path, const char *out_path, long n) {
+    MPI_File in, out;
+    int rank, p;
+    long start, count, i, wrong = 0;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    count = n / p + (rank < n % p);
+    start = rank * (n / p) + (rank < n % p ? rank : n % p);
+
+    check(MPI_File_open(MPI_COMM_WORLD, in_path, MPI_MODE_RDONLY, MPI_INFO_NULL, &in),
+          in_path);
+    check(MPI_File_open(MPI_COMM_WORLD, out_path, MPI_MODE_RDONLY, MPI_INFO_NULL, &out),
+          out_path);
+    int *in_buf = alloc_ints(count);
+    int *out_buf = alloc_ints(count);
+    transfer(in, in_buf, start, count, 0, 1);
+    transfer(out, out_buf, start, count, 0, 1);
+    for (i = 0; i < count; i++) {
+        if (out_buf[i] != in_buf[i] * SCALAR) {
+            if (wrong == 0) {
+                fprintf(stderr, "rank %d: element %ld is %d, should be %d\n", rank,
+                        start + i, out_buf[i], in_buf[i] * SCALAR);
+            }
+            wrong++;
+        }
+    }
+    free(in_buf);
+    free(out_buf);
+    MPI_File_close(&in);
+    MPI_File_close(&out);
+    return wrong;
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, parallel;
+    long n, wrong;
+    struct arrayfile_header h;
+    struct result res;
+    MPI_File in, out;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc != 4 || (strcmp(argv[3], "boss") != 0 && strcmp(argv[3], "parallel") != 0)) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <input> <output> <boss|parallel>\n", argv[0]);
+            fprintf(stderr, "where <input> is an array file of ints (see ../ch14/genArrayFile)\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    parallel = strcmp(argv[3], "parallel") == 0;
+
+    /* Every process opens the files (the open is collective), but in boss
+     * mode only rank 0 reads or writes them. */
+    check(MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL, &in),
+          argv[1]);
+    read_header(in, &h);
+    n = h.count;
+
+    check(MPI_File_open(MPI_COMM_WORLD, argv[2], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                        MPI_INFO_NULL, &out), argv[2]);
+    /* discard any old contents, then let the boss write the header */
+    check(MPI_File_set_size(out, AF_ALIGN + (MPI_Offset)n * sizeof(int)),
+          "setting output size");
+    if (rank == 0) {
+        write_header(out, n);
+    }
+
+    res = parallel ? run_parallel(in, out, n) : run_boss(in, out, n);
+
+    MPI_File_close(&in);
+    MPI_File_close(&out);
+
+    /* slowest process's times and largest buffer */
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : res.t, res.t, 3, MPI_DOUBLE, MPI_MAX,
+               0, MPI_COMM_WORLD);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &res.buf_elems, &res.buf_elems, 1,
+               MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    /* check: every output element must be SCALAR times its input element */
+    wrong = check_output(argv[1], argv[2], n);
+    MPI_Allreduce(MPI_IN_PLACE, &wrong, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        printf("%s mode, %ld elements, %d processes\n", argv[3], n, process_count);
+        printf("  %-28s %10.6f s\n", "read:", res.t[0]);
+        printf("  %-28s %10.6f s\n",
+               parallel ? "compute:" : "scatter + compute + gather:", res.t[1]);
+        printf("  %-28s %10.6f s\n", "write:", res.t[2]);
+        printf("  largest buffer on one process: %.2f MiB\n",
+               res.buf_elems * sizeof(int) / 1048576.0);
+        if (wrong == 0) {
+            printf("output verified\n");
+        } else {
+            printf("ERROR: %ld wrong output elements\n", wrong);
+        }
+    }
+
+    MPI_Finalize();
+    return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * Pipelined version of scalar_multiply_mpi.c that overlaps communication
+ * with computation.
+ *
+ * In the original program every process waits for its whole chunk to be
+ * scattered before it starts computing, and the boss waits for every
+ * process to finish computing before anything is gathered.  Here each
+ * process's part of the array is split into smaller chunks that are sent
+ * with nonblocking point-to-point messages (MPI_Isend/MPI_Irecv):
+ *
+ *   - each worker has two receive buffers (double buffering): while it
+ *     multiplies chunk k in one buffer, chunk k+1 is arriving in the other
+ *   - as soon as a chunk is done, the worker starts sending it back, and
+ *     moves on to the next chunk without waiting for the send to complete
+ *   - the boss sends chunk k to every worker, multiplies its own chunk k
+ *     while those messages are in flight, then moves on to chunk k+1
+ *
+ * The program runs the original blocking scatter/compute/gather and the
+ * pipelined version on the same data, and reports how much of the blocking
+ * version's communication time the pipeline hides.  Both versions are run
+ * once untimed to warm up, then REPS times each, alternating which goes
+ * first, and the median times are reported.
+ *
+ * To compile:
+ *   mpicc -O2 -o scalar_multiply_mpi_pipelined scalar_multiply_mpi_pipelined.c
+ *
+ * To run: mpirun -np <p> ./scalar_multiply_mpi_pipelined <n> <chunk>
+ *   n:     array size (must fit in an int)
+ *   chunk: number of elements per pipelined message
+ *
+ *   mpirun -np 4 ./scalar_multiply_mpi_pipelined 100000000 1000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "mpi.h"
+
+#define SCALAR (10)
+#define REPS (5) /* timed runs of each version (the median is reported) */
+#define PROGRESS_BLOCK (16384) /* elements multiplied between MPI_Testall calls */
+
+/* Message tag for chunk k.  MPI only guarantees tags up to 32767, so they
+ * wrap around; that is safe because messages between two processes with
+ * the same tag are always matched in the order they were sent. */
+#define TAG(k) ((int)((k) % 32768))
+
+/* Builds the input array.  In a real application, the boss process would
+ * likely read its input from a data file. */
+int *build_array(long array_size) {
+    long i;
+    int *result = malloc(array_size * sizeof(int));
+
+    if (result == NULL) {
+        fprintf(stderr, "boss: cannot allocate %ld elements\n", array_size);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (i = 0; i < array_size; i++) {
+        result[i] = i % 1000;
+    }
+
+    return result;
+}
+
+/* Multiply each element of an array by a scalar value. */
+void scalar_multiply(int *array, long array_size, int scalar) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* Multiplies like scalar_multiply, but calls MPI_Testall on the npending
+ * requests in pending every PROGRESS_BLOCK elements.  Many MPI
+ * implementations only move large messages forward while the program is
+ * inside an MPI call, so without these calls the messages in flight would
+ * not actually move during the computation. */
+void scalar_multiply_progress(int *array, long array_size, int scalar,
+                              MPI_Request *pending, int npending) {
+    long i, n;
+    int flag;
+    for (i = 0; i < array_size; i += PROGRESS_BLOCK) {
+        n = array_size - i < PROGRESS_BLOCK ? array_size - i : PROGRESS_BLOCK;
+        scalar_multiply(array + i, n, scalar);
+        MPI_Testall(npending, pending, &flag, MPI_STATUSES_IGNORE);
+    }
+}
+
+/* Balanced decomposition: the first n % p processes get one extra element.
+ * Fills in counts and displacements for every process. */
+void balanced_counts(long n, int p, int *counts, int *displs) {
+    int i;
+    long start = 0;
+    for (i = 0; i < p; i++) {
+        counts[i] = n / p + (i < n % p);
+        displs[i] = start;
+        start += counts[i];
+    }
+}
+
+/* number of elements in chunk k of a slice of size len */
+int chunk_len(int len, int chunk, long k) {
+    long left = len - k * chunk;
+    return left < chunk ? left : chunk;
+}
+
+/* Boss side of the pipeline.  Sends chunk k of every worker's slice, then
+ * multiplies its own chunk k while the sends are in flight.  Each result
+ * is received directly back into array, in place of the chunk that was
+ * sent from there.  Returns the time spent waiting in MPI_Wait calls. */
+double pipeline_boss(int *array, int *counts, int *displs, int process_count,
+                     int chunk, int scalar, long nchunks) {
+    MPI_Request *sreq = malloc(process_count * sizeof(MPI_Request));
+    MPI_Request *rreq = malloc(nchunks * process_count * sizeof(MPI_Request));
+    double start, wait = 0;
+    long k;
+    int w, n;
+
+    if (sreq == NULL || rreq == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (k = 0; k < nchunks * process_count; k++) {
+        rreq[k] = MPI_REQUEST_NULL;
+    }
+
+    for (k = 0; k < nchunks; k++) {
+        sreq[0] = MPI_REQUEST_NULL;
+        for (w = 1; w < process_count; w++) {
+            sreq[w] = MPI_REQUEST_NULL;
+            n = chunk_len(counts[w], chunk, k);
+            if (n > 0) {
+                MPI_Isend(array + displs[w] + k * chunk, n, MPI_INT, w, TAG(k),
+                          MPI_COMM_WORLD, &sreq[w]);
+            }
+        }
+
+        /* boss's own share of the work, overlapped with the sends */
+        n = chunk_len(counts[0], chunk, k);
+        if (n > 0) {
+            scalar_multiply_progress(array + k * chunk, n, scalar, sreq, process_count);
+        }
+
+        /* a chunk's memory can only be reused for its result once it has
+         * been sent */
+        start = MPI_Wtime();
+        MPI_Waitall(process_count, sreq, MPI_STATUSES_IGNORE);
+        wait += MPI_Wtime() - start;
+
+        for (w = 1; w < process_count; w++) {
+            n = chunk_len(counts[w], chunk, k);
+            if (n > 0) {
+                MPI_Irecv(array + displs[w] + k * chunk, n, MPI_INT, w, TAG(k),
+                          MPI_COMM_WORLD, &rreq[k * process_count + w]);
+            }
+        }
+    }
+
+    start = MPI_Wtime();
+    MPI_Waitall(nchunks * process_count, rreq, MPI_STATUSES_IGNORE);
+    wait += MPI_Wtime() - start;
+
+    free(sreq);
+    free(rreq);
+    return wait;
+}
+
+/* Worker side of the pipeline, with two buffers.  Chunk k is received into
+ * buf[k % 2]; while it is being multiplied, chunk k+1 is already being
+ * received into the other buffer.  Returns the time spent waiting. */
+double pipeline_worker(int len, int chunk, int scalar, long nchunks) {
+    int *buf[2];
+    MPI_Request rreq[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    MPI_Request sreq[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    double start, wait = 0;
+    long k;
+    int b, n;
+
+    buf[0] = malloc(chunk * sizeof(int));
+    buf[1] = malloc(chunk * sizeof(int));
+    if (buf[0] == NULL || buf[1] == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (nchunks > 0 && len > 0) {
+        MPI_Irecv(buf[0], chunk_len(len, chunk, 0), MPI_INT, 0, 0,
+                  MPI_COMM_WORLD, &rreq[0]);
+    }
+
+    for (k = 0; k < nchunks && chunk_len(len, chunk, k) > 0; k++) {
+        b = k % 2;
+        n = chunk_len(len, chunk, k);
+
+        /* wait for chunk k to arrive */
+        start = MPI_Wtime();
+        MPI_Wait(&rreq[b], MPI_STATUS_IGNORE);
+        wait += MPI_Wtime() - start;
+
+        /* start receiving chunk k+1 into the other buffer, once the result
+         * that was being sent from that buffer (chunk k-1) has gone */
+        if (k + 1 < nchunks && chunk_len(len, chunk, k + 1) > 0) {
+            start = MPI_Wtime();
+            MPI_Wait(&sreq[1 - b], MPI_STATUS_IGNORE);
+            wait += MPI_Wtime() - start;
+            MPI_Irecv(buf[1 - b], chunk_len(len, chunk, k + 1), MPI_INT, 0,
+                      TAG(k + 1), MPI_COMM_WORLD, &rreq[1 - b]);
+        }
+
+        scalar_multiply_progress(buf[b], n, scalar, &rreq[1 - b], 1);
+
+        MPI_Isend(buf[b], n, MPI_INT, 0, TAG(k), MPI_COMM_WORLD, &sreq[b]);
+    }
+
+    start = MPI_Wtime();
+    MPI_Waitall(2, sreq, MPI_STATUSES_IGNORE);
+    wait += MPI_Wtime() - start;
+
+    free(buf[0]);
+    free(buf[1]);
+    return wait;
+}
+
+/* Boss checks the final array. */
+long count_errors(int *array, long array_size, int scalar) {
+    long j, errors = 0;
+    for (j = 0; j < array_size; j++) {
+        if (array[j] != (j % 1000) * scalar) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* Runs the blocking version: scatter, compute, gather.  Fills in t[0], t[1]
+ * and t[2] with this process's time for each. */
+void run_blocking(int *array, int *local_array, int *counts, int *displs,
+                  int rank, int scalar, double *t) {
+    double start;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Scatterv(array, counts, displs, MPI_INT, local_array, counts[rank],
+                 MPI_INT, 0, MPI_COMM_WORLD);
+    t[0] = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    scalar_multiply(local_array, counts[rank], scalar);
+    t[1] = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    MPI_Gatherv(local_array, counts[rank], MPI_INT, array, counts, displs,
+                MPI_INT, 0, MPI_COMM_WORLD);
+    t[2] = MPI_Wtime() - start;
+}
+
+/* Runs the pipelined version.  Fills in t[3] with this process's total time
+ * and t[4] with its time waiting on messages. */
+void run_pipelined(int *array, int *counts, int *displs, int rank,
+                   int process_count, int chunk, int scalar, long nchunks,
+                   double *t) {
+    double start;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    if (rank == 0) {
+        t[4] = pipeline_boss(array, counts, displs, process_count, chunk,
+                             scalar, nchunks);
+    } else {
+        t[4] = pipeline_worker(counts[rank], chunk, scalar, nchunks);
+    }
+    t[3] = MPI_Wtime() - start;
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* median of the n values in x (which it sorts) */
+double median(double *x, int n) {
+    qsort(x, n, sizeof(double), cmp_double);
+    return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, chunk, rep, v, j;
+    long array_size, chunk_arg, nchunks;
+    int scalar = SCALAR;
+    int *array = NULL, *local_array, *counts, *displs;
+    double mine[5], slowest[5], runs[5][REPS], med[5];
+    long errors = 0;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+
+    /* Determine how many processes there are and which one this is. */
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc != 3) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <n> <chunk>\n", argv[0]);
+            fprintf(stderr, "where <n> is the array size\n");
+            fprintf(stderr, "and <chunk> is the number of elements per message\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    array_size = strtol(argv[1], NULL, 10);
+    chunk_arg = strtol(argv[2], NULL, 10);
+    if (array_size < 1 || array_size > INT_MAX || chunk_arg < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "n must be between 1 and %d, chunk must be positive\n", INT_MAX);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    counts = malloc(process_count * sizeof(int));
+    displs = malloc(process_count * sizeof(int));
+    if (counts == NULL || displs == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    balanced_counts(array_size, process_count, counts, displs);
+    local_array = malloc((counts[rank] > 0 ? counts[rank] : 1) * sizeof(int));
+    if (local_array == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* a chunk larger than the largest slice (counts[0]) is the same as
+     * that slice: clamping it keeps the arithmetic below within int */
+    chunk = chunk_arg < counts[0] ? chunk_arg : counts[0];
+
+    /* every process has the most elements that any process has, rounded up
+     * to a whole number of chunks */
+    nchunks = ((long)counts[0] + chunk - 1) / chunk;
+
+    /* Run 0 warms up both versions (the first run of anything pays for page
+     * faults and for MPI setting up its connections) and is not counted.
+     * After it, the order alternates, so that neither version always runs
+     * first. */
+    for (rep = 0; rep <= REPS; rep++) {
+        for (v = 0; v < 2; v++) {
+            if (rank == 0) {
+                array = build_array(array_size); /* fresh input for each run */
+            }
+            if ((v + rep) % 2 == 0) {
+                run_blocking(array, local_array, counts, displs, rank, scalar, mine);
+            } else {
+                run_pipelined(array, counts, displs, rank, process_count, chunk,
+                              scalar, nchunks, mine);
+            }
+            if (rank == 0) {
+                errors += count_errors(array, array_size, scalar);
+                free(array);
+            }
+        }
+
+        /* the slowest process's time for each measurement */
+        MPI_Reduce(mine, slowest, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rep > 0) {
+            for (j = 0; j < 5; j++) {
+                runs[j][rep - 1] = slowest[j];
+            }
+        }
+    }
+
+    if (rank == 0) {
+        for (j = 0; j < 5; j++) {
+            med[j] = median(runs[j], REPS);
+        }
+        double t_block = med[0] + med[1] + med[2];
+        double t_comm = med[0] + med[2];
+        double hidden = t_block - med[3];
+        printf("%ld elements on %d processes, %d elements per chunk (%ld chunks each)\n",
+               array_size, process_count, chunk, nchunks);
+        printf("median of %d runs after a warm-up run:\n", REPS);
+        printf("blocking:  scatter %.6f  compute %.6f  gather %.6f  total %.6f s\n",
+               med[0], med[1], med[2], t_block);
+        printf("pipelined: total %.6f s, longest time waiting on messages %.6f s\n",
+               med[3], med[4]);
+        printf("communication hidden: %.6f s of %.6f s (%.1f%%)\n",
+               hidden > 0 ? hidden : 0, t_comm,
+               t_comm > 0 && hidden > 0 ? 100.0 * hidden / t_comm : 0.0);
+        printf("%s\n", errors ? "ERROR: wrong result" : "results verified");
+    }
+
+    /* Clean up. */
+    free(local_array);
+    free(counts);
+    free(displs);
+    MPI_Finalize();
+
+    return errors ? 1 : 0;
+}
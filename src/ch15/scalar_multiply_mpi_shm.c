@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * scalar_multiply_mpi.c without copies, for processes on the same machine.
+ *
+ * MPI_Scatter and MPI_Gather copy the whole array twice: once from the
+ * boss to the workers and once back.  When all the processes run on one
+ * machine, they can instead share a single copy of the array:
+ *
+ *   - MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) groups the processes that
+ *     can share memory (those on the same node) into a node communicator
+ *   - MPI_Win_allocate_shared allocates the array in memory that every
+ *     process in that communicator can map; the node's boss allocates all
+ *     of it and the others allocate nothing
+ *   - MPI_Win_shared_query gives every process a pointer to the array, and
+ *     each process multiplies its own slice in place
+ *
+ * The program runs the scatter/gather version and the shared-memory
+ * version and compares their run times and how much memory each process
+ * uses for the array.  As in scalar_multiply_mpi_pipelined.c, both versions
+ * run once untimed to warm up, then REPS times each, alternating which goes
+ * first, and the median times are reported.  Processes on different nodes each get their own
+ * shared array (this example does not combine results across nodes).
+ *
+ * To compile: mpicc -O2 -o scalar_multiply_mpi_shm scalar_multiply_mpi_shm.c
+ *
+ * To run: mpirun -np <p> ./scalar_multiply_mpi_shm <n>
+ *   mpirun -np 4 ./scalar_multiply_mpi_shm 100000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "mpi.h"
+
+#define SCALAR (10)
+#define REPS (5) /* timed runs of each version (the median is reported) */
+
+/* Fills array with a simple pattern.  In a real application, the boss
+ * process would likely read its input from a data file. */
+void fill_array(int *array, long array_size) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        array[i] = i % 1000;
+    }
+}
+
+/* Multiply each element of an array by a scalar value. */
+void scalar_multiply(int *array, long array_size, int scalar) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* Balanced decomposition: the first n % p processes get one extra element.
+ * Fills in counts and displacements for every process. */
+void balanced_counts(long n, int p, int *counts, int *displs) {
+    int i;
+    long start = 0;
+    for (i = 0; i < p; i++) {
+        counts[i] = n / p + (i < n % p);
+        displs[i] = start;
+        start += counts[i];
+    }
+}
+
+/* Boss checks the final array. */
+long count_errors(int *array, long array_size, int scalar) {
+    long j, errors = 0;
+    for (j = 0; j < array_size; j++) {
+        if (array[j] != (j % 1000) * scalar) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* The original approach: the boss holds the array and scatters it, every
+ * process multiplies a private copy of its slice, and the boss gathers
+ * the results.  Returns the elapsed time; *bytes is set to the memory this
+ * process used for array data. */
+double run_scatter_gather(MPI_Comm comm, long array_size, int scalar,
+                          long *errors, long *bytes) {
+    int rank, size;
+    int *array = NULL, *local_array, *counts, *displs;
+    double start, elapsed;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    counts = malloc(size * sizeof(int));
+    displs = malloc(size * sizeof(int));
+    if (counts == NULL || displs == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    balanced_counts(array_size, size, counts, displs);
+
+    *bytes = counts[rank] * sizeof(int);
+    if (rank == 0) {
+        array = malloc(array_size * sizeof(int));
+        if (array == NULL) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fill_array(array, array_size);
+        *bytes += array_size * sizeof(int);
+    }
+    local_array = malloc((counts[rank] > 0 ? counts[rank] : 1) * sizeof(int));
+    if (local_array == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    MPI_Scatterv(array, counts, displs, MPI_INT, local_array, counts[rank],
+                 MPI_INT, 0, comm);
+    scalar_multiply(local_array, counts[rank], scalar);
+    MPI_Gatherv(local_array, counts[rank], MPI_INT, array, counts, displs,
+                MPI_INT, 0, comm);
+    elapsed = MPI_Wtime() - start;
+
+    if (rank == 0) {
+        *errors += count_errors(array, array_size, scalar);
+        free(array);
+    }
+    free(local_array);
+    free(counts);
+    free(displs);
+    return elapsed;
+}
+
+/* The shared-memory approach: the boss of comm (a node communicator)
+ * allocates the whole array in a shared window, and every process
+ * multiplies its slice of that one array in place.  Returns the elapsed
+ * time; *bytes is set to the memory this process allocated. */
+double run_shared(MPI_Comm comm, long array_size, int scalar,
+                  long *errors, long *bytes) {
+    int rank, size, disp_unit;
+    int *array, *counts, *displs;
+    MPI_Aint win_size;
+    MPI_Win win;
+    double start, elapsed;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    counts = malloc(size * sizeof(int));
+    displs = malloc(size * sizeof(int));
+    if (counts == NULL || displs == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    balanced_counts(array_size, size, counts, displs);
+
+    /* only the boss contributes memory to the window */
+    *bytes = rank == 0 ? array_size * sizeof(int) : 0;
+    MPI_Win_allocate_shared(*bytes, sizeof(int), MPI_INFO_NULL, comm,
+                            &array, &win);
+
+    /* everyone else looks up where the boss's memory is mapped in their
+     * own address space */
+    MPI_Win_shared_query(win, 0, &win_size, &disp_unit, &array);
+
+    /* the window is accessed with ordinary loads and stores; the lock_all
+     * epoch plus MPI_Win_sync and barriers make each process's writes
+     * visible to the others */
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    if (rank == 0) {
+        fill_array(array, array_size);
+    }
+    MPI_Win_sync(win);
+    MPI_Barrier(comm);
+
+    start = MPI_Wtime();
+    scalar_multiply(array + displs[rank], counts[rank], scalar);
+    MPI_Win_sync(win);
+    MPI_Barrier(comm);
+    elapsed = MPI_Wtime() - start;
+
+    MPI_Win_sync(win);
+    if (rank == 0) {
+        *errors += count_errors(array, array_size, scalar);
+    }
+    MPI_Win_unlock_all(win);
+
+    MPI_Win_free(&win);
+    free(counts);
+    free(displs);
+    return elapsed;
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* median of the n values in x (which it sorts) */
+double median(double *x, int n) {
+    qsort(x, n, sizeof(double), cmp_double);
+    return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, node_rank, node_size, rep, v, j;
+    long array_size, errors = 0, bytes_sg, bytes_shm;
+    long mem[2], mem_max[2], mem_sum[2];
+    double t[2], t_max[2], runs[2][REPS];
+    MPI_Comm node_comm;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+
+    /* Determine how many processes there are and which one this is. */
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc != 2 || (array_size = strtol(argv[1], NULL, 10)) < 1
+        || array_size > INT_MAX) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s <n>, where 0 < n <= %d is the array size\n",
+                    argv[0], INT_MAX);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Group the processes that can share memory with each other. */
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    /* Both versions run on the node communicator so they do the same work
+     * (on a single node, that is all of MPI_COMM_WORLD).  Run 0 warms up
+     * both versions (the first run of anything pays for page faults and
+     * for MPI setting up its connections) and is not counted.  After it,
+     * the order alternates, so that neither version always runs first. */
+    for (rep = 0; rep <= REPS; rep++) {
+        for (v = 0; v < 2; v++) {
+            if ((v + rep) % 2 == 0) {
+                t[0] = run_scatter_gather(node_comm, array_size, SCALAR, &errors,
+                                          &bytes_sg);
+            } else {
+                t[1] = run_shared(node_comm, array_size, SCALAR, &errors, &bytes_shm);
+            }
+        }
+
+        /* the slowest process's time for each version */
+        MPI_Reduce(t, t_max, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rep > 0) {
+            for (j = 0; j < 2; j++) {
+                runs[j][rep - 1] = t_max[j];
+            }
+        }
+    }
+
+    /* Report the median time, and the largest and total memory use. */
+    mem[0] = bytes_sg;
+    mem[1] = bytes_shm;
+    MPI_Reduce(mem, mem_max, 2, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(mem, mem_sum, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        for (j = 0; j < 2; j++) {
+            t_max[j] = median(runs[j], REPS);
+        }
+        printf("%ld elements, %d processes (%d on this node)\n",
+               array_size, process_count, node_size);
+        printf("median of %d runs after a warm-up run:\n", REPS);
+        printf("%-16s %12s %18s %18s\n", "version", "time (s)",
+               "max MiB/process", "total MiB");
+        printf("%-16s %12.6f %18.1f %18.1f\n", "scatter/gather", t_max[0],
+               mem_max[0] / 1048576.0, mem_sum[0] / 1048576.0);
+        printf("%-16s %12.6f %18.1f %18.1f\n", "shared window", t_max[1],
+               mem_max[1] / 1048576.0, mem_sum[1] / 1048576.0);
+        printf("%s\n", errors ? "ERROR: wrong result" : "results verified");
+    }
+
+    /* Clean up. */
+    MPI_Comm_free(&node_comm);
+    MPI_Finalize();
+
+    return errors ? 1 : 0;
+}
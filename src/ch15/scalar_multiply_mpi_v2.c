@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2020, Dive into Systems, LLC
+ * https://diveintosystems.org/
+ *
+ * scalar_multiply_mpi.c for arrays of any size.
+ *
+ * The original version assumes the array size divides evenly by the number
+ * of processes and that every count fits in an int.  This version:
+ *
+ *   - gives each process either floor(n/p) or ceil(n/p) elements, using
+ *     MPI_Scatterv and MPI_Gatherv, which take a separate count and
+ *     displacement for every process
+ *   - uses 64-bit sizes, so arrays can have billions of elements.  MPI
+ *     counts and displacements are ints, so for arrays too big to count in
+ *     ints, the data is sent in units of a contiguous datatype holding
+ *     several elements (see choose_unit)
+ *   - times each phase and reports the slowest process's time for each
+ *
+ * To compile: mpicc -O2 -o scalar_multiply_mpi_v2 scalar_multiply_mpi_v2.c
+ *
+ * To run: mpirun -np <p> ./scalar_multiply_mpi_v2 [n]
+ *   # 1 billion elements over 8 processes:
+ *   mpirun -np 8 ./scalar_multiply_mpi_v2 1000000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "mpi.h"
+
+#define ARRAY_SIZE (40)   /* default size if none is given */
+#define SCALAR (10)
+#define PRINT_LIMIT (100) /* only print arrays up to this size */
+
+/* largest count passed to an MPI call (define it smaller with -DMAX_COUNT=...
+ * to try out the multi-element units on a small array) */
+#ifndef MAX_COUNT
+#define MAX_COUNT INT_MAX
+#endif
+
+/* the phases that are timed */
+enum { T_BUILD, T_BCAST, T_SCATTER, T_COMPUTE, T_GATHER, T_VERIFY, NPHASES };
+static const char *phase_names[NPHASES] = {
+    "build", "bcast", "scatter", "compute", "gather", "verify"
+};
+
+/* In a real application, the boss process would likely read its input from a
+ * data file.  This example program produces a simple array of the requested
+ * size. */
+int *build_array(long array_size) {
+    long i;
+    int *result = malloc(array_size * sizeof(int));
+
+    if (result == NULL) {
+        fprintf(stderr, "boss: cannot allocate %ld elements\n", array_size);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (i = 0; i < array_size; i++) {
+        result[i] = i % 1000;
+    }
+
+    return result;
+}
+
+/* Print the elements of an array, given the array and its size. */
+void print_array(int *array, long array_size) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        printf("%3d ", array[i]);
+    }
+    printf("\n\n");
+}
+
+/* Multiply each element of an array by a scalar value. */
+void scalar_multiply(int *array, long array_size, int scalar) {
+    long i;
+    for (i = 0; i < array_size; i++) {
+        array[i] = array[i] * scalar;
+    }
+}
+
+/* Returns the number of array elements to send as one MPI "unit".  If the
+ * array size fits in an int, this is 1 and counts are simply numbers of
+ * elements.  Otherwise it is the smallest unit that makes the number of
+ * units fit in an int. */
+long choose_unit(long array_size) {
+    return (array_size + MAX_COUNT - 1) / MAX_COUNT;
+}
+
+/* Balanced decomposition of n units over p processes: the first n % p
+ * processes get one extra unit.  Fills in counts and displacements (in
+ * units) for every process. */
+void balanced_counts(long n, int p, int *counts, int *displs) {
+    int i;
+    long start = 0;
+    for (i = 0; i < p; i++) {
+        counts[i] = n / p + (i < n % p);
+        displs[i] = start;
+        start += counts[i];
+    }
+}
+
+int main(int argc, char **argv) {
+    int rank, process_count, i;
+    long array_size, unit, nunits, tail, local_size, j;
+    int scalar;
+    int *array = NULL, *local_array;
+    int *counts, *displs;
+    MPI_Datatype unit_type;
+    double t[NPHASES], tmax[NPHASES], start;
+    long errors = 0;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+
+    /* Determine how many processes there are and which one this is. */
+    MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    array_size = ARRAY_SIZE;
+    if (argc == 2) {
+        array_size = strtol(argv[1], NULL, 10);
+    }
+    if (array_size < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "usage: %s [n], where n > 0 is the array size\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Boss sets up the problem. */
+    start = MPI_Wtime();
+    if (rank == 0) {
+        array = build_array(array_size);
+        scalar = SCALAR;
+
+        if (array_size <= PRINT_LIMIT) {
+            printf("Initial array:\n");
+            print_array(array, array_size);
+        }
+    }
+    t[T_BUILD] = MPI_Wtime() - start;
+
+    /* Boss sends the scalar value and the array size to every process.
+     * The size is a long, so it is sent as an MPI_LONG.  (The barrier keeps
+     * the time workers spend waiting for the boss out of the bcast time.) */
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Bcast(&scalar, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&array_size, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    t[T_BCAST] = MPI_Wtime() - start;
+
+    /* Every process computes the same decomposition.  The array is divided
+     * into nunits units of unit elements each, plus tail leftover elements
+     * (only when unit > 1) that are given to the last process. */
+    unit = choose_unit(array_size);
+    nunits = array_size / unit;
+    tail = array_size - nunits * unit;
+
+    MPI_Type_contiguous(unit, MPI_INT, &unit_type);
+    MPI_Type_commit(&unit_type);
+
+    counts = malloc(process_count * sizeof(int));
+    displs = malloc(process_count * sizeof(int));
+    if (counts == NULL || displs == NULL) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    balanced_counts(nunits, process_count, counts, displs);
+
+    local_size = (long)counts[rank] * unit;
+    if (rank == process_count - 1) {
+        local_size += tail;
+    }
+
+    /* Each process allocates space to store its portion of the array. */
+    local_array = malloc((local_size > 0 ? local_size : 1) * sizeof(int));
+    if (local_array == NULL) {
+        fprintf(stderr, "rank %d: cannot allocate %ld elements\n", rank, local_size);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* Boss scatters the array: process i gets counts[i] units starting at
+     * unit displs[i]. */
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    MPI_Scatterv(array, counts, displs, unit_type,
+                 local_array, counts[rank], unit_type, 0, MPI_COMM_WORLD);
+    if (tail > 0 && process_count > 1) {
+        if (rank == 0) {
+            MPI_Send(array + nunits * unit, tail, MPI_INT, process_count - 1,
+                     0, MPI_COMM_WORLD);
+        } else if (rank == process_count - 1) {
+            MPI_Recv(local_array + (long)counts[rank] * unit, tail, MPI_INT,
+                     0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    } else if (tail > 0) {
+        /* a single process is both boss and last process */
+        for (j = 0; j < tail; j++) {
+            local_array[local_size - tail + j] = array[nunits * unit + j];
+        }
+    }
+    t[T_SCATTER] = MPI_Wtime() - start;
+
+    /* Every process (including boss) performs scalar multiplication over its
+     * chunk of the array in parallel. */
+    start = MPI_Wtime();
+    scalar_multiply(local_array, local_size, scalar);
+    t[T_COMPUTE] = MPI_Wtime() - start;
+
+    /* Boss gathers the chunks back into the final array. */
+    start = MPI_Wtime();
+    MPI_Gatherv(local_array, counts[rank], unit_type,
+                array, counts, displs, unit_type, 0, MPI_COMM_WORLD);
+    if (tail > 0 && process_count > 1) {
+        if (rank == process_count - 1) {
+            MPI_Send(local_array + (long)counts[rank] * unit, tail, MPI_INT,
+                     0, 0, MPI_COMM_WORLD);
+        } else if (rank == 0) {
+            MPI_Recv(array + nunits * unit, tail, MPI_INT, process_count - 1,
+                     0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    } else if (tail > 0) {
+        for (j = 0; j < tail; j++) {
+            array[nunits * unit + j] = local_array[local_size - tail + j];
+        }
+    }
+    t[T_GATHER] = MPI_Wtime() - start;
+
+    /* Boss checks (and for small arrays, prints) the final answer. */
+    start = MPI_Wtime();
+    if (rank == 0) {
+        for (j = 0; j < array_size; j++) {
+            if (array[j] != (j % 1000) * scalar) {
+                errors++;
+            }
+        }
+        if (array_size <= PRINT_LIMIT) {
+            printf("Final array:\n");
+            print_array(array, array_size);
+        }
+    }
+    t[T_VERIFY] = MPI_Wtime() - start;
+
+    /* Report the slowest process's time for each phase. */
+    MPI_Reduce(t, tmax, NPHASES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        long min_size = array_size, max_size = 0, size;
+        for (i = 0; i < process_count; i++) {
+            size = (long)counts[i] * unit + (i == process_count - 1 ? tail : 0);
+            if (size < min_size) min_size = size;
+            if (size > max_size) max_size = size;
+        }
+        printf("%ld elements on %d processes (%ld to %ld elements each)\n",
+               array_size, process_count, min_size, max_size);
+        for (i = 0; i < NPHASES; i++) {
+            printf("  %-8s %10.6f s\n", phase_names[i], tmax[i]);
+        }
+        printf("%s\n", errors ? "ERROR: wrong result" : "result verified");
+    }
+
+    /* Clean up. */
+    if (rank == 0) {
+        free(array);
+    }
+    free(local_array);
+    free(counts);
+    free(displs);
+    MPI_Type_free(&unit_type);
+    MPI_Finalize();
+
+    return errors ? 1 : 0;
+}